@@ -0,0 +1,632 @@
+#include "backend.h"
+#include "image_io.h"
+#include "buffer_pool.h"
+#include "cluster.h"
+#include "scene_stream.h"
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <omp.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#define PROGRESS_BAR_WIDTH 50  // Width of the progress bar
+
+static const FilterBackend *const compiled_backends[] = {
+#if USE_CUDA
+    &cuda_backend,
+#endif
+    &openmp_backend,
+    &serial_backend,
+};
+#define NUM_COMPILED_BACKENDS ((int)(sizeof(compiled_backends) / sizeof(compiled_backends[0])))
+
+// Backends processDataset leaves prepared with keepBackendsPrepared, each with the chain it was prepared for
+typedef struct {
+    const FilterBackend *backend;
+    FilterChain chain;
+    int threads;
+} PreparedBackend;
+
+static PreparedBackend prepared_backends[MAX_BACKENDS];
+static int num_prepared_backends = 0;
+static int keep_prepared = 0;
+
+// Function to print the progress bar
+static void printProgressBar(int current, int total) {
+    float percentage = (float)current / total;
+    int completed = (int)(percentage * PROGRESS_BAR_WIDTH);
+
+    printf("\r[");
+    for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) {
+        if (i < completed) printf("=");
+        else printf(" ");
+    }
+    printf("] %d%%", (int)(percentage * 100));
+    fflush(stdout);
+}
+
+int makeDirectory(const char *path) {
+#ifdef _WIN32
+    int status = _mkdir(path);
+#else
+    int status = mkdir(path, 0777);
+#endif
+    return status == 0 || errno == EEXIST ? 0 : -1;
+}
+
+int listBackends(const FilterBackend **backends) {
+    for (int i = 0; i < NUM_COMPILED_BACKENDS; i++) backends[i] = compiled_backends[i];
+    return NUM_COMPILED_BACKENDS;
+}
+
+const FilterBackend *findBackend(const char *name) {
+    for (int i = 0; i < NUM_COMPILED_BACKENDS; i++)
+        if (strcmp(compiled_backends[i]->name, name) == 0) return compiled_backends[i];
+    return NULL;
+}
+
+// Average pixels per frame over the manifest entries that have a size, or -1 if none has
+static double meanFramePixels(const Manifest *manifest) {
+    double pixels = 0.0;
+    int sized = 0;
+    for (int n = 0; n < manifest->count; n++) {
+        if (manifest->images[n].width <= 0 || manifest->images[n].height <= 0) continue;
+        pixels += (double)manifest->images[n].width * manifest->images[n].height;
+        sized++;
+    }
+    return sized > 0 ? pixels / sized : -1.0;
+}
+
+const FilterBackend *autoBackend(const FilterChain *chain, const Manifest *manifest) {
+#if USE_CUDA
+    double pixels = manifest ? meanFramePixels(manifest) : -1.0;
+    if (cuda_backend.available() && cuda_backend.supports(chain, 0) && (pixels < 0 || pixels >= GPU_MIN_PIXELS))
+        return &cuda_backend;
+#else
+    (void)manifest;
+    (void)meanFramePixels;
+#endif
+    if (omp_get_max_threads() > 1 && openmp_backend.supports(chain, 0)) return &openmp_backend;
+    return &serial_backend;
+}
+
+// The backends "all" stands for. Returns the count.
+static int allBackends(const FilterChain *chain, const FilterBackend **backends) {
+    int count = 0;
+    int have_openmp = openmp_backend.available() && openmp_backend.supports(chain, 0);
+    for (int i = 0; i < NUM_COMPILED_BACKENDS && count < MAX_BACKENDS; i++) {
+        const FilterBackend *backend = compiled_backends[i];
+        if (backend == &serial_backend && have_openmp) continue;
+        if (backend->available() && backend->supports(chain, 0)) backends[count++] = backend;
+    }
+    return count;
+}
+
+int parseBackendList(const char *list, const FilterChain *chain, const Manifest *manifest,
+                     const FilterBackend **backends) {
+    char buffer[256];
+    int count = 0;
+    if (strlen(list) >= sizeof(buffer)) {
+        printf("Backend list too long\n");
+        return 0;
+    }
+    if (strcmp(list, "all") == 0) return allBackends(chain, backends);
+    strcpy(buffer, list);
+
+    for (char *name = strtok(buffer, ","); name; name = strtok(NULL, ",")) {
+        const FilterBackend *backend = strcmp(name, "auto") == 0 ? autoBackend(chain, manifest) : findBackend(name);
+        if (!backend) {
+            printf("Unknown backend: %s\n", name);
+            return 0;
+        }
+        if (!backend->available()) {
+            printf("Backend not available on this machine: %s\n", name);
+            return 0;
+        }
+        if (!backend->supports(chain, 1)) return 0;
+        for (int i = 0; i < count; i++) {
+            if (backends[i] == backend) {
+                printf("Backend listed twice: %s\n", backend->name);
+                return 0;
+            }
+        }
+        if (count == MAX_BACKENDS) {
+            printf("At most %d backends can run together\n", MAX_BACKENDS);
+            return 0;
+        }
+        backends[count++] = backend;
+    }
+    if (count == 0) printf("No backend given\n");
+    return count;
+}
+
+void datasetImagePaths(const DatasetJob *job, int image, char *image_path, char *output_path) {
+    const char *file_name = job->manifest->images[image].file_name;
+    snprintf(image_path, 512, "%s/%s", job->image_dir, file_name);
+    snprintf(output_path, 512, "%s/%s", job->output_dir, file_name);
+}
+
+void datasetImageDone(DatasetJob *job, int image, int thread, int written) {
+    runReportImageDone(job->report, image, thread, written);
+    if (!written) return;
+    if (job->journal) journalImageWritten(job->journal, image, job->report->images[image].bytes_written);
+
+    // Whichever thread is due redraws the progress bar
+    int done;
+    #pragma omp atomic capture
+    done = ++job->processed;
+    // Ranks of a multi-node run would draw over each other
+    if (clusterSize() == 1 && progressRefreshDue(job->report)) printProgressBar(done, job->manifest->count);
+}
+
+typedef struct WorkQueue WorkQueue;
+
+// One backend's part of processDataset
+typedef struct {
+    const FilterBackend *backend;
+    DatasetJob *job;
+    BackendShare share;         // Static share, or the thread slots and mode of a dynamic run
+    WorkQueue *queue;           // Dynamic run: chunks are taken from here, NULL for a static share
+    int grain;
+    int written;
+    int taken;                  // Images handed to the backend so far
+    int chunks;
+    int done;                   // Images of finished chunks and the time they took: the measured rate
+    double busy_seconds;
+    int stopped;                // Left the queue
+    pthread_t thread;
+    int on_thread;              // Running on its own host thread, to be joined
+} ShareRun;
+
+// Images not handed out yet in a dynamic run. In a multi-node run with
+// SHARD_DYNAMIC, [next, count) is the window of images this node reserved last
+// and is refilled from the cluster's counter when it runs out.
+struct WorkQueue {
+    pthread_mutex_t lock;
+    const int *images;
+    int next;
+    int count;
+    int total;                  // Images in the whole queue
+    int more;                   // The cluster's counter may still hold images
+    ShareRun *runs;
+    int num_runs;
+    Prefetcher *prefetch;       // Follows the node's window, NULL if off
+};
+
+static double measuredRate(const ShareRun *run) {
+    return run->busy_seconds > 0 ? run->done / run->busy_seconds : 0.0;
+}
+
+void keepBackendsPrepared(int keep) {
+    keep_prepared = keep;
+}
+
+void releasePreparedBackends(void) {
+    for (int b = 0; b < num_prepared_backends; b++) prepared_backends[b].backend->release();
+    num_prepared_backends = 0;
+    keep_prepared = 0;
+    poolRelease();
+}
+
+// Prepare backend for chain, or reuse it if an earlier run left it prepared for the same chain.
+// A backend left prepared for another chain is released and prepared again.
+static int prepareBackend(const FilterBackend *backend, const FilterChain *chain) {
+    if (!keep_prepared) return backend->prepare(chain);
+
+    PreparedBackend *slot = NULL;
+    for (int b = 0; b < num_prepared_backends; b++)
+        if (prepared_backends[b].backend == backend) slot = &prepared_backends[b];
+    if (slot && sameFilterChain(&slot->chain, chain)) return slot->threads;
+    if (slot) backend->release();
+    else slot = &prepared_backends[num_prepared_backends++];
+
+    // The backend keeps a pointer to the chain, so it is prepared with the slot's copy
+    slot->backend = backend;
+    slot->chain = *chain;
+    slot->threads = backend->prepare(&slot->chain);
+    if (slot->threads > 0) return slot->threads;
+    *slot = prepared_backends[--num_prepared_backends];
+    return 0;
+}
+
+// Reserve the node's next window of the cluster-wide queue: SCHED_CHUNK_SECONDS
+// of work at the node's measured rate, and at least a grain for every backend.
+// Returns the size of the window, 0 once the queue is exhausted.
+static int refillQueue(WorkQueue *queue) {
+    long size = 0;
+    double rate = 0.0;
+    for (int b = 0; b < queue->num_runs; b++) {
+        size += queue->runs[b].grain;
+        rate += measuredRate(&queue->runs[b]);
+    }
+    if (rate * SCHED_CHUNK_SECONDS > size) size = (long)(rate * SCHED_CHUNK_SECONDS);
+
+    long first = clusterTake(size);
+    if (first >= queue->total) {
+        queue->more = 0;
+        return 0;
+    }
+    queue->next = (int)first;
+    queue->count = first + size < queue->total ? (int)(first + size) : queue->total;
+    if (queue->prefetch) prefetchLane(queue->prefetch, 0, queue->images + queue->next, queue->count - queue->next);
+    return queue->count - queue->next;
+}
+
+// Take run's next chunk off the queue and return its size, 0 once run should stop.
+// Until every backend still taking work has a measured rate, chunks are the
+// backend's grain, at most an equal share of what is left. After that a backend
+// takes what it processes in SCHED_CHUNK_SECONDS (at least its grain), but no
+// more than its share of the remaining images in proportion to its rate. A
+// backend whose share is under half an image stops, unless it is the fastest,
+// rather than holding up the end of the run with one slow image.
+static int takeChunk(ShareRun *run, const int **images) {
+    WorkQueue *queue = run->queue;
+    pthread_mutex_lock(&queue->lock);
+
+    int left = queue->count - queue->next;
+    if (left == 0 && queue->more) left = refillQueue(queue);
+    int active = 0, measured = 1;
+    double total_rate = 0.0, fastest = 0.0;
+    for (int b = 0; b < queue->num_runs; b++) {
+        const ShareRun *other = &queue->runs[b];
+        double rate = measuredRate(other);
+        if (other->stopped) continue;
+        active++;
+        if (rate <= 0) measured = 0;
+        total_rate += rate;
+        if (rate > fastest) fastest = rate;
+    }
+
+    int size = run->grain;
+    if (!measured) {
+        int equal = (left + active - 1) / active;
+        if (size > equal) size = equal;
+    } else {
+        double rate = measuredRate(run);
+        double share = left * rate / total_rate;
+        if (rate * SCHED_CHUNK_SECONDS > size) size = (int)(rate * SCHED_CHUNK_SECONDS);
+        if (size > ceil(share)) size = (int)ceil(share);
+        if (share < 0.5 && rate < fastest && !queue->more) size = 0;
+    }
+    if (size > left) size = left;
+
+    *images = queue->images + queue->next;
+    queue->next += size;
+    run->taken += size;
+    if (size > 0) run->chunks++;
+    else run->stopped = 1;
+    pthread_mutex_unlock(&queue->lock);
+    return size;
+}
+
+static void recordChunk(ShareRun *run, int count, double seconds) {
+    if (run->queue) pthread_mutex_lock(&run->queue->lock);
+    run->done += count;
+    run->busy_seconds += seconds;
+    if (run->queue) pthread_mutex_unlock(&run->queue->lock);
+}
+
+static void *runShare(void *arg) {
+    ShareRun *run = (ShareRun *)arg;
+    BackendShare chunk = run->share;
+
+    if (!run->queue) {
+        double start_time = wallClockSeconds();
+        run->written = run->backend->run(run->job, &chunk);
+        run->taken = chunk.count;
+        run->chunks = 1;
+        recordChunk(run, chunk.count, wallClockSeconds() - start_time);
+    } else {
+        while ((chunk.count = takeChunk(run, &chunk.images)) > 0) {
+            double start_time = wallClockSeconds();
+            run->written += run->backend->run(run->job, &chunk);
+            recordChunk(run, chunk.count, wallClockSeconds() - start_time);
+            // The mode of the first chunk; the last few small ones may be run differently
+            if (!run->share.mode[0]) run->share.mode = chunk.mode;
+        }
+    }
+    if (!run->share.mode[0]) run->share.mode = chunk.mode;
+    if (run->on_thread) poolReleaseThreadCache();
+    return NULL;
+}
+
+// Totals over the ranks of a gathered report
+static void printClusterSummary(const RunReport *report) {
+    int written = 0;
+    double slowest = 0.0;
+    for (int r = 0; r < report->num_ranks; r++) {
+        written += report->ranks[r].written;
+        if (report->ranks[r].wall_seconds > slowest) slowest = report->ranks[r].wall_seconds;
+    }
+    printf("Cluster: %d ranks, %d threads, %d images written in %.3f seconds (%.1f images/s)\n", report->num_ranks,
+           report->num_threads, written, slowest, slowest > 0 ? written / slowest : 0.0);
+}
+
+// Join the names (or modes) of the runs with '+', e.g. "openmp+cuda"
+static void joinRunNames(const ShareRun *runs, int count, int modes, char *buffer, size_t size) {
+    buffer[0] = '\0';
+    for (int b = 0; b < count; b++) {
+        const char *name = modes ? runs[b].share.mode : runs[b].backend->name;
+        size_t used = strlen(buffer);
+        snprintf(buffer + used, size - used, "%s%s", b ? "+" : "", name ? name : "");
+    }
+}
+
+int processDataset(const DatasetOptions *options, const char *backend_list, const double *weights,
+                   int num_weights) {
+    Manifest manifest;
+    int rank = clusterRank(), num_ranks = clusterSize();
+
+    int loaded;
+    if (options->file_list) {
+        loaded = listManifest(options->file_list, &manifest) == 0;
+    } else {
+        // Rank 0 parses the JSON and writes the binary cache; the other ranks then load the cache
+        if (!clusterAllOk(rank != 0 || loadManifest(options->json_path, MANIFEST_CACHE, &manifest) == 0)) return -1;
+        loaded = rank == 0 || loadManifest(options->json_path, MANIFEST_CACHE, &manifest) == 0;
+    }
+    if (!clusterAllOk(loaded)) {
+        if (loaded) freeManifest(&manifest);
+        return -1;
+    }
+
+    // Each rank picks the backends of its own node
+    const FilterBackend *backends[MAX_BACKENDS];
+    int cluster_dynamic = num_ranks > 1 && options->shard == SHARD_DYNAMIC;
+    int num_backends = parseBackendList(backend_list, &options->chain, &manifest, backends);
+    if (num_backends > 0 && num_weights != 0 && num_weights != num_backends) {
+        printf("--split needs one weight per backend\n");
+        num_backends = 0;
+    }
+    if (num_backends > 0 && num_weights != 0 && cluster_dynamic) {
+        printf("--split needs --shard block in a multi-node run\n");
+        num_backends = 0;
+    }
+
+    // Create the output directory once; every backend writes into it
+    if (num_backends > 0 && makeDirectory(options->output_dir) != 0) {
+        printf("Error creating output directory: %s\n", options->output_dir);
+        num_backends = 0;
+    }
+
+    int *images = (int *)malloc((manifest.count > 0 ? manifest.count : 1) * sizeof(int));
+    unsigned char *up_to_date = (unsigned char *)calloc(manifest.count > 0 ? manifest.count : 1, 1);
+    if (num_backends > 0 && (!images || !up_to_date)) {
+        printf("Out of memory\n");
+        num_backends = 0;
+    }
+    if (!clusterAllOk(num_backends > 0)) num_backends = 0;
+
+    // Whether wide images keep their samples is decided once for the run, and
+    // only when every stage and every backend of every rank filters them, so an
+    // output's name and depth do not depend on the backend that took the image
+    int wide_samples = num_backends > 0 && chainFiltersWide(&options->chain);
+    for (int b = 0; b < num_backends; b++)
+        if (!backends[b]->wide_samples) wide_samples = 0;
+    wide_samples = clusterAllOk(wide_samples);
+
+    // An incremental run only processes the images the journal does not have current outputs for
+    Journal journal;
+    int use_journal = num_backends > 0 && options->incremental != JOURNAL_OFF;
+    uint64_t settings = journalSettings(&options->chain, &options->output, wide_samples);
+    if (use_journal && openJournal(&journal, options->incremental, options->image_dir, options->output_dir,
+                                   &manifest, settings, up_to_date) != 0) {
+        use_journal = 0;
+        num_backends = 0;
+    }
+    int num_pending = 0;
+    for (int n = 0; images && up_to_date && n < manifest.count; n++)
+        if (!up_to_date[n]) images[num_pending++] = n;
+    if (use_journal && rank == 0)
+        printf("Incremental run (%s): %d of %d images up to date, %d to process\n",
+               journalModeName(options->incremental), manifest.count - num_pending, manifest.count, num_pending);
+
+    // Scenes too large to load whole are set aside and streamed, every rank taking part in each
+    int *scenes = NULL;
+    int num_scenes = 0;
+    if (num_backends > 0 && options->stream_above > 0) {
+        int kept = 0;
+        scenes = (int *)malloc((num_pending > 0 ? num_pending : 1) * sizeof(int));
+        for (int i = 0; scenes && i < num_pending; i++) {
+            const char *file_name = manifest.images[images[i]].file_name;
+            if (isLargeScene(options->image_dir, file_name, options->stream_above)) scenes[num_scenes++] = images[i];
+            else images[kept++] = images[i];
+        }
+        if (num_scenes > 0 && !chainStreams(&options->chain, rank == 0)) {
+            // Loaded whole like every other image instead
+            for (int s = 0; s < num_scenes; s++) images[kept++] = scenes[s];
+            num_scenes = 0;
+        }
+        num_pending = kept;
+    }
+
+    // This rank's part of the images: all of them on a single node, its block
+    // with SHARD_BLOCK, or whatever it takes from the cluster's counter
+    const int *rank_images = images;
+    int rank_count = num_pending;
+    if (num_ranks > 1 && options->shard == SHARD_BLOCK) {
+        int first = clusterBlockStart(num_pending, rank, num_ranks);
+        rank_images = images + first;
+        rank_count = clusterBlockStart(num_pending, rank + 1, num_ranks) - first;
+    }
+    if (num_ranks > 1 && num_backends > 0) {
+        printf("Rank %d of %d: %s sharding", rank, num_ranks, cluster_dynamic ? "dynamic" : "block");
+        if (!cluster_dynamic) printf(", %d images", rank_count);
+        printf("\n");
+    }
+
+    // Prepare every backend. With weights each one gets a contiguous block of the
+    // images; otherwise they all take chunks from one queue.
+    ShareRun runs[MAX_BACKENDS];
+    WorkQueue queue;
+    int dynamic = cluster_dynamic || (num_backends > 1 && num_weights == 0);
+    double total_weight = 0.0, cumulative = 0.0;
+    int prepared = 0, num_threads = 0, assigned = 0;
+    for (int b = 0; b < num_backends; b++) total_weight += num_weights ? weights[b] : 1.0;
+
+    for (int b = 0; b < num_backends; b++) {
+        ShareRun *run = &runs[b];
+        memset(run, 0, sizeof(*run));
+        run->backend = backends[b];
+
+        int threads = prepareBackend(backends[b], &options->chain);
+        if (threads <= 0) break;
+        prepared++;
+        run->grain = backends[b]->grain();
+        if (run->grain < 1) run->grain = 1;
+        run->queue = dynamic ? &queue : NULL;
+
+        cumulative += num_weights ? weights[b] : 1.0;
+        int end = b + 1 == num_backends ? rank_count
+                                        : (int)(rank_count * cumulative / total_weight + 0.5);
+        run->share.images = rank_images + assigned;
+        run->share.count = end - assigned;
+        run->share.first_thread = num_threads;
+        run->share.num_threads = threads;
+        run->share.mode = "";
+        assigned = end;
+        num_threads += threads;
+    }
+
+    RunReport report;
+    int started = num_backends > 0 && prepared == num_backends &&
+                  initRunReport(&report, backends[0]->name, &manifest, num_threads) == 0;
+    if (num_backends > 0 && prepared == num_backends && !started) printf("Out of memory\n");
+    if (!clusterAllOk(started)) {
+        if (started) freeRunReport(&report);
+        started = 0;
+    }
+    int processed_images = -1;
+
+    if (started) {
+        char program[64], mode[64];
+        Prefetcher prefetcher;
+        int use_prefetch = options->prefetch_depth > 0 &&
+                           openPrefetcher(&prefetcher, &manifest, options->image_dir, options->prefetch_depth) == 0;
+        DatasetJob job = {&manifest, options->image_dir, options->output_dir, &options->chain,
+                          &options->output, &report, use_journal ? &journal : NULL,
+                          use_prefetch ? &prefetcher : NULL, wide_samples,
+                          manifest.count - num_pending - num_scenes};
+
+        if (dynamic) {
+            pthread_mutex_init(&queue.lock, NULL);
+            queue.images = rank_images;
+            queue.next = 0;
+            queue.count = cluster_dynamic ? 0 : rank_count;
+            queue.total = rank_count;
+            queue.more = cluster_dynamic;
+            queue.runs = runs;
+            queue.num_runs = num_backends;
+            queue.prefetch = job.prefetch;
+            if (cluster_dynamic) clusterOpenCounter();
+        }
+
+        // Images are read ahead in the order the queue hands them out, or along every static share
+        if (use_prefetch) {
+            printf("Prefetching %d images ahead with %s\n", options->prefetch_depth, prefetchMethod(&prefetcher));
+            for (int b = 0; !dynamic && b < num_backends; b++)
+                prefetchLane(&prefetcher, b, runs[b].share.images, runs[b].share.count);
+            if (dynamic && !cluster_dynamic) prefetchLane(&prefetcher, 0, rank_images, rank_count);
+        }
+        for (int b = 0; b < num_backends; b++) {
+            if (dynamic)
+                printf("Backend %s: %d threads, chunks of %d+ images from the shared queue\n", backends[b]->name,
+                       runs[b].share.num_threads, runs[b].grain);
+            else
+                printf("Backend %s: %d images, %d threads\n", backends[b]->name, runs[b].share.count,
+                       runs[b].share.num_threads);
+        }
+
+        applyOutputOptions(&options->output);
+        double start_time = wallClockSeconds();
+
+        if (num_scenes > 0) {
+            if (rank == 0) {
+                printf("Streaming %d large scenes with %s, %d halo rows per band\n", num_scenes, backends[0]->name,
+                       chainHaloRows(&options->chain));
+                if (options->output.format != OUTPUT_AUTO && options->output.format != OUTPUT_RAW &&
+                    !options->output.resize_width && !options->output.resize_height)
+                    printf("Large scenes are written as raw files\n");
+            }
+            for (int s = 0; s < num_scenes; s++)
+                streamScene(&job, backends[0], scenes[s], options->band_rows, runs[0].share.first_thread);
+        }
+
+        // The first backend runs on this thread, every other one on a host thread of its own
+        for (int b = 0; b < num_backends; b++) {
+            runs[b].job = &job;
+            runs[b].on_thread = b > 0 && pthread_create(&runs[b].thread, NULL, runShare, &runs[b]) == 0;
+        }
+        for (int b = 0; b < num_backends; b++)
+            if (!runs[b].on_thread) runShare(&runs[b]);
+        for (int b = 0; b < num_backends; b++)
+            if (runs[b].on_thread) pthread_join(runs[b].thread, NULL);
+        double wall_seconds = wallClockSeconds() - start_time;
+
+        if (dynamic) pthread_mutex_destroy(&queue.lock);
+        if (cluster_dynamic) clusterCloseCounter();
+        if (use_prefetch) {
+            closePrefetcher(&prefetcher, &report);
+            if (prefetcher.own_reads > 0 || prefetcher.timing.empty_waits > 0)
+                printf("\nPrefetch: %ld images read ahead, %ld waited for, %ld read by the backends\n",
+                       prefetcher.timing.pushes, prefetcher.timing.empty_waits, prefetcher.own_reads);
+        }
+
+        processed_images = job.processed;
+        if (manifest.count > 0 && num_ranks == 1) printProgressBar(processed_images, manifest.count);
+
+        if (num_ranks > 1)
+            printf("Rank %d: %d images written in %.3f seconds\n", rank,
+                   processed_images - (manifest.count - num_pending - num_scenes), wall_seconds);
+        else
+            printf("\nProcessing time: %.3f seconds\n", wall_seconds);
+        for (int b = 0; b < num_backends; b++) {
+            const ShareRun *run = &runs[b];
+            BackendTiming timing = {run->backend->name, run->share.mode, run->share.first_thread,
+                                    run->share.num_threads, run->taken, run->written, run->chunks,
+                                    run->busy_seconds};
+            runReportBackend(&report, &timing);
+            if (num_backends > 1)
+                printf("Backend %s: %d of %d images written in %d chunks, %.1f images/s (%s)\n",
+                       run->backend->name, run->written, run->taken, run->chunks, measuredRate(run),
+                       run->share.mode);
+        }
+        printRunSummary(&report);
+
+        joinRunNames(runs, num_backends, 0, program, sizeof(program));
+        joinRunNames(runs, num_backends, 1, mode, sizeof(mode));
+        report.program = program;
+        report.mode = mode;
+        report.decoders = decoderNames();
+        report.encoder = pngEncoder()->name;
+
+        // Rank 0 writes one report for the whole cluster
+        if (num_ranks > 1) {
+            clusterGatherReport(&report, wall_seconds);
+            if (rank == 0) printClusterSummary(&report);
+        }
+        if (options->report_path && rank == 0) writeRunReport(&report, options->report_path);
+        freeRunReport(&report);
+    }
+
+    // Left prepared, with the pool's buffers, for the next run
+    if (!keep_prepared) {
+        for (int b = 0; b < prepared; b++) backends[b]->release();
+        poolRelease();
+    }
+    if (use_journal) closeJournal(&journal);
+    free(images);
+    free(scenes);
+    free(up_to_date);
+    freeManifest(&manifest);
+    return processed_images;
+}
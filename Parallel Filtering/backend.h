@@ -0,0 +1,161 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "manifest_loader.h"
+#include "filter_chain.h"
+#include "output_format.h"
+#include "run_report.h"
+#include "journal.h"
+#include "cluster.h"
+#include "prefetch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Filter backends and the dataset driver they share. Every backend (serial,
+// OpenMP, CUDA) implements FilterBackend, and one driver (sar_filter.c) picks
+// them at runtime. processDataset loads the manifest, creates the output
+// directory and sets up the run report once, then runs the backends side by
+// side, each handing it chunks of images. A backend only decides how a chunk
+// is spread over threads or GPU streams; loading, saving and progress go
+// through image_io.h and the helpers below.
+
+// Build with -DUSE_CUDA=1 (and filter_apply_cuda.cu compiled by nvcc) to include the CUDA backend
+#ifndef USE_CUDA
+#define USE_CUDA 0
+#endif
+
+#define MAX_BACKENDS 4
+#define GPU_MIN_PIXELS (512 * 512)  // "auto" keeps smaller frames on the CPU, where no copies are needed
+#define SCHED_CHUNK_SECONDS 0.25    // Work a backend takes from the shared queue at once, at its measured rate
+
+typedef struct {
+    const char *json_path;
+    const char *file_list;      // Comma-separated file names in image_dir to process instead of json_path's
+                                // images (listManifest), NULL = the manifest
+    const char *image_dir;
+    const char *output_dir;
+    const char *report_path;    // NULL = no JSON run report
+    FilterChain chain;
+    OutputOptions output;
+    JournalMode incremental;    // JOURNAL_OFF = process every image
+    ShardMode shard;            // How the ranks of a multi-node run split the images
+    long long stream_above;     // Raw scenes with this many bytes of samples or more are streamed
+                                // band by band (scene_stream.h); 0 = never
+    int band_rows;              // Rows per band of a streamed scene, 0 = STREAM_BAND_BYTES worth
+    int prefetch_depth;         // Images read ahead of each backend (prefetch.h), 0 = no prefetching
+} DatasetOptions;
+
+// State shared by the backends during processDataset
+typedef struct {
+    const Manifest *manifest;
+    const char *image_dir;
+    const char *output_dir;
+    const FilterChain *chain;
+    const OutputOptions *output;
+    RunReport *report;
+    Journal *journal;           // NULL unless the run is incremental
+    Prefetcher *prefetch;       // Reads images ahead for loadInputImage, NULL if off
+    int wide_samples;           // Load 16-bit PNGs and wide raw files at full depth (loadInputImage's wide)
+    int processed;              // Images written so far (or up to date), by every backend
+} DatasetJob;
+
+// Images handed to one run() call and the backend's run report thread slots
+typedef struct {
+    const int *images;          // Manifest indices
+    int count;
+    int first_thread;           // Report thread of the backend's thread 0
+    int num_threads;
+    const char *mode;           // Set by run(): how the share was processed, for the run report
+} BackendShare;
+
+typedef struct {
+    const char *name;
+    const char *usage;          // Backend-specific options for the usage text, "" if none
+    int wide_samples;           // Filters u16/f32 frames (of chains chainFiltersWide accepts); a run
+                                // without it decodes 16-bit PNGs to 8 bits (DatasetJob.wide_samples)
+
+    // 1 if the backend can run on this machine (e.g. a CUDA device is present)
+    int (*available)(void);
+    // 1 if the backend can run the chain; with verbose, says why not on stderr
+    int (*supports)(const FilterChain *chain, int verbose);
+    // Parse a backend option at argv[*i] like parseBenchOption: 1 if used, 0 if not, -1 if invalid
+    int (*parse_option)(int argc, char **argv, int *i);
+    // Set up for the chain (devices, kernels, constants). Returns the number of
+    // threads run() reports timings under, or 0 on failure.
+    int (*prepare)(const FilterChain *chain);
+    // Images run() needs at once to keep every thread or stream busy (after prepare)
+    int (*grain)(void);
+    // Filter and save the share's images. Called once per chunk when the images
+    // are scheduled dynamically. Returns the number written.
+    int (*run)(DatasetJob *job, BackendShare *share);
+    // Filter one frame of PixelType dtype src -> dst with the prepared chain, synchronously,
+    // with all of the backend's threads (benchmark, scene bands). Returns 0 if it cannot.
+    int (*filter_frame)(const void *src, void *dst, int width, int height, int dtype);
+    // Release what prepare set up
+    void (*release)(void);
+} FilterBackend;
+
+extern const FilterBackend serial_backend;
+extern const FilterBackend openmp_backend;
+#if USE_CUDA
+extern const FilterBackend cuda_backend;
+#endif
+
+// Backends compiled into this binary, fastest first. Returns the count.
+int listBackends(const FilterBackend **backends);
+const FilterBackend *findBackend(const char *name);
+
+// The backend "auto" runs: CUDA when a device is present, it supports the
+// chain and the frames are at least GPU_MIN_PIXELS on average (per the
+// manifest, which may be NULL), then OpenMP with more than one core, then serial.
+const FilterBackend *autoBackend(const FilterChain *chain, const Manifest *manifest);
+
+// Parse a comma-separated backend list ("auto", "openmp", "openmp,cuda", ...).
+// "all" stands for every available backend that supports the chain, leaving
+// out serial when OpenMP is there to use the same cores.
+// Returns the number of backends, or 0 after reporting an unknown or unavailable one.
+int parseBackendList(const char *list, const FilterChain *chain, const Manifest *manifest,
+                     const FilterBackend **backends);
+
+// Input and output paths of image n of the job (buffers of 512 bytes)
+void datasetImagePaths(const DatasetJob *job, int image, char *image_path, char *output_path);
+
+// Record image as finished by thread (in the report and the journal), and
+// redraw the progress bar when it is due
+void datasetImageDone(DatasetJob *job, int image, int thread, int written);
+
+// Run the backends of backend_list (see parseBackendList) over the dataset,
+// concurrently. With num_weights weights, one per backend, the images are
+// split up front into contiguous blocks in proportion to them. Otherwise
+// (num_weights 0) the backends pull chunks from a shared queue: each takes
+// what it gets through in about SCHED_CHUNK_SECONDS at its measured
+// throughput, capped near the end of the queue so that all of them finish
+// together. With options->incremental the journal in the output directory is
+// consulted first and the images whose outputs are up to date are skipped.
+// Scenes of options->stream_above bytes or more are filtered first, one at a
+// time and band by band, by the first backend (scene_stream.h). With
+// options->prefetch_depth the images are read ahead of the backends in the
+// order they will take them.
+// In a multi-node run (cluster.h) every rank calls processDataset on the same
+// options and processes its part of the images with its own backends.
+// Returns the number of images written or up to date (by this rank), or -1 if the run could not start.
+int processDataset(const DatasetOptions *options, const char *backend_list, const double *weights,
+                   int num_weights);
+
+// With keep set, processDataset leaves its backends prepared and the buffer
+// pool's blocks cached when it returns, and later calls reuse a backend without
+// preparing it again while their chain is the same (service.h).
+// releasePreparedBackends releases them all, empties the pool and stops keeping them.
+void keepBackendsPrepared(int keep);
+void releasePreparedBackends(void);
+
+// Create a directory unless it exists. Returns 0 on success.
+int makeDirectory(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
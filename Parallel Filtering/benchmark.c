@@ -0,0 +1,396 @@
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stb_image_write.h"
+#include "manifest_loader.h"
+#include "run_report.h"
+#include "codec.h"
+#include "buffer_pool.h"
+#include "pixel_type.h"
+
+#define BENCH_DEFAULT_REPEATS 10
+#define BENCH_DEFAULT_WARMUP 2
+#define BENCH_NUM_STAGES 4
+
+static const char *stage_names[BENCH_NUM_STAGES] = {"decode", "filter", "encode", "total"};
+
+// A benchmark input: the encoded bytes, so that every repeat decodes from memory
+typedef struct {
+    char name[256];
+    int width, height;
+    unsigned char *encoded;
+    size_t encoded_size;
+} BenchFrame;
+
+// Results for one frame
+typedef struct {
+    char name[256];
+    int width, height;
+    double median[BENCH_NUM_STAGES];  // Seconds
+    double p95[BENCH_NUM_STAGES];
+    int max_diff;                     // Largest difference from the reference, -1 if not checked
+    long differing;                   // Pixels that differ from the reference at all
+} BenchResult;
+
+// Growable byte buffer the synthetic frames are encoded into
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} ByteSink;
+
+void initBenchOptions(BenchOptions *options) {
+    memset(options, 0, sizeof(*options));
+    options->sizes[0][0] = options->sizes[0][1] = 256;
+    options->sizes[1][0] = options->sizes[1][1] = 1024;
+    options->sizes[2][0] = options->sizes[2][1] = 4096;
+    options->num_sizes = 3;
+    options->repeats = BENCH_DEFAULT_REPEATS;
+    options->warmup = BENCH_DEFAULT_WARMUP;
+}
+
+const char *benchUsage(void) {
+    return "[--bench] [--bench-sizes WxH[,WxH...]] [--bench-repeats N] [--bench-warmup N]\n"
+           "    [--bench-real N] [--bench-dataset JSON IMAGE_DIR] [--bench-csv FILE] [--bench-json FILE]";
+}
+
+static int parseSizes(const char *list, BenchOptions *options) {
+    int count = 0;
+    const char *p = list;
+
+    while (*p) {
+        int width, height, consumed;
+        if (count == BENCH_MAX_SIZES || sscanf(p, "%dx%d%n", &width, &height, &consumed) != 2) return -1;
+        if (width < 1 || height < 1) return -1;
+        options->sizes[count][0] = width;
+        options->sizes[count][1] = height;
+        count++;
+        p += consumed;
+        if (*p == ',') p++;
+        else if (*p) return -1;
+    }
+    if (count == 0) return -1;
+    options->num_sizes = count;
+    return 0;
+}
+
+int parseBenchOption(int argc, char **argv, int *i, BenchOptions *options) {
+    const char *option = argv[*i];
+    if (strncmp(option, "--bench", 7) != 0) return 0;
+
+    options->enabled = 1;
+    if (strcmp(option, "--bench") == 0) return 1;
+    if (*i + 1 >= argc) return -1;
+
+    const char *value = argv[++*i];
+    if (strcmp(option, "--bench-sizes") == 0) return parseSizes(value, options) == 0 ? 1 : -1;
+    if (strcmp(option, "--bench-csv") == 0) {
+        options->csv_path = value;
+        return 1;
+    }
+    if (strcmp(option, "--bench-json") == 0) {
+        options->json_path = value;
+        return 1;
+    }
+    if (strcmp(option, "--bench-dataset") == 0) {
+        if (*i + 1 >= argc) return -1;
+        options->dataset_json = value;
+        options->dataset_dir = argv[++*i];
+        return 1;
+    }
+
+    int number = atoi(value);
+    if (strcmp(option, "--bench-repeats") == 0 && number >= 1) options->repeats = number;
+    else if (strcmp(option, "--bench-warmup") == 0 && number >= 0) options->warmup = number;
+    else if (strcmp(option, "--bench-real") == 0 && number >= 0) options->real_frames = number;
+    else return -1;
+    return 1;
+}
+
+static void writeToSink(void *context, void *data, int size) {
+    ByteSink *sink = (ByteSink *)context;
+    if (sink->size + size > sink->capacity) {
+        size_t capacity = sink->capacity ? sink->capacity : 64 * 1024;
+        while (capacity < sink->size + size) capacity *= 2;
+        unsigned char *grown = (unsigned char *)realloc(sink->data, capacity);
+        if (!grown) return;
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+    memcpy(sink->data + sink->size, data, size);
+    sink->size += size;
+}
+
+// Speckle-like test pattern: smooth structure with multiplicative noise
+static void syntheticPixels(unsigned char *pixels, int width, int height) {
+    unsigned int state = 12345u;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            state = state * 1664525u + 1013904223u;
+            double base = 110.0 + 60.0 * sin(x / 37.0) * cos(y / 53.0);
+            double speckle = 0.5 + (state >> 8) / (double)(1u << 24);
+            double value = base * speckle;
+            pixels[(size_t)y * width + x] = (unsigned char)(value > 255.0 ? 255.0 : value);
+        }
+    }
+}
+
+static int syntheticFrame(BenchFrame *frame, int width, int height) {
+    unsigned char *pixels = (unsigned char *)malloc((size_t)width * height);
+    if (!pixels) return 0;
+    syntheticPixels(pixels, width, height);
+
+    ByteSink sink = {0};
+    stbi_write_png_to_func(writeToSink, &sink, width, height, 1, pixels, width);
+    free(pixels);
+    if (!sink.data) return 0;
+
+    snprintf(frame->name, sizeof(frame->name), "synthetic");
+    frame->width = width;
+    frame->height = height;
+    frame->encoded = sink.data;
+    frame->encoded_size = sink.size;
+    return 1;
+}
+
+static int realFrame(BenchFrame *frame, const char *image_dir, const char *file_name) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", image_dir, file_name);
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("Could not read image: %s\n", path);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    frame->encoded = length > 0 ? (unsigned char *)malloc(length) : NULL;
+    int ok = frame->encoded && fread(frame->encoded, 1, length, file) == (size_t)length;
+    fclose(file);
+
+    // Decoded once up front for its size, by the codecs that decode it in the timed runs
+    int dtype;
+    void *pixels = ok ? decodeGray(frame->encoded, (size_t)length, 0, &frame->width, &frame->height, &dtype) : NULL;
+    ok = pixels != NULL;
+    poolFree(pixels);
+    if (!ok) {
+        printf("Could not read image: %s\n", path);
+        free(frame->encoded);
+        return 0;
+    }
+    snprintf(frame->name, sizeof(frame->name), "%s", file_name);
+    frame->encoded_size = (size_t)length;
+    return 1;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Nearest-rank percentile of n sorted samples
+static double percentile(const double *sorted, int n, double p) {
+    int rank = (int)ceil(p * n) - 1;
+    if (rank < 0) rank = 0;
+    if (rank >= n) rank = n - 1;
+    return sorted[rank];
+}
+
+static int benchFrame(const BenchBackend *backend, const BenchOptions *options,
+                      const BenchFrame *frame, BenchResult *result) {
+    size_t size = (size_t)frame->width * frame->height;
+    unsigned char *output = (unsigned char *)malloc(size);
+    unsigned char *reference = (unsigned char *)malloc(size);
+    double *samples = (double *)malloc(BENCH_NUM_STAGES * options->repeats * sizeof(double));
+    const ImageEncoder *encoder = pngEncoder();
+    FILE *encoded = tmpfile();  // Rewritten by every repeat, like an output file by processDataset
+    int ok = output && reference && samples && encoded;
+    if (!encoded) printf("Could not create a temporary file for the encoded frames\n");
+
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s", frame->name);
+    result->width = frame->width;
+    result->height = frame->height;
+
+    // Decoded and encoded with the codecs processDataset uses (codec.h), 8-bit PNGs at the encoder's default level
+    for (int r = 0; ok && r < options->warmup + options->repeats; r++) {
+        int width, height, dtype;
+        size_t encoded_size = 0;
+        double t0 = wallClockSeconds();
+        unsigned char *pixels = (unsigned char *)decodeGray(frame->encoded, frame->encoded_size, 0, &width, &height,
+                                                            &dtype);
+        double t1 = wallClockSeconds();
+        if (!pixels || dtype != PIXEL_U8 || width != frame->width || height != frame->height) {
+            poolFree(pixels);
+            ok = 0;
+            break;
+        }
+
+        backend->filter(pixels, output, width, height, backend->context);
+        double t2 = wallClockSeconds();
+
+        rewind(encoded);
+        ok = encoder->write_png(encoded, output, width, height, encoder->default_level, &encoded_size);
+        double t3 = wallClockSeconds();
+
+        if (r == 0 && backend->reference)
+            backend->reference(pixels, reference, width, height, backend->reference_context);
+        poolFree(pixels);
+
+        if (r >= options->warmup) {
+            int n = r - options->warmup;
+            samples[0 * options->repeats + n] = t1 - t0;
+            samples[1 * options->repeats + n] = t2 - t1;
+            samples[2 * options->repeats + n] = t3 - t2;
+            samples[3 * options->repeats + n] = t3 - t0;
+        }
+    }
+
+    if (ok) {
+        for (int s = 0; s < BENCH_NUM_STAGES; s++) {
+            double *stage = samples + s * options->repeats;
+            qsort(stage, options->repeats, sizeof(double), compareDoubles);
+            result->median[s] = percentile(stage, options->repeats, 0.5);
+            result->p95[s] = percentile(stage, options->repeats, 0.95);
+        }
+        if (!backend->reference) result->max_diff = result->differing = -1;
+        for (size_t i = 0; backend->reference && i < size; i++) {
+            int diff = abs((int)output[i] - (int)reference[i]);
+            if (diff > result->max_diff) result->max_diff = diff;
+            if (diff) result->differing++;
+        }
+    }
+
+    free(output);
+    free(reference);
+    free(samples);
+    if (encoded) fclose(encoded);
+    return ok;
+}
+
+static double megapixelsPerSecond(const BenchResult *result, int stage) {
+    return result->median[stage] > 0 ? (double)result->width * result->height / 1e6 / result->median[stage] : 0.0;
+}
+
+static void writeCsv(const char *path, const char *backend, const BenchResult *results, int count) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Could not write %s\n", path);
+        return;
+    }
+    fprintf(file, "backend,frame,width,height,stage,median_ms,p95_ms,mpix_per_s,max_diff,differing_pixels,"
+                  "decoders,encoder\n");
+    for (int i = 0; i < count; i++) {
+        for (int s = 0; s < BENCH_NUM_STAGES; s++) {
+            fprintf(file, "%s,%s,%d,%d,%s,%.4f,%.4f,%.2f,%d,%ld,%s,%s\n", backend, results[i].name,
+                    results[i].width, results[i].height, stage_names[s], results[i].median[s] * 1e3,
+                    results[i].p95[s] * 1e3, megapixelsPerSecond(&results[i], s), results[i].max_diff,
+                    results[i].differing, decoderNames(), pngEncoder()->name);
+        }
+    }
+    fclose(file);
+}
+
+static void writeJson(const char *path, const char *backend, const BenchOptions *options,
+                      const BenchResult *results, int count) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Could not write %s\n", path);
+        return;
+    }
+    fprintf(file, "{\n  \"backend\": ");
+    writeJsonString(file, backend);
+    fprintf(file, ",\n  \"codecs\": {\"decode\": ");
+    writeJsonString(file, decoderNames());
+    fprintf(file, ", \"encode\": ");
+    writeJsonString(file, pngEncoder()->name);
+    fprintf(file, "},\n  \"repeats\": %d,\n  \"warmup\": %d,\n  \"tolerance\": %d,\n  \"frames\": [\n",
+            options->repeats, options->warmup, BENCH_TOLERANCE);
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "    {\"frame\": ");
+        writeJsonString(file, results[i].name);
+        fprintf(file, ", \"width\": %d, \"height\": %d, \"max_diff\": %d, \"differing_pixels\": %ld,\n",
+                results[i].width, results[i].height, results[i].max_diff, results[i].differing);
+        fprintf(file, "     \"stages\": {");
+        for (int s = 0; s < BENCH_NUM_STAGES; s++) {
+            fprintf(file, "%s\"%s\": {\"median_ms\": %.4f, \"p95_ms\": %.4f, \"mpix_per_s\": %.2f}",
+                    s ? ", " : "", stage_names[s], results[i].median[s] * 1e3, results[i].p95[s] * 1e3,
+                    megapixelsPerSecond(&results[i], s));
+        }
+        fprintf(file, "}}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+int runBenchmark(const BenchBackend *backend, const BenchOptions *options,
+                 const char *json_path, const char *image_dir) {
+    int max_frames = options->num_sizes + options->real_frames;
+    BenchFrame *frames = (BenchFrame *)calloc(max_frames > 0 ? max_frames : 1, sizeof(BenchFrame));
+    BenchResult *results = (BenchResult *)calloc(max_frames > 0 ? max_frames : 1, sizeof(BenchResult));
+    int num_frames = 0, num_results = 0, failures = 0;
+
+    if (!frames || !results) {
+        printf("Out of memory\n");
+        free(frames);
+        free(results);
+        return -1;
+    }
+
+    for (int i = 0; i < options->num_sizes; i++)
+        if (syntheticFrame(&frames[num_frames], options->sizes[i][0], options->sizes[i][1])) num_frames++;
+
+    if (options->dataset_json) {
+        json_path = options->dataset_json;
+        image_dir = options->dataset_dir;
+    }
+    if (options->real_frames > 0 && (!json_path || !image_dir))
+        printf("--bench-real needs --json and --images, or --bench-dataset\n");
+    if (options->real_frames > 0 && json_path && image_dir) {
+        Manifest manifest;
+        if (loadManifest(json_path, MANIFEST_CACHE, &manifest) == 0) {
+            for (int n = 0; n < manifest.count && n < options->real_frames; n++)
+                if (realFrame(&frames[num_frames], image_dir, manifest.images[n].file_name)) num_frames++;
+            freeManifest(&manifest);
+        }
+    }
+
+    printf("Benchmark: %s backend, %d frames, %d repeats after %d warmup, codecs: decode %s, encode %s\n",
+           backend->name, num_frames, options->repeats, options->warmup, decoderNames(), pngEncoder()->name);
+    printf("%-24s %11s  %-17s %-17s %-17s %9s  %s\n", "frame", "size", "decode ms (p50/p95)",
+           "filter ms", "encode ms", "MPix/s", "check");
+
+    for (int i = 0; i < num_frames; i++) {
+        BenchResult *result = &results[num_results];
+        if (!benchFrame(backend, options, &frames[i], result)) {
+            printf("%-24s benchmark failed\n", frames[i].name);
+            failures++;
+            continue;
+        }
+        num_results++;
+
+        int passed = result->max_diff <= BENCH_TOLERANCE;
+        if (!passed) failures++;
+        printf("%-24.24s %5dx%-5d  %7.3f/%-9.3f %7.3f/%-9.3f %7.3f/%-9.3f %9.1f  ",
+               result->name, result->width, result->height,
+               result->median[0] * 1e3, result->p95[0] * 1e3,
+               result->median[1] * 1e3, result->p95[1] * 1e3,
+               result->median[2] * 1e3, result->p95[2] * 1e3,
+               megapixelsPerSecond(result, 1));
+        if (result->max_diff < 0) printf("unchecked\n");
+        else printf("%s (max diff %d, %ld px)\n", passed ? "ok" : "MISMATCH", result->max_diff, result->differing);
+    }
+
+    if (options->csv_path) writeCsv(options->csv_path, backend->name, results, num_results);
+    if (options->json_path) writeJson(options->json_path, backend->name, options, results, num_results);
+
+    for (int i = 0; i < num_frames; i++) free(frames[i].encoded);
+    free(frames);
+    free(results);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Benchmark harness shared by every filter backend (sar_filter --bench).
+// Every backend runs the same frames - synthetic ones of set sizes and,
+// optionally, real frames from the dataset - through decode, filter and encode,
+// with the codecs a dataset run uses (codec.h).
+// Each stage is timed on the wall clock over repeated runs after a warmup, and
+// median/p95 plus MPix/s are reported. Each backend's output is checked
+// against a reference run of the same chain (the serial backend), and the
+// results can be written as CSV and JSON.
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_TOLERANCE 1   // Largest per-pixel difference from the reference that still passes
+
+// One backend's filter chain on an 8-bit frame: src -> dst, src is not modified
+typedef void (*BenchFilterFn)(const unsigned char *src, unsigned char *dst, int width, int height,
+                              void *context);
+
+typedef struct {
+    const char *name;       // Reported backend name ("serial", "openmp", "cuda")
+    BenchFilterFn filter;
+    void *context;
+    BenchFilterFn reference;  // The same chain to compare the output with, NULL = unchecked
+    void *reference_context;
+} BenchBackend;
+
+typedef struct {
+    int enabled;
+    int sizes[BENCH_MAX_SIZES][2];  // Synthetic frame sizes (width, height)
+    int num_sizes;
+    int repeats;
+    int warmup;
+    int real_frames;                // First N images of the dataset manifest
+    const char *dataset_json;       // Overrides the binary's manifest path; NULL = keep it
+    const char *dataset_dir;
+    const char *csv_path;           // NULL = no CSV
+    const char *json_path;          // NULL = no JSON
+} BenchOptions;
+
+void initBenchOptions(BenchOptions *options);
+
+// Parse a --bench* option at argv[*i], advancing *i past its arguments.
+// Returns 1 if it was a bench option, 0 if not, -1 if its arguments are invalid.
+int parseBenchOption(int argc, char **argv, int *i, BenchOptions *options);
+
+// Usage text for the bench options
+const char *benchUsage(void);
+
+// Run the benchmark. json_path/image_dir locate the real frames unless
+// --bench-dataset overrides them.
+// Returns 0 if every output matched the reference within BENCH_TOLERANCE.
+int runBenchmark(const BenchBackend *backend, const BenchOptions *options,
+                 const char *json_path, const char *image_dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
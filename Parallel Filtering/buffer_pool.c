@@ -0,0 +1,134 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Every block carries a small header recording its capacity. Freed blocks are
+// kept per thread (no locking) and handed back by poolMalloc when they are big
+// enough, so after the first few images decoding, filtering and encoding run
+// without touching the system allocator or faulting in fresh pages.
+
+typedef struct {
+    size_t capacity;
+} PoolHeader;
+
+typedef struct {
+    void *blocks[POOL_THREAD_BLOCKS];
+    int count;
+} PoolCache;
+
+static THREAD_LOCAL PoolCache pool_thread_cache;
+static void *pool_shared_blocks[POOL_SHARED_BLOCKS];
+static int pool_shared_count = 0;
+static pthread_mutex_t pool_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t poolCapacity(void *block) {
+    return ((PoolHeader *)block)->capacity;
+}
+
+// Take the smallest block of at least size bytes from the list, or NULL
+static void *takeBlock(void **blocks, int *count, size_t size) {
+    int best = -1;
+    for (int i = 0; i < *count; i++) {
+        if (poolCapacity(blocks[i]) >= size &&
+            (best < 0 || poolCapacity(blocks[i]) < poolCapacity(blocks[best])))
+            best = i;
+    }
+    if (best < 0) return NULL;
+
+    void *block = blocks[best];
+    blocks[best] = blocks[--(*count)];
+    return block;
+}
+
+// Store block in the list, evicting the smallest entry if that one is smaller.
+// Returns the block that did not fit (to be freed), or NULL.
+static void *putBlock(void **blocks, int *count, int limit, void *block) {
+    if (*count < limit) {
+        blocks[(*count)++] = block;
+        return NULL;
+    }
+
+    int smallest = 0;
+    for (int i = 1; i < *count; i++)
+        if (poolCapacity(blocks[i]) < poolCapacity(blocks[smallest])) smallest = i;
+    if (poolCapacity(blocks[smallest]) >= poolCapacity(block)) return block;
+
+    void *evicted = blocks[smallest];
+    blocks[smallest] = block;
+    return evicted;
+}
+
+void *poolMalloc(size_t size) {
+    void *block = NULL;
+
+    if (size >= POOL_MIN_BLOCK) {
+        PoolCache *cache = &pool_thread_cache;
+        block = takeBlock(cache->blocks, &cache->count, size);
+        if (!block && pool_shared_count > 0) {
+            pthread_mutex_lock(&pool_shared_lock);
+            block = takeBlock(pool_shared_blocks, &pool_shared_count, size);
+            pthread_mutex_unlock(&pool_shared_lock);
+        }
+    }
+
+    if (!block) {
+        block = malloc(POOL_HEADER_SIZE + size);
+        if (!block) return NULL;
+        ((PoolHeader *)block)->capacity = size;
+    }
+    return (char *)block + POOL_HEADER_SIZE;
+}
+
+void poolFree(void *ptr) {
+    if (!ptr) return;
+
+    void *block = (char *)ptr - POOL_HEADER_SIZE;
+    if (poolCapacity(block) < POOL_MIN_BLOCK) {
+        free(block);
+        return;
+    }
+
+    PoolCache *cache = &pool_thread_cache;
+    block = putBlock(cache->blocks, &cache->count, POOL_THREAD_BLOCKS, block);
+    if (block) {
+        pthread_mutex_lock(&pool_shared_lock);
+        block = putBlock(pool_shared_blocks, &pool_shared_count, POOL_SHARED_BLOCKS, block);
+        pthread_mutex_unlock(&pool_shared_lock);
+        free(block);
+    }
+}
+
+void *poolRealloc(void *ptr, size_t size) {
+    if (!ptr) return poolMalloc(size);
+
+    size_t capacity = poolCapacity((char *)ptr - POOL_HEADER_SIZE);
+    if (size <= capacity) return ptr;
+
+    void *new_ptr = poolMalloc(size);
+    if (!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, capacity);
+    poolFree(ptr);
+    return new_ptr;
+}
+
+void poolReleaseThreadCache(void) {
+    PoolCache *cache = &pool_thread_cache;
+    while (cache->count > 0)
+        free(cache->blocks[--cache->count]);
+}
+
+void poolRelease(void) {
+    poolReleaseThreadCache();
+    pthread_mutex_lock(&pool_shared_lock);
+    while (pool_shared_count > 0)
+        free(pool_shared_blocks[--pool_shared_count]);
+    pthread_mutex_unlock(&pool_shared_lock);
+}
@@ -0,0 +1,38 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pool of frame-sized buffers shared by every backend. Image buffers, and
+// everything stb allocates while decoding and encoding (see image_io.c), come
+// from here, so frames are recycled between images instead of going back to
+// malloc every time. Blocks of at least POOL_MIN_BLOCK bytes are recycled. Each
+// thread caches up to POOL_THREAD_BLOCKS freed blocks; overflow goes to a shared
+// list of POOL_SHARED_BLOCKS so blocks freed on one thread (e.g. a pipeline
+// writer) can be reused on another (e.g. a reader).
+
+#define POOL_MIN_BLOCK (64 * 1024)
+#define POOL_THREAD_BLOCKS 4
+#define POOL_SHARED_BLOCKS 16
+#define POOL_HEADER_SIZE 64          // Keeps pooled buffers 64-byte aligned for SIMD loads
+
+void *poolMalloc(size_t size);
+void *poolRealloc(void *ptr, size_t size);
+void poolFree(void *ptr);
+
+// Return the calling thread's cached blocks to the system
+void poolReleaseThreadCache(void);
+
+// Release all cached blocks: the calling thread's and the shared list.
+// Worker threads release their own caches with poolReleaseThreadCache.
+void poolRelease(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,209 @@
+#include "cluster.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if USE_MPI
+#include <mpi.h>
+
+static int cluster_rank = 0;
+static int cluster_size = 1;
+static MPI_Win counter_window = MPI_WIN_NULL;
+static long *counter_value;
+
+// Per-image record of the images one rank processed
+typedef struct {
+    int index;
+    ImageTiming timing;
+} ImageRecord;
+#endif
+
+int parseShardMode(const char *name, ShardMode *mode) {
+    if (strcmp(name, "dynamic") == 0) *mode = SHARD_DYNAMIC;
+    else if (strcmp(name, "block") == 0) *mode = SHARD_BLOCK;
+    else return -1;
+    return 0;
+}
+
+void clusterInit(int *argc, char ***argv) {
+#if USE_MPI
+    // Backends call clusterTake from their own host threads, one at a time
+    int provided;
+    MPI_Init_thread(argc, argv, MPI_THREAD_SERIALIZED, &provided);
+    if (provided < MPI_THREAD_SERIALIZED) {
+        fprintf(stderr, "MPI does not support calls from several threads\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, &cluster_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &cluster_size);
+#else
+    (void)argc;
+    (void)argv;
+#endif
+}
+
+void clusterFinalize(void) {
+#if USE_MPI
+    MPI_Finalize();
+#endif
+}
+
+int clusterRank(void) {
+#if USE_MPI
+    return cluster_rank;
+#else
+    return 0;
+#endif
+}
+
+int clusterSize(void) {
+#if USE_MPI
+    return cluster_size;
+#else
+    return 1;
+#endif
+}
+
+void clusterBarrier(void) {
+#if USE_MPI
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+}
+
+int clusterAllOk(int ok) {
+#if USE_MPI
+    int all = ok != 0;
+    MPI_Allreduce(MPI_IN_PLACE, &all, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return all;
+#else
+    return ok != 0;
+#endif
+}
+
+void clusterMaxFlags(unsigned char *flags, int count) {
+#if USE_MPI
+    if (count > 0) MPI_Allreduce(MPI_IN_PLACE, flags, count, MPI_UNSIGNED_CHAR, MPI_MAX, MPI_COMM_WORLD);
+#else
+    (void)flags;
+    (void)count;
+#endif
+}
+
+int clusterBlockStart(int count, int rank, int size) {
+    return (int)((long long)count * rank / size);
+}
+
+void clusterOpenCounter(void) {
+#if USE_MPI
+    // The counter lives on rank 0; every rank keeps a passive-target epoch open on it
+    MPI_Aint size = cluster_rank == 0 ? sizeof(long) : 0;
+    MPI_Win_allocate(size, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &counter_value, &counter_window);
+    if (cluster_rank == 0) *counter_value = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_lock_all(0, counter_window);
+#endif
+}
+
+long clusterTake(long count) {
+#if USE_MPI
+    long first;
+    MPI_Fetch_and_op(&count, &first, MPI_LONG, 0, 0, MPI_SUM, counter_window);
+    MPI_Win_flush(0, counter_window);
+    return first;
+#else
+    (void)count;
+    return 0;
+#endif
+}
+
+void clusterCloseCounter(void) {
+#if USE_MPI
+    MPI_Win_unlock_all(counter_window);
+    MPI_Win_free(&counter_window);
+#endif
+}
+
+void clusterGatherReport(RunReport *report, double wall_seconds) {
+#if USE_MPI
+    int count = report->manifest->count;
+    RankTiming summary;
+    int name_length;
+
+    memset(&summary, 0, sizeof(summary));
+    summary.rank = cluster_rank;
+    char host[MPI_MAX_PROCESSOR_NAME];
+    MPI_Get_processor_name(host, &name_length);
+    snprintf(summary.host, sizeof(summary.host), "%.*s", (int)sizeof(summary.host) - 1, host);  // Truncated to fit
+    snprintf(summary.program, sizeof(summary.program), "%s", report->program);
+    snprintf(summary.mode, sizeof(summary.mode), "%s", report->mode);
+    summary.threads = report->num_threads;
+    summary.wall_seconds = wall_seconds;
+
+    // The images this rank got to; every other record is untouched
+    ImageRecord *records = (ImageRecord *)malloc((count > 0 ? count : 1) * sizeof(ImageRecord));
+    int num_records = 0;
+    for (int n = 0; records && n < count; n++) {
+        const ImageTiming *image = &report->images[n];
+        if (image->status == 0) continue;
+        if (image->status > 0) summary.written++;
+        else summary.failed++;
+        records[num_records].index = n;
+        records[num_records].timing = *image;
+        num_records++;
+    }
+    summary.images = num_records;
+
+    RankTiming *ranks = cluster_rank == 0 ? (RankTiming *)calloc(cluster_size, sizeof(RankTiming)) : NULL;
+    MPI_Gather(&summary, sizeof(summary), MPI_BYTE, ranks, sizeof(summary), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    int *record_bytes = NULL, *record_offsets = NULL, *thread_bytes = NULL, *thread_offsets = NULL;
+    ImageRecord *all_records = NULL;
+    ThreadTiming *all_threads = NULL;
+    int total_records = 0, total_threads = 0;
+    if (cluster_rank == 0) {
+        record_bytes = (int *)malloc(4 * cluster_size * sizeof(int));
+        record_offsets = record_bytes + cluster_size;
+        thread_bytes = record_offsets + cluster_size;
+        thread_offsets = thread_bytes + cluster_size;
+        for (int r = 0; r < cluster_size; r++) {
+            record_offsets[r] = total_records * (int)sizeof(ImageRecord);
+            record_bytes[r] = ranks[r].images * (int)sizeof(ImageRecord);
+            thread_offsets[r] = total_threads * (int)sizeof(ThreadTiming);
+            thread_bytes[r] = ranks[r].threads * (int)sizeof(ThreadTiming);
+            total_records += ranks[r].images;
+            total_threads += ranks[r].threads;
+        }
+        all_records = (ImageRecord *)malloc((total_records > 0 ? total_records : 1) * sizeof(ImageRecord));
+        all_threads = (ThreadTiming *)malloc(total_threads * sizeof(ThreadTiming));
+    }
+    MPI_Gatherv(records, num_records * (int)sizeof(ImageRecord), MPI_BYTE, all_records, record_bytes,
+                record_offsets, MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(report->threads, report->num_threads * (int)sizeof(ThreadTiming), MPI_BYTE, all_threads,
+                thread_bytes, thread_offsets, MPI_BYTE, 0, MPI_COMM_WORLD);
+    free(records);
+
+    if (cluster_rank == 0) {
+        // Threads are numbered across the ranks, rank 0's first
+        int record = 0, thread_base = 0;
+        for (int r = 0; r < cluster_size; r++) {
+            for (int i = 0; i < ranks[r].images; i++, record++) {
+                ImageTiming *image = &report->images[all_records[record].index];
+                *image = all_records[record].timing;
+                if (image->thread >= 0) image->thread += thread_base;
+            }
+            thread_base += ranks[r].threads;
+        }
+        free(report->threads);
+        report->threads = all_threads;
+        report->num_threads = total_threads;
+        report->ranks = ranks;
+        report->num_ranks = cluster_size;
+        free(all_records);
+        free(record_bytes);
+    }
+#else
+    (void)report;
+    (void)wall_seconds;
+#endif
+}
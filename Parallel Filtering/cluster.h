@@ -0,0 +1,63 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "run_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Multi-node runs over MPI. Every rank is one sar_filter process running its
+// own local backends (so one node may use its GPU while another has none) on
+// its part of the manifest. The manifest is loaded by every rank from the
+// shared filesystem: rank 0 parses the JSON and writes the binary cache first,
+// the others then read the cache, so nothing the size of the manifest is
+// broadcast. Images are handed out in contiguous blocks per rank or, by
+// default, in chunks taken from a counter on rank 0 through one-sided MPI
+// atomics, so no rank has to act as a master. At the end the per-image
+// timings and per-rank throughput are gathered into rank 0's run report.
+//
+// Without -DUSE_MPI=1 (and mpicc) these functions describe a single rank.
+
+#ifndef USE_MPI
+#define USE_MPI 0
+#endif
+
+typedef enum {
+    SHARD_DYNAMIC,  // Ranks take chunks from a shared counter
+    SHARD_BLOCK     // Rank r processes the r-th contiguous block of the images
+} ShardMode;
+
+// Parse "dynamic" or "block". Returns 0 on success.
+int parseShardMode(const char *name, ShardMode *mode);
+
+void clusterInit(int *argc, char ***argv);
+void clusterFinalize(void);
+int clusterRank(void);
+int clusterSize(void);
+void clusterBarrier(void);
+
+// 1 if ok is set on every rank. Collective: every rank must call it at the same point.
+int clusterAllOk(int ok);
+
+// Element-wise maximum of flags[0..count) over the ranks, in place
+void clusterMaxFlags(unsigned char *flags, int count);
+
+// First of the block of count items [first, first + count) of rank (out of size ranks)
+int clusterBlockStart(int count, int rank, int size);
+
+// Shared counter for SHARD_DYNAMIC (collective open and close). clusterTake
+// reserves count items and returns the first; it may run past the end.
+void clusterOpenCounter(void);
+long clusterTake(long count);
+void clusterCloseCounter(void);
+
+// Merge every rank's per-image timings, thread totals and a per-rank summary
+// into rank 0's report. Collective; only rank 0's report is complete afterwards.
+void clusterGatherReport(RunReport *report, double wall_seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+#include "codec.h"
+#include "buffer_pool.h"
+#include "pixel_type.h"
+#include "output_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#if USE_LIBJPEG
+#include <jpeglib.h>
+#endif
+#if USE_LIBPNG
+#include <png.h>
+
+// zlib does better than stb's deflate at every level: 3 writes smaller files
+// than stb at 8 in half its time
+#define LIBPNG_DEFAULT_LEVEL 3
+#endif
+
+// ---- stb_image (every format it knows) ----
+
+static int stbAccepts(const unsigned char *data, size_t size) {
+    (void)data;
+    (void)size;
+    return 1;
+}
+
+static void *stbDecode(const unsigned char *data, size_t size, int wide, int *width, int *height, int *dtype) {
+    int channels;
+    if (wide && stbi_is_16_bit_from_memory(data, (int)size)) {
+        *dtype = PIXEL_U16;
+        return stbi_load_16_from_memory(data, (int)size, width, height, &channels, STBI_grey);
+    }
+    *dtype = PIXEL_U8;
+    return stbi_load_from_memory(data, (int)size, width, height, &channels, STBI_grey);
+}
+
+// stb_image_write's level is set once for the run (applyOutputOptions)
+typedef struct {
+    FILE *file;
+    size_t size;
+    int ok;
+} PngSink;
+
+static void writeSink(void *context, void *data, int size) {
+    PngSink *sink = (PngSink *)context;
+    sink->ok = sink->ok && fwrite(data, 1, size, sink->file) == (size_t)size;
+    sink->size += size;
+}
+
+static int stbWritePng(FILE *file, const unsigned char *pixels, int width, int height, int level, size_t *size) {
+    PngSink sink = {file, 0, 1};
+    (void)level;
+    sink.ok = stbi_write_png_to_func(writeSink, &sink, width, height, 1, pixels, width) != 0 && sink.ok;
+    *size += sink.size;
+    return sink.ok;
+}
+
+// ---- libjpeg (libjpeg-turbo) ----
+
+#if USE_LIBJPEG
+typedef struct {
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+} JpegError;
+
+static void jpegErrorExit(j_common_ptr info) {
+    longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+static void jpegSilence(j_common_ptr info, int level) {
+    (void)info;
+    (void)level;
+}
+
+static int jpegAccepts(const unsigned char *data, size_t size) {
+    return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+// Straight to gray in the library: the luma of YCbCr files is decoded without color conversion
+static void *jpegDecode(const unsigned char *data, size_t size, int wide, int *width, int *height, int *dtype) {
+    struct jpeg_decompress_struct info;
+    JpegError error;
+    unsigned char *volatile pixels = NULL;
+    (void)wide;
+
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+    error.manager.emit_message = jpegSilence;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        poolFree(pixels);
+        return NULL;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, data, (unsigned long)size);
+    jpeg_read_header(&info, TRUE);
+    if (info.jpeg_color_space == JCS_CMYK || info.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&info);
+        return NULL;
+    }
+    info.out_color_space = JCS_GRAYSCALE;
+    jpeg_start_decompress(&info);
+
+    size_t row_size = info.output_width;
+    pixels = (unsigned char *)poolMalloc(row_size * info.output_height);
+    if (!pixels) longjmp(error.jump, 1);
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = pixels + info.output_scanline * row_size;
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    *width = (int)info.output_width;
+    *height = (int)info.output_height;
+    *dtype = PIXEL_U8;
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return pixels;
+}
+#endif
+
+// ---- libpng ----
+
+#if USE_LIBPNG
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+} PngSource;
+
+static void pngRead(png_structp png, png_bytep out, png_size_t length) {
+    PngSource *source = (PngSource *)png_get_io_ptr(png);
+    if (length > source->size - source->offset) png_error(png, "truncated");
+    memcpy(out, source->data + source->offset, length);
+    source->offset += length;
+}
+
+static void pngSilence(png_structp png, png_const_charp message) {
+    (void)png;
+    (void)message;
+}
+
+// stb's luma weights, so both decoders turn color into the same gray
+static unsigned grayOf(unsigned r, unsigned g, unsigned b) {
+    return (r * 77 + g * 150 + b * 29) >> 8;
+}
+
+static int pngAccepts(const unsigned char *data, size_t size) {
+    return size >= 8 && png_sig_cmp(data, 0, 8) == 0;
+}
+
+// Samples are read as the file stores them (palettes and low bit depths
+// expanded) and reduced to gray here the way stb does: luma of RGB at full
+// depth, alpha dropped, 16-bit samples cut to their high byte unless wide.
+static void *pngDecode(const unsigned char *data, size_t size, int wide, int *width, int *height, int *dtype) {
+    PngSource source = {data, size, 0};
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, pngSilence, pngSilence);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    unsigned char *volatile samples = NULL;
+    unsigned char *volatile pixels = NULL;
+    png_bytep *volatile rows = NULL;
+    if (!info) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return NULL;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        if (samples != pixels) free(samples);
+        poolFree(pixels);
+        free(rows);
+        return NULL;
+    }
+    png_set_read_fn(png, &source, pngRead);
+    png_read_info(png, info);
+
+    int color_type = png_get_color_type(png, info);
+    int bit_depth = png_get_bit_depth(png, info);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) png_set_expand_gray_1_2_4_to_8(png);
+    const uint16_t one = 1;
+    if (bit_depth == 16 && *(const unsigned char *)&one) png_set_swap(png);  // PNG is big-endian
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    size_t w = png_get_image_width(png, info), h = png_get_image_height(png, info);
+    int channels = png_get_channels(png, info);
+    int sample_size = png_get_bit_depth(png, info) == 16 ? 2 : 1;
+    int out_size = sample_size == 2 && wide ? 2 : 1;
+    size_t row_size = png_get_rowbytes(png, info);
+
+    // Single-channel files of the output depth are read in place
+    pixels = (unsigned char *)poolMalloc(w * h * out_size);
+    int in_place = channels == 1 && sample_size == out_size;
+    samples = in_place ? pixels : (unsigned char *)malloc(row_size * h);
+    rows = (png_bytep *)malloc(h * sizeof(png_bytep));
+    if (!pixels || !samples || !rows) png_error(png, "out of memory");
+    for (size_t y = 0; y < h; y++) rows[y] = samples + y * row_size;
+    png_read_image(png, rows);
+    png_read_end(png, NULL);
+
+    // Gray and gray+alpha keep their first channel; RGB and RGBA become luma
+    if (!in_place) {
+        for (size_t y = 0; y < h; y++) {
+            for (size_t x = 0; x < w; x++) {
+                unsigned v;
+                if (sample_size == 2) {
+                    const uint16_t *s = (const uint16_t *)(rows[y]) + x * channels;
+                    v = channels >= 3 ? grayOf(s[0], s[1], s[2]) : s[0];
+                    if (out_size == 2) ((uint16_t *)pixels)[y * w + x] = (uint16_t)v;
+                    else pixels[y * w + x] = (unsigned char)(v >> 8);
+                } else {
+                    const unsigned char *s = rows[y] + x * channels;
+                    pixels[y * w + x] = (unsigned char)(channels >= 3 ? grayOf(s[0], s[1], s[2]) : s[0]);
+                }
+            }
+        }
+        free(samples);
+    }
+    free(rows);
+    png_destroy_read_struct(&png, &info, NULL);
+    *width = (int)w;
+    *height = (int)h;
+    *dtype = out_size == 2 ? PIXEL_U16 : PIXEL_U8;
+    return pixels;
+}
+
+static void pngWrite(png_structp png, png_bytep data, png_size_t length) {
+    PngSink *sink = (PngSink *)png_get_io_ptr(png);
+    sink->ok = sink->ok && fwrite(data, 1, length, sink->file) == length;
+    sink->size += length;
+}
+
+static void pngFlush(png_structp png) {
+    (void)png;
+}
+
+static int pngWritePng(FILE *file, const unsigned char *pixels, int width, int height, int level, size_t *size) {
+    PngSink sink = {file, 0, 1};
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, pngSilence, pngSilence);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (!info) {
+        png_destroy_write_struct(&png, NULL);
+        return 0;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return 0;
+    }
+    png_set_write_fn(png, &sink, pngWrite, pngFlush);
+    png_set_compression_level(png, level);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    for (int y = 0; y < height; y++) png_write_row(png, (png_const_bytep)(pixels + (size_t)y * width));
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    *size += sink.size;
+    return sink.ok;
+}
+#endif
+
+static const ImageDecoder decoders[] = {
+#if USE_LIBJPEG
+#ifdef LIBJPEG_TURBO_VERSION
+    {"libjpeg-turbo", jpegAccepts, jpegDecode},
+#else
+    {"libjpeg", jpegAccepts, jpegDecode},
+#endif
+#endif
+#if USE_LIBPNG
+    {"libpng", pngAccepts, pngDecode},
+#endif
+    {"stb", stbAccepts, stbDecode},
+};
+#define NUM_DECODERS ((int)(sizeof(decoders) / sizeof(decoders[0])))
+
+static const ImageEncoder encoders[] = {
+#if USE_LIBPNG
+    {"libpng", LIBPNG_DEFAULT_LEVEL, pngWritePng},
+#endif
+    {"stb", DEFAULT_PNG_COMPRESSION_LEVEL, stbWritePng},
+};
+
+void *decodeGray(const unsigned char *data, size_t size, int wide, int *width, int *height, int *dtype) {
+    for (int d = 0; d < NUM_DECODERS; d++) {
+        if (!decoders[d].accepts(data, size)) continue;
+        void *pixels = decoders[d].decode(data, size, wide, width, height, dtype);
+        if (pixels) return pixels;
+    }
+    return NULL;
+}
+
+const ImageEncoder *pngEncoder(void) {
+    return &encoders[0];
+}
+
+// Built on the first call, which the driver makes before starting any threads
+const char *decoderNames(void) {
+    static char names[128];
+    if (!names[0]) {
+        for (int d = 0; d < NUM_DECODERS; d++) {
+            size_t used = strlen(names);
+            snprintf(names + used, sizeof(names) - used, "%s%s", d ? "+" : "", decoders[d].name);
+        }
+    }
+    return names;
+}
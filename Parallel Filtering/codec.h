@@ -0,0 +1,60 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Codecs for the encoded images a dataset is read from and written to.
+// Decoders are tried in order on a file's contents; the first one that takes
+// it decodes it, and stb_image, which is always built in, takes every format
+// it knows. A library decoder that fails on a file (a CMYK JPEG, say) hands it
+// on to stb. 8-bit PNG output goes through the first built-in encoder.
+//
+// Build with -DUSE_LIBJPEG=1 (-ljpeg, libjpeg-turbo or any libjpeg 8 API) for
+// JPEG decoding and -DUSE_LIBPNG=1 (-lpng) for PNG decoding and encoding; both
+// default to stb. Library and stb decoders convert color to gray the same
+// way, but their JPEG IDCTs round differently, so JPEG pixels can be off by one.
+
+#ifndef USE_LIBJPEG
+#define USE_LIBJPEG 0
+#endif
+#ifndef USE_LIBPNG
+#define USE_LIBPNG 0
+#endif
+
+typedef struct {
+    const char *name;
+    // 1 if data looks like a file this decoder reads
+    int (*accepts)(const unsigned char *data, size_t size);
+    // Decode to grayscale: 16-bit samples for 16-bit sources when wide is set,
+    // 8-bit otherwise. Returns pool-allocated pixels (buffer_pool.h) or NULL.
+    void *(*decode)(const unsigned char *data, size_t size, int wide, int *width, int *height, int *dtype);
+} ImageDecoder;
+
+typedef struct {
+    const char *name;
+    int default_level;  // zlib level when --format png gives none
+    // Write an 8-bit grayscale PNG to file at zlib level (0-9). Returns 1 on
+    // success and adds the bytes written to *size.
+    int (*write_png)(FILE *file, const unsigned char *pixels, int width, int height, int level, size_t *size);
+} ImageEncoder;
+
+// Decode with the first decoder that accepts data and succeeds. Returns the
+// pixels (free with poolFree) or NULL.
+void *decodeGray(const unsigned char *data, size_t size, int wide, int *width, int *height, int *dtype);
+
+// The PNG encoder writeOutputImage uses
+const ImageEncoder *pngEncoder(void);
+
+// Decoders in the order they are tried, joined with '+', e.g. "libjpeg-turbo+libpng+stb"
+const char *decoderNames(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,61 +1,93 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+// Serial backend: the reference implementation of every filter, run one image
+// at a time on a single thread. Filters work in place on 8-bit frames. Each
+// filter runs its window over the interior, where it fits, and the rows and
+// columns along the edges separately, completed as the stage's border says.
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
-#include "cJSON.h"
 #include <string.h>
 #include <math.h>
-#include <sys/stat.h> // For mkdir on Unix-like systems
-#include <errno.h>    // For errno and EEXIST on Unix-like systems
-
-#ifdef _WIN32
-#include <direct.h> // For mkdir on Windows
-#define mkdir(dir) _mkdir(dir) // Define mkdir for Windows
-#endif
-
-#define PROGRESS_BAR_WIDTH 50  // Width of the progress bar
-
-// Function to print the progress bar
-void printProgressBar(int current, int total) {
-    float percentage = (float)current / total;
-    int completed = (int)(percentage * PROGRESS_BAR_WIDTH);
-    
-    printf("\r[");  
-    for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) {
-        if (i < completed) printf("=");
-        else printf(" ");
+#include "backend.h"
+#include "image_io.h"
+
+// The fill value of a constant border as an 8-bit sample
+static int fillSample(const FilterStage *stage) {
+    return (int)(stage->fill < 0 ? 0 : (stage->fill > 255 ? 255 : stage->fill));
+}
+
+// Sample (i, j), which may lie outside the image, completed as stage->border says
+static int borderSample(const unsigned char *image_data, int width, int height, int i, int j,
+                        const FilterStage *stage) {
+    int y = borderIndex(i, height, stage->border), x = borderIndex(j, width, stage->border);
+    return y < 0 || x < 0 ? fillSample(stage) : image_data[y * width + x];
+}
+
+// Columns [0, *left) and [*right, width) of row i are the ones a window of
+// radius offset does not fit around: all of them in the edge rows
+static void borderColumns(int i, int width, int height, int offset, int *left, int *right) {
+    if (i < offset || i >= height - offset) {
+        *left = *right = width;
+        return;
+    }
+    *left = offset < width ? offset : width;
+    *right = width - offset > *left ? width - offset : *left;
+}
+
+// Gaussian of edge pixel (i, j), accumulated in the same order as the interior
+static unsigned char gaussianEdgePixel(const unsigned char *image_data, int width, int height, int i, int j,
+                                       const double *kernel, const FilterStage *stage) {
+    if (stage->border == BORDER_KEEP) return image_data[i * width + j];
+
+    int offset = stage->size / 2;
+    double pixel_value = 0.0;
+    for (int k = -offset; k <= offset; k++) {
+        for (int l = -offset; l <= offset; l++) {
+            pixel_value += borderSample(image_data, width, height, i + k, j + l, stage) *
+                           kernel[(k + offset) * stage->size + (l + offset)];
+        }
     }
-    printf("] %d%%", (int)(percentage * 100));
-    fflush(stdout);
+    return (unsigned char)(pixel_value < 0 ? 0 : (pixel_value > 255 ? 255 : pixel_value));
+}
+
+// Box mean of edge pixel (i, j)
+static unsigned char boxEdgePixel(const unsigned char *image_data, int width, int height, int i, int j,
+                                  const FilterStage *stage) {
+    if (stage->border == BORDER_KEEP) return image_data[i * width + j];
+
+    int offset = stage->size / 2;
+    int sum = 0;
+    for (int k = -offset; k <= offset; k++)
+        for (int l = -offset; l <= offset; l++)
+            sum += borderSample(image_data, width, height, i + k, j + l, stage);
+    return (unsigned char)(sum / (stage->size * stage->size));
 }
 
 // Function to apply Gaussian filter
-void applyGaussianFilter(unsigned char *image_data, int width, int height) {
-    int kernel_size = 5;
-    double sigma = 1.5;
-    double kernel[5][5];
+static void applyGaussianFilter(unsigned char *image_data, int width, int height, const FilterStage *stage) {
+    int kernel_size = stage->size;
+    double sigma = stage->sigma;
+    double *kernel = (double *)malloc(kernel_size * kernel_size * sizeof(double));
     double sum = 0.0;
+    if (!kernel) return;
 
     for (int i = 0; i < kernel_size; i++) {
         for (int j = 0; j < kernel_size; j++) {
             double x = i - kernel_size / 2;
             double y = j - kernel_size / 2;
-            kernel[i][j] = exp(-(x * x + y * y) / (2 * sigma * sigma));
-            sum += kernel[i][j];
+            kernel[i * kernel_size + j] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+            sum += kernel[i * kernel_size + j];
         }
     }
 
     for (int i = 0; i < kernel_size; i++)
         for (int j = 0; j < kernel_size; j++)
-            kernel[i][j] /= sum;
+            kernel[i * kernel_size + j] /= sum;
 
     unsigned char *temp = (unsigned char *)malloc(width * height);
-    if (!temp) return;
+    if (!temp) {
+        free(kernel);
+        return;
+    }
 
     int offset = kernel_size / 2;
     for (int i = offset; i < height - offset; i++) {
@@ -63,20 +95,30 @@ void applyGaussianFilter(unsigned char *image_data, int width, int height) {
             double pixel_value = 0.0;
             for (int k = -offset; k <= offset; k++) {
                 for (int l = -offset; l <= offset; l++) {
-                    pixel_value += image_data[(i + k) * width + (j + l)] * kernel[k + offset][l + offset];
+                    pixel_value += image_data[(i + k) * width + (j + l)] * kernel[(k + offset) * kernel_size + (l + offset)];
                 }
             }
             temp[i * width + j] = (unsigned char)(pixel_value < 0 ? 0 : (pixel_value > 255 ? 255 : pixel_value));
         }
     }
 
+    for (int i = 0; i < height; i++) {
+        int left, right;
+        borderColumns(i, width, height, offset, &left, &right);
+        for (int j = 0; j < left; j++)
+            temp[i * width + j] = gaussianEdgePixel(image_data, width, height, i, j, kernel, stage);
+        for (int j = right; j < width; j++)
+            temp[i * width + j] = gaussianEdgePixel(image_data, width, height, i, j, kernel, stage);
+    }
+
     memcpy(image_data, temp, width * height);
     free(temp);
+    free(kernel);
 }
 
 // Function to apply Wiener filter (approximation)
-void applyWienerFilter(unsigned char *image_data, int width, int height) {
-    int kernel_size = 5;
+static void applyWienerFilter(unsigned char *image_data, int width, int height, const FilterStage *stage) {
+    int kernel_size = stage->size;
     int kernel_area = kernel_size * kernel_size;
 
     unsigned char *temp = (unsigned char *)malloc(width * height);
@@ -95,106 +137,238 @@ void applyWienerFilter(unsigned char *image_data, int width, int height) {
         }
     }
 
+    for (int i = 0; i < height; i++) {
+        int left, right;
+        borderColumns(i, width, height, offset, &left, &right);
+        for (int j = 0; j < left; j++)
+            temp[i * width + j] = boxEdgePixel(image_data, width, height, i, j, stage);
+        for (int j = right; j < width; j++)
+            temp[i * width + j] = boxEdgePixel(image_data, width, height, i, j, stage);
+    }
+
     memcpy(image_data, temp, width * height);
     free(temp);
 }
 
-// Function to process the dataset and save the processed images in a different folder
-void processDataset(const char *json_path, const char *image_dir, const char *output_dir) {
-    clock_t start, end;
-    double cpu_time_used;
+// Local mean and variance over the window around (i, j): clipped at the image
+// edges for a keep border, completed by the border otherwise
+static void localStatistics(const unsigned char *image_data, int width, int height, int i, int j, int offset,
+                            const FilterStage *stage, double *mean, double *variance) {
+    double sum = 0.0, sum_sq = 0.0;
+    int n = 0;
+    for (int k = i - offset; k <= i + offset; k++) {
+        for (int l = j - offset; l <= j + offset; l++) {
+            int inside = k >= 0 && k < height && l >= 0 && l < width;
+            if (!inside && stage->border == BORDER_KEEP) continue;
+            int x = inside ? image_data[k * width + l] : borderSample(image_data, width, height, k, l, stage);
+            sum += x;
+            sum_sq += x * x;
+            n++;
+        }
+    }
+    *mean = sum / n;
+    *variance = sum_sq / n - *mean * *mean;
+    if (*variance < 0) *variance = 0;
+}
 
-    FILE *file = fopen(json_path, "r");
-    if (!file) {
-        printf("Could not open JSON file: %s\n", json_path);
-        return;
+// Frost estimate of pixel (i, j): the window weighted by distance from the
+// centre, clipped at the image edges for a keep border as localStatistics is
+static double frostPixel(const unsigned char *image_data, int width, int height, int i, int j, int offset,
+                         double mean, double variance, const FilterStage *stage) {
+    double weights[2 * MAX_FILTER_SIZE];
+    frostWeights(frostCoefficient(stage, mean, variance), offset, weights);
+
+    double sum = 0.0, weight_sum = 0.0;
+    for (int k = -offset; k <= offset; k++) {
+        for (int l = -offset; l <= offset; l++) {
+            int inside = i + k >= 0 && i + k < height && j + l >= 0 && j + l < width;
+            if (!inside && stage->border == BORDER_KEEP) continue;
+            double weight = weights[abs(k) + abs(l)];
+            sum += weight * borderSample(image_data, width, height, i + k, j + l, stage);
+            weight_sum += weight;
+        }
     }
+    return sum / weight_sum;
+}
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    char *json_data = (char *)malloc(length + 1);
-    fread(json_data, 1, length, file);
-    json_data[length] = '\0';
-    fclose(file);
-
-    cJSON *root = cJSON_Parse(json_data);
-    if (!root) {
-        printf("Error parsing JSON\n");
-        free(json_data);
-        return;
+// Function to apply a local-statistics filter: the adaptive Wiener filter (as
+// in MATLAB's wiener2), Lee, enhanced Lee or Frost (see localStatisticsValue).
+// A negative noise_variance is estimated as the mean of the local variances.
+static void applyLocalStatisticsFilter(unsigned char *image_data, int width, int height, const FilterStage *stage) {
+    int kernel_size = stage->size;
+    double noise_variance = stage->noise;
+    unsigned char *temp = (unsigned char *)malloc(width * height);
+    if (!temp) return;
+
+    int offset = kernel_size / 2;
+    double mean, variance;
+    if (stage->kind == FILTER_ADAPTIVE_WIENER && noise_variance < 0) {
+        double variance_sum = 0.0;
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                localStatistics(image_data, width, height, i, j, offset, stage, &mean, &variance);
+                variance_sum += variance;
+            }
+        }
+        noise_variance = variance_sum / ((double)width * height);
     }
 
-    cJSON *images = cJSON_GetObjectItem(root, "images");
-    if (!cJSON_IsArray(images)) {
-        printf("Invalid JSON format\n");
-        cJSON_Delete(root);
-        free(json_data);
-        return;
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            localStatistics(image_data, width, height, i, j, offset, stage, &mean, &variance);
+            double value = stage->kind == FILTER_FROST
+                ? frostPixel(image_data, width, height, i, j, offset, mean, variance, stage)
+                : localStatisticsValue(stage, noise_variance, image_data[i * width + j], mean, variance);
+            value += 0.5;
+            temp[i * width + j] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+        }
     }
 
-    int total_images = cJSON_GetArraySize(images);
-    int processed_images = 0;
+    memcpy(image_data, temp, width * height);
+    free(temp);
+}
 
-    start = clock(); // Start timing
+static int compareSamples(const void *a, const void *b) {
+    return *(const unsigned char *)a - *(const unsigned char *)b;
+}
 
-    cJSON *image_item;
-    cJSON_ArrayForEach(image_item, images) {
-        cJSON *file_name = cJSON_GetObjectItem(image_item, "file_name");
-        if (!cJSON_IsString(file_name)) continue;
+// Function to apply the median filter
+static void applyMedianFilter(unsigned char *image_data, int width, int height, const FilterStage *stage) {
+    int kernel_size = stage->size;
+    unsigned char window[MAX_FILTER_SIZE * MAX_FILTER_SIZE];
+    unsigned char *temp = (unsigned char *)malloc(width * height);
+    if (!temp) return;
+
+    int offset = kernel_size / 2;
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            int inside = i >= offset && i < height - offset && j >= offset && j < width - offset;
+            if (!inside && stage->border == BORDER_KEEP) {
+                temp[i * width + j] = image_data[i * width + j];
+                continue;
+            }
+            int n = 0;
+            for (int k = -offset; k <= offset; k++)
+                for (int l = -offset; l <= offset; l++)
+                    window[n++] = (unsigned char)borderSample(image_data, width, height, i + k, j + l, stage);
+            qsort(window, n, 1, compareSamples);
+            temp[i * width + j] = window[n / 2];
+        }
+    }
+
+    memcpy(image_data, temp, width * height);
+    free(temp);
+}
+
+// Run every stage of the chain over the image, in place
+static void applyFilterChain(unsigned char *image_data, int width, int height, const FilterChain *chain) {
+    for (int i = 0; i < chain->count; i++) {
+        const FilterStage *stage = &chain->stages[i];
+        switch (stage->kind) {
+            case FILTER_GAUSSIAN:
+                applyGaussianFilter(image_data, width, height, stage);
+                break;
+            case FILTER_BOX:
+                applyWienerFilter(image_data, width, height, stage);
+                break;
+            case FILTER_ADAPTIVE_WIENER:
+            case FILTER_LEE:
+            case FILTER_ENHANCED_LEE:
+            case FILTER_FROST:
+                applyLocalStatisticsFilter(image_data, width, height, stage);
+                break;
+            case FILTER_MEDIAN:
+                applyMedianFilter(image_data, width, height, stage);
+                break;
+        }
+    }
+}
+
+static const FilterChain *serial_chain;
+
+static int serialAvailable(void) {
+    return 1;
+}
+
+static int serialSupports(const FilterChain *chain, int verbose) {
+    (void)chain;
+    (void)verbose;
+    return 1;
+}
+
+static int serialParseOption(int argc, char **argv, int *i) {
+    (void)argc;
+    (void)argv;
+    (void)i;
+    return 0;
+}
+
+static int serialPrepare(const FilterChain *chain) {
+    serial_chain = chain;
+    return 1;
+}
+
+// One image at a time keeps the only thread busy
+static int serialGrain(void) {
+    return 1;
+}
 
+// Load, filter in place and save each image of the share in manifest order
+static int serialRun(DatasetJob *job, BackendShare *share) {
+    int thread = share->first_thread;
+    int written_images = 0;
+    share->mode = "serial";
+
+    for (int k = 0; k < share->count; k++) {
+        int n = share->images[k];
         char image_path[512];
         char output_path[512];
-        
-        // Original image path
-        sprintf(image_path, "%s/%s", image_dir, file_name->valuestring);
-        
-        // Output path for processed images (change this to your desired folder)
-        sprintf(output_path, "%s/%s", output_dir, file_name->valuestring);
-
-        int width, height, channels;
-        unsigned char *image_data = stbi_load(image_path, &width, &height, &channels, STBI_grey);
-        if (!image_data) {
-            printf("\nCould not read image: %s\n", image_path);
+        InputImage input;
+        datasetImagePaths(job, n, image_path, output_path);
+
+        // The serial reference filters 8-bit images only (a run with it has no wide_samples)
+        if (!loadInputImage(image_path, 0, &input, job->prefetch, job->report, n, thread)) {
+            datasetImageDone(job, n, thread, 0);
             continue;
         }
 
         // Apply filters
-        applyGaussianFilter(image_data, width, height);
-        applyWienerFilter(image_data, width, height);
-
-        // Create the output directory if it doesn't exist
-        if (mkdir(output_dir) == -1 && errno != EEXIST) {
-            printf("Error creating output directory: %s\n", output_dir);
-            free(image_data);
-            continue;
-        }
+        double stage_start = wallClockSeconds();
+        applyFilterChain((unsigned char *)input.pixels, input.width, input.height, job->chain);
+        runReportStage(job->report, n, thread, STAGE_FILTER, wallClockSeconds() - stage_start);
 
         // Save processed image to the new location
-        stbi_write_png(output_path, width, height, 1, image_data, width);
-        stbi_image_free(image_data);
-
-        // Update progress bar
-        processed_images++;
-        printProgressBar(processed_images, total_images);
+        int written = saveOutputImage(output_path, input.pixels, input.width, input.height, PIXEL_U8, job->output,
+                                      input.is_raw, job->report, n, thread);
+        freeInputImage(&input);
+        datasetImageDone(job, n, thread, written);
+        written_images += written;
     }
-
-    cJSON_Delete(root);
-    free(json_data);
-
-    end = clock();
-    cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
-    
-    printf("\nProcessing time: %.3f seconds\n", cpu_time_used);
+    return written_images;
 }
 
-int main() {
-    printf("Starting model training...\n");
+// The serial chain filters 8-bit frames in place, so run it on a copy
+static int serialFilterFrame(const void *src, void *dst, int width, int height, int dtype) {
+    if (dtype != PIXEL_U8) return 0;
+    memcpy(dst, src, (size_t)width * height);
+    applyFilterChain((unsigned char *)dst, width, height, serial_chain);
+    return 1;
+}
 
-    processDataset("C:/Users/V Abhiram/Desktop/IT301M/project/SARscope/train/_annotations.coco.json", 
-                   "C:/Users/V Abhiram/Desktop/IT301M/project/SARscope/train",
-                   "C:/Users/V Abhiram/Desktop/IT301M/project/SARscope/train/processed_images");
+static void serialRelease(void) {
+    serial_chain = NULL;
+}
 
-    printf("\nTraining complete.\n");
-    return 0;
-}
\ No newline at end of file
+const FilterBackend serial_backend = {
+    "serial",
+    "",
+    0,
+    serialAvailable,
+    serialSupports,
+    serialParseOption,
+    serialPrepare,
+    serialGrain,
+    serialRun,
+    serialFilterFrame,
+    serialRelease,
+};
@@ -1,3 +1,7 @@
+// CUDA backend: frames are packed into batches and spread over several CUDA
+// streams, so uploads, kernels and downloads of different batches overlap with
+// decoding and encoding on the host. Built into sar_filter with -DUSE_CUDA=1.
+
 #include <cuda_runtime.h>
 #include <device_launch_parameters.h>
 #include <stdio.h>
@@ -5,24 +9,20 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
-#include <sys/stat.h>
-#include <errno.h>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
 
-#include "cJSON.h"
+#include "backend.h"
+#include "image_io.h"
 
-#ifdef _WIN32
-#include <direct.h>
-#define mkdir(dir, mode) _mkdir(dir)
-#endif
-
-#define PROGRESS_BAR_WIDTH 50
 #define BLOCK_SIZE 16  // CUDA block size (16x16 threads)
+#define KERNEL_SIZE 5  // Size of the Gaussian and Wiener windows
+#define FILTER_RADIUS (KERNEL_SIZE / 2)
+#define TILE_DIM (BLOCK_SIZE + 2 * FILTER_RADIUS)  // Shared-memory tile including the halo
+#define NUM_STREAMS 3  // Images in flight: upload of N+1, kernels of N, download of N-1 overlap
+#define DEFAULT_BATCH_SIZE 8  // Images per launch (--batch); 1 = one pair of kernel launches per image
+
+// Fused batch kernel: the Gaussian needs a 2-pixel halo around the box filter's 2-pixel halo
+#define FUSED_IN_DIM (BLOCK_SIZE + 4 * FILTER_RADIUS)   // Input tile
+#define FUSED_MID_DIM (BLOCK_SIZE + 2 * FILTER_RADIUS)  // Gaussian tile
 
 // Error checking macro for CUDA calls
 #define CUDA_CHECK(call) \
@@ -35,119 +35,757 @@ do { \
     } \
 } while(0)
 
-// Function to print the progress bar
-void printProgressBar(int current, int total) {
-    float percentage = (float)current / total;
-    int completed = (int)(percentage * PROGRESS_BAR_WIDTH);
-    
-    printf("\r[");  
-    for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) {
-        if (i < completed) printf("=");
-        else printf(" ");
+// Normalized Gaussian kernel, computed on the host exactly like the CPU versions
+__constant__ double c_gaussianKernel[KERNEL_SIZE * KERNEL_SIZE];
+
+// Per pixel type: how a Gaussian result is stored and how the box mean is taken.
+// Integer types clamp and truncate like the CPU reference; float is not quantized.
+template <typename T> struct PixelTraits;
+
+template <> struct PixelTraits<unsigned char> {
+    typedef int Sum;
+    __device__ static unsigned char fromGaussian(double v) {
+        return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    __device__ static unsigned char mean(int sum) { return sum / (KERNEL_SIZE * KERNEL_SIZE); }
+};
+
+template <> struct PixelTraits<unsigned short> {
+    typedef int Sum;
+    __device__ static unsigned short fromGaussian(double v) {
+        return (unsigned short)(v < 0 ? 0 : (v > 65535 ? 65535 : v));
+    }
+    __device__ static unsigned short mean(int sum) { return sum / (KERNEL_SIZE * KERNEL_SIZE); }
+};
+
+template <> struct PixelTraits<float> {
+    typedef double Sum;
+    __device__ static float fromGaussian(double v) { return (float)v; }
+    __device__ static float mean(double sum) { return (float)(sum / (KERNEL_SIZE * KERNEL_SIZE)); }
+};
+
+// A stage's border (filter_chain.h), passed to the kernels by value
+typedef struct {
+    int mode;     // BorderMode
+    double fill;  // BORDER_CONSTANT sample, before clamping to the pixel type
+} KernelBorder;
+
+static KernelBorder stageBorder(const FilterStage *stage) {
+    KernelBorder border = { (int)stage->border, stage->fill };
+    return border;
+}
+
+// Sample (x, y) of input, which may lie outside the image, completed as border
+// says. A keep border clamps: those samples only feed border pixels, which are
+// copied through unfiltered anyway.
+template <typename T>
+__device__ T borderSample(const T *input, int width, int height, int x, int y, KernelBorder border) {
+    int gx = borderIndex(x, width, border.mode), gy = borderIndex(y, height, border.mode);
+    if (gx < 0 || gy < 0) return PixelTraits<T>::fromGaussian(border.fill);
+    return input[gy * width + gx];
+}
+
+// Load the block's pixels plus a FILTER_RADIUS halo into shared memory
+template <typename T>
+__device__ void loadTile(const T *input, T tile[TILE_DIM][TILE_DIM], int width, int height, KernelBorder border) {
+    int base_x = blockIdx.x * BLOCK_SIZE - FILTER_RADIUS;
+    int base_y = blockIdx.y * BLOCK_SIZE - FILTER_RADIUS;
+
+    for (int i = threadIdx.y * BLOCK_SIZE + threadIdx.x; i < TILE_DIM * TILE_DIM;
+         i += BLOCK_SIZE * BLOCK_SIZE) {
+        tile[i / TILE_DIM][i % TILE_DIM] =
+            borderSample(input, width, height, base_x + i % TILE_DIM, base_y + i / TILE_DIM, border);
     }
-    printf("] %d%%", (int)(percentage * 100));
-    fflush(stdout);
 }
 
-// Function to process the dataset and save the processed images in a different folder
-void processDataset(const char *json_path, const char *image_dir, const char *output_dir) {
-    clock_t start, end;
-    double cpu_time_used;
+// 1 if (x, y) is a pixel a window of the given radius does not fit around,
+// which a keep border leaves as it is
+__device__ static inline int isBorderPixel(int x, int y, int width, int height, int radius) {
+    return x < radius || y < radius || x >= width - radius || y >= height - radius;
+}
+
+// Gaussian filter kernel: one thread per output pixel, 16x16 tile with a 2-pixel halo
+template <typename T>
+__global__ void gaussianFilterKernel(const T *input, T *output, int width, int height, KernelBorder border) {
+    __shared__ T tile[TILE_DIM][TILE_DIM];
 
-    FILE *file = fopen(json_path, "r");
-    if (!file) {
-        printf("Could not open JSON file: %s\n", json_path);
+    loadTile(input, tile, width, height, border);
+    __syncthreads();
+
+    int x = blockIdx.x * BLOCK_SIZE + threadIdx.x;
+    int y = blockIdx.y * BLOCK_SIZE + threadIdx.y;
+    if (x >= width || y >= height) return;
+
+    // Copy border pixels (not processed by the filter)
+    if (border.mode == BORDER_KEEP && isBorderPixel(x, y, width, height, FILTER_RADIUS)) {
+        output[y * width + x] = input[y * width + x];
         return;
     }
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    char *json_data = (char *)malloc(length + 1);
-    fread(json_data, 1, length, file);
-    json_data[length] = '\0';
-    fclose(file);
+    // Same accumulation order as the CPU loop; the _rn intrinsics stop nvcc from
+    // contracting into FMAs so the result is bit-identical to applyGaussianFilter
+    double pixel_value = 0.0;
+    for (int k = 0; k < KERNEL_SIZE; k++) {
+        for (int l = 0; l < KERNEL_SIZE; l++) {
+            pixel_value = __dadd_rn(pixel_value,
+                                    __dmul_rn((double)tile[threadIdx.y + k][threadIdx.x + l],
+                                              c_gaussianKernel[k * KERNEL_SIZE + l]));
+        }
+    }
+    output[y * width + x] = PixelTraits<T>::fromGaussian(pixel_value);
+}
+
+// Wiener filter (approximation) kernel: 5x5 box mean over the same tile layout
+template <typename T>
+__global__ void wienerFilterKernel(const T *input, T *output, int width, int height, KernelBorder border) {
+    __shared__ T tile[TILE_DIM][TILE_DIM];
+
+    loadTile(input, tile, width, height, border);
+    __syncthreads();
+
+    int x = blockIdx.x * BLOCK_SIZE + threadIdx.x;
+    int y = blockIdx.y * BLOCK_SIZE + threadIdx.y;
+    if (x >= width || y >= height) return;
 
-    cJSON *root = cJSON_Parse(json_data);
-    if (!root) {
-        printf("Error parsing JSON\n");
-        free(json_data);
+    // Copy border pixels (not processed by the filter)
+    if (border.mode == BORDER_KEEP && isBorderPixel(x, y, width, height, FILTER_RADIUS)) {
+        output[y * width + x] = input[y * width + x];
         return;
     }
 
-    cJSON *images = cJSON_GetObjectItem(root, "images");
-    if (!cJSON_IsArray(images)) {
-        printf("Invalid JSON format\n");
-        cJSON_Delete(root);
-        free(json_data);
+    typename PixelTraits<T>::Sum sum = 0;
+    for (int k = 0; k < KERNEL_SIZE; k++) {
+        for (int l = 0; l < KERNEL_SIZE; l++) {
+            sum += tile[threadIdx.y + k][threadIdx.x + l];
+        }
+    }
+    output[y * width + x] = PixelTraits<T>::mean(sum);
+}
+
+// Load the block's pixels plus a halo of radius into tile, dim = BLOCK_SIZE + 2 * radius
+// on a side, for the stages whose window size is only known at run time
+__device__ static void loadStageTile(const unsigned char *input, unsigned char *tile, int dim, int radius,
+                                     int width, int height, KernelBorder border) {
+    int base_x = blockIdx.x * BLOCK_SIZE - radius;
+    int base_y = blockIdx.y * BLOCK_SIZE - radius;
+
+    for (int i = threadIdx.y * BLOCK_SIZE + threadIdx.x; i < dim * dim; i += BLOCK_SIZE * BLOCK_SIZE)
+        tile[i] = borderSample(input, width, height, base_x + i % dim, base_y + i / dim, border);
+}
+
+// Local-statistics kernel (adaptive Wiener with a given noise, Lee, enhanced Lee
+// and Frost) for 8-bit frames, over a dynamic shared tile of the stage's size.
+// The window sums are integers, so mean and variance are exactly those of
+// localStatistics in filter_apply.c; a keep border shrinks the window to the
+// image as there. The filtered value then goes through the same shared
+// functions (localStatisticsValue, frostWeights), but their sqrt and exp are
+// the device's, so a value that lands on a rounding edge can come out one gray
+// level away from the CPU.
+__global__ void localStatisticsKernel(const unsigned char *input, unsigned char *output, int width, int height,
+                                      FilterStage stage, KernelBorder border) {
+    extern __shared__ unsigned char stage_tile[];
+    int radius = stage.size / 2, dim = BLOCK_SIZE + 2 * radius;
+
+    loadStageTile(input, stage_tile, dim, radius, width, height, border);
+    __syncthreads();
+
+    int x = blockIdx.x * BLOCK_SIZE + threadIdx.x;
+    int y = blockIdx.y * BLOCK_SIZE + threadIdx.y;
+    if (x >= width || y >= height) return;
+
+    const unsigned char *window = stage_tile + threadIdx.y * dim + threadIdx.x;  // Window's top-left sample
+    int keep = border.mode == BORDER_KEEP;
+    int sum = 0, sum_sq = 0, n = 0;
+    for (int k = 0; k < stage.size; k++) {
+        for (int l = 0; l < stage.size; l++) {
+            int gx = x - radius + l, gy = y - radius + k;
+            if (keep && (gx < 0 || gy < 0 || gx >= width || gy >= height)) continue;
+            int sample = window[k * dim + l];
+            sum += sample;
+            sum_sq += sample * sample;
+            n++;
+        }
+    }
+    double mean = __ddiv_rn((double)sum, (double)n);
+    double variance = __dsub_rn(__ddiv_rn((double)sum_sq, (double)n), __dmul_rn(mean, mean));
+    if (variance < 0) variance = 0;
+
+    double value;
+    if (stage.kind == FILTER_FROST) {
+        double weights[2 * MAX_FILTER_SIZE];
+        frostWeights(frostCoefficient(&stage, mean, variance), radius, weights);
+
+        double weighted = 0.0, weight_sum = 0.0;
+        for (int k = 0; k < stage.size; k++) {
+            for (int l = 0; l < stage.size; l++) {
+                int gx = x - radius + l, gy = y - radius + k;
+                if (keep && (gx < 0 || gy < 0 || gx >= width || gy >= height)) continue;
+                double weight = weights[abs(k - radius) + abs(l - radius)];
+                weighted = __dadd_rn(weighted, __dmul_rn(weight, (double)window[k * dim + l]));
+                weight_sum = __dadd_rn(weight_sum, weight);
+            }
+        }
+        value = __ddiv_rn(weighted, weight_sum);
+    } else {
+        value = localStatisticsValue(&stage, stage.noise, input[y * width + x], mean, variance);
+    }
+    output[y * width + x] = PixelTraits<unsigned char>::fromGaussian(__dadd_rn(value, 0.5));
+}
+
+// Median kernel for 8-bit frames. The median is found bit by bit from the top:
+// it is the largest value v with at most n / 2 window samples below it, so
+// eight counting passes over the window replace the sort of applyMedianFilter
+// and give the same sample.
+__global__ void medianFilterKernel(const unsigned char *input, unsigned char *output, int width, int height,
+                                   int size, KernelBorder border) {
+    extern __shared__ unsigned char stage_tile[];
+    int radius = size / 2, dim = BLOCK_SIZE + 2 * radius;
+
+    loadStageTile(input, stage_tile, dim, radius, width, height, border);
+    __syncthreads();
+
+    int x = blockIdx.x * BLOCK_SIZE + threadIdx.x;
+    int y = blockIdx.y * BLOCK_SIZE + threadIdx.y;
+    if (x >= width || y >= height) return;
+
+    // Copy border pixels (not processed by the filter)
+    if (border.mode == BORDER_KEEP && isBorderPixel(x, y, width, height, radius)) {
+        output[y * width + x] = input[y * width + x];
         return;
     }
 
-    int total_images = cJSON_GetArraySize(images);
-    int processed_images = 0;
+    const unsigned char *window = stage_tile + threadIdx.y * dim + threadIdx.x;
+    int half = size * size / 2, median = 0;
+    for (int bit = 128; bit > 0; bit >>= 1) {
+        int candidate = median | bit, below = 0;
+        for (int k = 0; k < size; k++)
+            for (int l = 0; l < size; l++)
+                below += window[k * dim + l] < candidate;
+        if (below <= half) median = candidate;
+    }
+    output[y * width + x] = (unsigned char)median;
+}
+
+// Shared memory of the tile of a stage whose window size is only known at run time
+static size_t stageTileBytes(const FilterStage *stage) {
+    int dim = BLOCK_SIZE + 2 * (stage->size / 2);
+    return (size_t)dim * dim;
+}
+
+// One frame of a packed batch: where it starts in the batch buffer (bytes), its size,
+// and the range of 16x16 tiles (thread blocks) that cover it
+typedef struct {
+    size_t offset;
+    int width, height;
+    int first_tile;
+    int tiles_x;
+} BatchImage;
+
+// Gaussian followed by Wiener over a whole batch of frames in one launch.
+// Each block finds its frame in the batch table, stages the input tile with a
+// 4-pixel halo, computes the Gaussian for the tile plus a 2-pixel halo in shared
+// memory and takes the box mean from there. Same output as the two-kernel path:
+// halo pixels beyond the image edge are the Gaussian of the pixel the box
+// border maps them to, or the box fill. Only the halo pixels some output pixel
+// of the image reads are computed: those map into the tile, while a reflected
+// one further out (past the end of a partial last tile) may not.
+template <typename T>
+__global__ void fusedBatchFilterKernel(const unsigned char *input, unsigned char *output,
+                                       const BatchImage *images, int num_images,
+                                       KernelBorder gaussian_border, KernelBorder box_border) {
+    __shared__ T in_tile[FUSED_IN_DIM][FUSED_IN_DIM];
+    __shared__ T mid_tile[FUSED_MID_DIM][FUSED_MID_DIM];
+    __shared__ int image_index;
+
+    int tid = threadIdx.y * BLOCK_SIZE + threadIdx.x;
+
+    // Last image whose first tile is <= this block
+    if (tid == 0) {
+        int lo = 0, hi = num_images - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (images[mid].first_tile <= (int)blockIdx.x) lo = mid;
+            else hi = mid - 1;
+        }
+        image_index = lo;
+    }
+    __syncthreads();
+
+    BatchImage image = images[image_index];
+    const T *src = (const T *)(input + image.offset);
+    T *dst = (T *)(output + image.offset);
+    int width = image.width, height = image.height;
+    int tile = blockIdx.x - image.first_tile;
+    int base_x = (tile % image.tiles_x) * BLOCK_SIZE;
+    int base_y = (tile / image.tiles_x) * BLOCK_SIZE;
+
+    for (int i = tid; i < FUSED_IN_DIM * FUSED_IN_DIM; i += BLOCK_SIZE * BLOCK_SIZE) {
+        in_tile[i / FUSED_IN_DIM][i % FUSED_IN_DIM] =
+            borderSample(src, width, height, base_x - 2 * FILTER_RADIUS + i % FUSED_IN_DIM,
+                         base_y - 2 * FILTER_RADIUS + i / FUSED_IN_DIM, gaussian_border);
+    }
+    __syncthreads();
+
+    // Gaussian for the output tile plus its halo; border pixels of a keep border keep the input value
+    for (int i = tid; i < FUSED_MID_DIM * FUSED_MID_DIM; i += BLOCK_SIZE * BLOCK_SIZE) {
+        int mx = i % FUSED_MID_DIM, my = i / FUSED_MID_DIM;
+        int gx = base_x - FILTER_RADIUS + mx, gy = base_y - FILTER_RADIUS + my;
+        if (gx >= width + FILTER_RADIUS || gy >= height + FILTER_RADIUS) continue;
+
+        if (box_border.mode != BORDER_KEEP) {
+            int bx = borderIndex(gx, width, box_border.mode), by = borderIndex(gy, height, box_border.mode);
+            if (bx < 0 || by < 0) {
+                mid_tile[i / FUSED_MID_DIM][i % FUSED_MID_DIM] = PixelTraits<T>::fromGaussian(box_border.fill);
+                continue;
+            }
+            mx += bx - gx;
+            my += by - gy;
+            gx = bx;
+            gy = by;
+        }
+
+        if (gaussian_border.mode == BORDER_KEEP && isBorderPixel(gx, gy, width, height, FILTER_RADIUS)) {
+            mid_tile[i / FUSED_MID_DIM][i % FUSED_MID_DIM] = in_tile[my + FILTER_RADIUS][mx + FILTER_RADIUS];
+            continue;
+        }
+
+        double pixel_value = 0.0;
+        for (int k = 0; k < KERNEL_SIZE; k++) {
+            for (int l = 0; l < KERNEL_SIZE; l++) {
+                pixel_value = __dadd_rn(pixel_value,
+                                        __dmul_rn((double)in_tile[my + k][mx + l],
+                                                  c_gaussianKernel[k * KERNEL_SIZE + l]));
+            }
+        }
+        mid_tile[i / FUSED_MID_DIM][i % FUSED_MID_DIM] = PixelTraits<T>::fromGaussian(pixel_value);
+    }
+    __syncthreads();
+
+    int x = base_x + threadIdx.x;
+    int y = base_y + threadIdx.y;
+    if (x >= width || y >= height) return;
+
+    // Border pixels of a keep border keep the Gaussian value
+    if (box_border.mode == BORDER_KEEP && isBorderPixel(x, y, width, height, FILTER_RADIUS)) {
+        dst[y * width + x] = mid_tile[threadIdx.y + FILTER_RADIUS][threadIdx.x + FILTER_RADIUS];
+        return;
+    }
+
+    typename PixelTraits<T>::Sum sum = 0;
+    for (int k = 0; k < KERNEL_SIZE; k++) {
+        for (int l = 0; l < KERNEL_SIZE; l++) {
+            sum += mid_tile[threadIdx.y + k][threadIdx.x + l];
+        }
+    }
+    dst[y * width + x] = PixelTraits<T>::mean(sum);
+}
+
+// Compute the Gaussian kernel on the host and upload it to constant memory
+void initGaussianKernel(double sigma) {
+    double kernel[KERNEL_SIZE * KERNEL_SIZE];
+    double sum = 0.0;
+
+    for (int i = 0; i < KERNEL_SIZE; i++) {
+        for (int j = 0; j < KERNEL_SIZE; j++) {
+            double x = i - KERNEL_SIZE / 2;
+            double y = j - KERNEL_SIZE / 2;
+            kernel[i * KERNEL_SIZE + j] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+            sum += kernel[i * KERNEL_SIZE + j];
+        }
+    }
+
+    for (int i = 0; i < KERNEL_SIZE * KERNEL_SIZE; i++)
+        kernel[i] /= sum;
+
+    CUDA_CHECK(cudaMemcpyToSymbol(c_gaussianKernel, kernel, sizeof(kernel)));
+}
+
+// The Gaussian and box kernels are compiled for KERNEL_SIZE windows and a
+// single Gaussian in constant memory, so those stages must be of that size, all
+// Gaussians with the same sigma. The local-statistics and median kernels take
+// any size, but the adaptive Wiener filter only with a given noise: the
+// estimate is a mean over the whole image, which no tile sees. Returns 0 and
+// the sigma if the chain fits, otherwise -1, reporting the offending stage when
+// verbose is set.
+static int checkCudaChain(const FilterChain *chain, int verbose, double *sigma) {
+    *sigma = 1.5;
+    int have_sigma = 0;
+
+    for (int i = 0; i < chain->count; i++) {
+        const FilterStage *stage = &chain->stages[i];
+        if (stage->kind == FILTER_ADAPTIVE_WIENER && stage->noise < 0) {
+            if (verbose)
+                fprintf(stderr, "The CUDA backend does not estimate the noise: give stage %d (adaptive-wiener) "
+                        "a noise=V\n", i + 1);
+            return -1;
+        }
+        if (stage->kind != FILTER_GAUSSIAN && stage->kind != FILTER_BOX) continue;
+        if (stage->size != KERNEL_SIZE) {
+            if (verbose)
+                fprintf(stderr, "The CUDA backend only runs size=%d gaussian and wiener stages "
+                        "(stage %d is %s:size=%d)\n", KERNEL_SIZE, i + 1, filterKindName(stage->kind), stage->size);
+            return -1;
+        }
+        if (stage->kind == FILTER_GAUSSIAN) {
+            if (have_sigma && stage->sigma != *sigma) {
+                if (verbose) fprintf(stderr, "The CUDA backend needs the same sigma for every gaussian stage\n");
+                return -1;
+            }
+            *sigma = stage->sigma;
+            have_sigma = 1;
+        }
+    }
+    return 0;
+}
+
+// One in-flight batch: a CUDA stream with its own pinned staging buffer, device
+// buffers and batch table. Buffers are allocated once and only grow when a larger
+// batch arrives, so the batch loop does no per-image cudaMalloc/cudaHostAlloc.
+typedef struct {
+    cudaStream_t stream;
+    unsigned char *h_buffer;   // Pinned host staging buffer (upload source and download target)
+    unsigned char *d_input;
+    unsigned char *d_output;
+    size_t capacity;           // Bytes allocated in each of the three buffers
+    BatchImage *h_images;      // Batch table (pinned) and its device copy
+    BatchImage *d_images;
+    char (*output_paths)[512];
+    int *raw_inputs;           // Frame i was read from a raw file (selects the "auto" output format)
+    int *image_indices;        // Manifest index of frame i, for the run report
+    cudaEvent_t start_event;   // Bracket the batch's copies and kernels on the stream
+    cudaEvent_t stop_event;
+    int count;                 // Frames packed into the batch
+    int dtype;                 // PixelType shared by every frame of the batch
+    size_t used;               // Bytes of h_buffer holding packed frames
+    int total_tiles;
+    int busy;                  // The batch is queued on this stream and not yet saved
+} StreamSlot;
+
+void initStreamSlot(StreamSlot *slot, int batch_size) {
+    memset(slot, 0, sizeof(*slot));
+    CUDA_CHECK(cudaStreamCreateWithFlags(&slot->stream, cudaStreamNonBlocking));
+    CUDA_CHECK(cudaHostAlloc((void **)&slot->h_images, batch_size * sizeof(BatchImage), cudaHostAllocDefault));
+    CUDA_CHECK(cudaMalloc(&slot->d_images, batch_size * sizeof(BatchImage)));
+    CUDA_CHECK(cudaEventCreate(&slot->start_event));
+    CUDA_CHECK(cudaEventCreate(&slot->stop_event));
+    slot->output_paths = (char (*)[512])malloc(batch_size * sizeof(*slot->output_paths));
+    slot->raw_inputs = (int *)malloc(batch_size * sizeof(int));
+    slot->image_indices = (int *)malloc(batch_size * sizeof(int));
+    if (!slot->output_paths || !slot->raw_inputs || !slot->image_indices) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void destroyStreamSlot(StreamSlot *slot) {
+    CUDA_CHECK(cudaStreamDestroy(slot->stream));
+    if (slot->capacity) {
+        CUDA_CHECK(cudaFreeHost(slot->h_buffer));
+        CUDA_CHECK(cudaFree(slot->d_input));
+        CUDA_CHECK(cudaFree(slot->d_output));
+    }
+    CUDA_CHECK(cudaFreeHost(slot->h_images));
+    CUDA_CHECK(cudaFree(slot->d_images));
+    CUDA_CHECK(cudaEventDestroy(slot->start_event));
+    CUDA_CHECK(cudaEventDestroy(slot->stop_event));
+    free(slot->output_paths);
+    free(slot->raw_inputs);
+    free(slot->image_indices);
+}
+
+// Grow the slot's buffers to hold size bytes, keeping the frames already packed
+void reserveStreamSlot(StreamSlot *slot, size_t size) {
+    if (size <= slot->capacity) return;
+
+    size_t new_capacity = slot->capacity * 2 > size ? slot->capacity * 2 : size;
+    unsigned char *h_buffer;
+    CUDA_CHECK(cudaHostAlloc((void **)&h_buffer, new_capacity, cudaHostAllocDefault));
+
+    if (slot->capacity) {
+        memcpy(h_buffer, slot->h_buffer, slot->used);
+        CUDA_CHECK(cudaFreeHost(slot->h_buffer));
+        CUDA_CHECK(cudaFree(slot->d_input));
+        CUDA_CHECK(cudaFree(slot->d_output));
+    }
+    slot->h_buffer = h_buffer;
+    CUDA_CHECK(cudaMalloc(&slot->d_input, new_capacity));
+    CUDA_CHECK(cudaMalloc(&slot->d_output, new_capacity));
+    slot->capacity = new_capacity;
+}
+
+// Append a decoded frame to the slot's batch; all frames of a batch have the same dtype
+void addToBatch(StreamSlot *slot, const void *image_data, int width, int height, int dtype,
+                const char *output_path, int raw_input, int image_index) {
+    size_t image_size = (size_t)width * height * pixelSize(dtype);
+    BatchImage *image = &slot->h_images[slot->count];
+
+    reserveStreamSlot(slot, slot->used + image_size);
+    memcpy(slot->h_buffer + slot->used, image_data, image_size);
+
+    image->offset = slot->used;
+    image->width = width;
+    image->height = height;
+    image->first_tile = slot->total_tiles;
+    image->tiles_x = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    strcpy(slot->output_paths[slot->count], output_path);
+    slot->raw_inputs[slot->count] = raw_input;
+    slot->image_indices[slot->count] = image_index;
+    slot->dtype = dtype;
+
+    slot->used += image_size;
+    slot->total_tiles += image->tiles_x * ((height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    slot->count++;
+}
+
+// Launch the chain over the slot's batch for pixel type T. With several frames
+// in the batch a Gaussian followed by a box mean runs as one fused kernel over
+// every frame; any other pass launches one kernel per frame. The
+// local-statistics and median kernels are 8-bit only: wide frames only come
+// with chains of Gaussian and box stages (chainFiltersWide). Passes alternate
+// between d_input and d_output and the result is downloaded from the last one.
+template <typename T>
+void launchFilters(StreamSlot *slot, const FilterChain *chain) {
+    unsigned char *src = slot->d_input, *dst = slot->d_output;
+    int table_uploaded = 0;
+
+    for (int i = 0; i < chain->count; i++) {
+        if (slot->count > 1 && chainFusesAt(chain, i)) {
+            if (!table_uploaded) {
+                CUDA_CHECK(cudaMemcpyAsync(slot->d_images, slot->h_images, slot->count * sizeof(BatchImage),
+                                           cudaMemcpyHostToDevice, slot->stream));
+                table_uploaded = 1;
+            }
+            fusedBatchFilterKernel<T><<<slot->total_tiles, dim3(BLOCK_SIZE, BLOCK_SIZE), 0, slot->stream>>>(
+                src, dst, slot->d_images, slot->count, stageBorder(&chain->stages[i]),
+                stageBorder(&chain->stages[i + 1]));
+            i++;
+        } else {
+            for (int f = 0; f < slot->count; f++) {
+                const BatchImage *image = &slot->h_images[f];
+                const T *input = (const T *)(src + image->offset);
+                T *output = (T *)(dst + image->offset);
+                dim3 block(BLOCK_SIZE, BLOCK_SIZE);
+                dim3 grid(image->tiles_x, (image->height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+                const FilterStage *stage = &chain->stages[i];
+                KernelBorder border = stageBorder(stage);
+
+                if (stage->kind == FILTER_GAUSSIAN)
+                    gaussianFilterKernel<T><<<grid, block, 0, slot->stream>>>(input, output, image->width,
+                                                                              image->height, border);
+                else if (stage->kind == FILTER_BOX)
+                    wienerFilterKernel<T><<<grid, block, 0, slot->stream>>>(input, output, image->width,
+                                                                            image->height, border);
+                else if (usesLocalStatistics(stage->kind))
+                    localStatisticsKernel<<<grid, block, stageTileBytes(stage), slot->stream>>>(
+                        (const unsigned char *)input, (unsigned char *)output, image->width, image->height, *stage,
+                        border);
+                else
+                    medianFilterKernel<<<grid, block, stageTileBytes(stage), slot->stream>>>(
+                        (const unsigned char *)input, (unsigned char *)output, image->width, image->height,
+                        stage->size, border);
+            }
+        }
+        CUDA_CHECK(cudaGetLastError());
+
+        unsigned char *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    CUDA_CHECK(cudaMemcpyAsync(slot->h_buffer, src, slot->used, cudaMemcpyDeviceToHost, slot->stream));
+}
+
+// Queue upload, filters and download of the slot's batch. Returns immediately;
+// the filtered frames are back in h_buffer once the stream has been synchronized.
+void enqueueFiltersCuda(StreamSlot *slot, const FilterChain *chain) {
+    CUDA_CHECK(cudaEventRecord(slot->start_event, slot->stream));
+    CUDA_CHECK(cudaMemcpyAsync(slot->d_input, slot->h_buffer, slot->used, cudaMemcpyHostToDevice, slot->stream));
+
+    switch (slot->dtype) {
+        case PIXEL_U16: launchFilters<unsigned short>(slot, chain); break;
+        case PIXEL_F32: launchFilters<float>(slot, chain); break;
+        default: launchFilters<unsigned char>(slot, chain); break;
+    }
+    CUDA_CHECK(cudaEventRecord(slot->stop_event, slot->stream));
+    slot->busy = 1;
+}
+
+// Wait for the slot's batch, save its frames and empty it. The batch's GPU time
+// (copies and kernels) is shared out over its frames by size as their filter
+// stage; saving each frame is its encode stage. Returns the number of images written.
+int finishStreamSlot(StreamSlot *slot, DatasetJob *job, int thread) {
+    int written = 0;
+
+    if (slot->busy) {
+        CUDA_CHECK(cudaStreamSynchronize(slot->stream));
+        float gpu_ms = 0.0f;
+        CUDA_CHECK(cudaEventElapsedTime(&gpu_ms, slot->start_event, slot->stop_event));
+
+        for (int i = 0; i < slot->count; i++) {
+            BatchImage *image = &slot->h_images[i];
+            int index = slot->image_indices[i];
+            size_t image_size = (size_t)image->width * image->height * pixelSize(slot->dtype);
+            runReportStage(job->report, index, thread, STAGE_FILTER, gpu_ms * 1e-3 * image_size / slot->used);
+
+            int saved = saveOutputImage(slot->output_paths[i], slot->h_buffer + image->offset, image->width,
+                                        image->height, slot->dtype, job->output, slot->raw_inputs[i],
+                                        job->report, index, thread);
+            datasetImageDone(job, index, thread, saved);
+            written += saved;
+        }
+    }
+    slot->busy = 0;
+    slot->count = 0;
+    slot->used = 0;
+    slot->total_tiles = 0;
+    return written;
+}
+
+static int cuda_batch_size = DEFAULT_BATCH_SIZE;
+static const FilterChain *cuda_chain;
+static StreamSlot cuda_slots[NUM_STREAMS];  // Kept from prepare to release, so chunks reuse their buffers
+static StreamSlot frame_slot;               // filter_frame: benchmark frames and scene bands
+static int cuda_slots_ready = 0;
+
+static int cudaAvailable(void) {
+    int count = 0;
+    return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+static int cudaSupports(const FilterChain *chain, int verbose) {
+    double sigma;
+    return checkCudaChain(chain, verbose, &sigma) == 0;
+}
+
+// --batch N: number of frames filtered per kernel launch
+static int cudaParseOption(int argc, char **argv, int *i) {
+    if (strcmp(argv[*i], "--batch") != 0) return 0;
+    if (*i + 1 >= argc) return -1;
+
+    cuda_batch_size = atoi(argv[++*i]);
+    if (cuda_batch_size < 1) {
+        fprintf(stderr, "Batch size must be at least 1\n");
+        return -1;
+    }
+    return 1;
+}
+
+static int cudaPrepare(const FilterChain *chain) {
+    double sigma;
+    if (checkCudaChain(chain, 1, &sigma) != 0) return 0;
 
     // Initialize CUDA
     CUDA_CHECK(cudaSetDevice(0));
+    initGaussianKernel(sigma);
+    for (int s = 0; s < NUM_STREAMS; s++) initStreamSlot(&cuda_slots[s], cuda_batch_size);
+    initStreamSlot(&frame_slot, 1);
+    cuda_slots_ready = 1;
+    cuda_chain = chain;
+    printf("CUDA batch size: %d\n", cuda_batch_size);
+    return 1;
+}
+
+// A chunk of the shared queue should fill every stream with a full batch
+static int cudaGrain(void) {
+    return cuda_batch_size * NUM_STREAMS;
+}
 
-    start = clock(); // Start timing
+// Frames are packed into batches of cuda_batch_size, and batches are spread
+// round-robin over the streams. Before a slot is reused its previous batch is
+// waited for and saved, so while the host decodes the next frames the GPU is
+// still copying and filtering the previous batches. Everything runs on one host
+// thread. Returns the number of images written.
+static int cudaRun(DatasetJob *job, BackendShare *share) {
+    const FilterChain *chain = job->chain;
+    int thread = share->first_thread;
+    int written_images = 0;
+    share->mode = cuda_batch_size > 1 ? "batched" : "single";
 
-    cJSON *image_item;
-    cJSON_ArrayForEach(image_item, images) {
-        cJSON *file_name = cJSON_GetObjectItem(image_item, "file_name");
-        if (!cJSON_IsString(file_name)) continue;
+    StreamSlot *slots = cuda_slots;
+    int next_slot = 0;
 
+    for (int k = 0; k < share->count; k++) {
+        int n = share->images[k];
         char image_path[512];
         char output_path[512];
-        
-        // Original image path
-        sprintf(image_path, "%s/%s", image_dir, file_name->valuestring);
-        
-        // Output path for processed images
-        sprintf(output_path, "%s/%s", output_dir, file_name->valuestring);
-
-        int width, height, channels;
-        unsigned char *image_data = stbi_load(image_path, &width, &height, &channels, STBI_grey);
-        if (!image_data) {
-            printf("\nCould not read image: %s\n", image_path);
+        InputImage input;
+        StreamSlot *slot = &slots[next_slot];
+        datasetImagePaths(job, n, image_path, output_path);
+
+        // 16-bit PNGs keep their full precision when the run filters wide samples
+        if (!loadInputImage(image_path, job->wide_samples, &input, job->prefetch, job->report, n, thread)) {
+            datasetImageDone(job, n, thread, 0);
             continue;
         }
 
-        // Create the output directory if it doesn't exist
-        #ifndef _WIN32
-        mkdir(output_dir, 0777);
-        #else
-        mkdir(output_dir);
-        #endif
+        // A batch holds a single pixel type: launch the pending one when the type changes
+        if (slot->count > 0 && slot->dtype != input.dtype) {
+            enqueueFiltersCuda(slot, chain);
+            next_slot = (next_slot + 1) % NUM_STREAMS;
+            slot = &slots[next_slot];
+        }
 
-        // Save processed image to the new location
-        stbi_write_png(output_path, width, height, 1, image_data, width);
-        stbi_image_free(image_data);
+        // Free the slot: save the batch it was processing
+        if (slot->busy) written_images += finishStreamSlot(slot, job, thread);
 
-        // Update progress bar
-        processed_images++;
-        printProgressBar(processed_images, total_images);
-    }
+        // Stage the frame in pinned memory; launch once the batch is full
+        addToBatch(slot, input.pixels, input.width, input.height, input.dtype, output_path, input.is_raw, n);
+        freeInputImage(&input);
 
-    cJSON_Delete(root);
-    free(json_data);
+        if (slot->count == cuda_batch_size) {
+            enqueueFiltersCuda(slot, chain);
+            next_slot = (next_slot + 1) % NUM_STREAMS;
+        }
+    }
 
-    end = clock();
-    cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
-    
-    printf("\nProcessing time: %.3f seconds\n", cpu_time_used);
+    // Launch the last partial batch, then drain the batches in flight, oldest first
+    if (slots[next_slot].count > 0) {
+        enqueueFiltersCuda(&slots[next_slot], chain);
+        next_slot = (next_slot + 1) % NUM_STREAMS;
+    }
+    for (int s = 0; s < NUM_STREAMS; s++) {
+        StreamSlot *slot = &slots[(next_slot + s) % NUM_STREAMS];
+        if (slot->busy) written_images += finishStreamSlot(slot, job, thread);
+    }
+    return written_images;
 }
 
-int main() {
-    printf("Starting CUDA-accelerated model training...\n");
+// One frame through a stream slot of its own, including the host <-> device
+// copies, synchronously
+static int cudaFilterFrame(const void *src, void *dst, int width, int height, int dtype) {
+    StreamSlot *slot = &frame_slot;
+    if (dtype != PIXEL_U8 && !chainFiltersWide(cuda_chain)) return 0;
 
-    processDataset("/content/dataset/SARscope/test/_annotations.coco.json",
-    "/content/dataset/SARscope/test",
-    "/content/dataset/processed_images");
+    addToBatch(slot, src, width, height, dtype, "", 0, 0);
+    enqueueFiltersCuda(slot, cuda_chain);
+    CUDA_CHECK(cudaStreamSynchronize(slot->stream));
+    memcpy(dst, slot->h_buffer, (size_t)width * height * pixelSize(dtype));
 
-    printf("\nTraining complete.\n");
-    
-    // Cleanup CUDA resources
+    slot->busy = 0;
+    slot->count = 0;
+    slot->used = 0;
+    slot->total_tiles = 0;
+    return 1;
+}
+
+// Cleanup CUDA resources
+static void cudaRelease(void) {
+    for (int s = 0; cuda_slots_ready && s < NUM_STREAMS; s++) destroyStreamSlot(&cuda_slots[s]);
+    if (cuda_slots_ready) destroyStreamSlot(&frame_slot);
+    cuda_slots_ready = 0;
+    cuda_chain = NULL;
     cudaDeviceReset();
-    
-    return 0;
 }
+
+const FilterBackend cuda_backend = {
+    "cuda",
+    "[--batch N]",
+    1,
+    cudaAvailable,
+    cudaSupports,
+    cudaParseOption,
+    cudaPrepare,
+    cudaGrain,
+    cudaRun,
+    cudaFilterFrame,
+    cudaRelease,
+};
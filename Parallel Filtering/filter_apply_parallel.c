@@ -1,252 +1,2137 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+// OpenMP backend: whole images per thread, rows of one image across threads or
+// a decode -> filter -> encode pipeline, with SIMD stencil kernels picked for
+// the CPU at runtime. Handles 8-bit, 16-bit and float32 frames.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
-#include "cJSON.h"
+#include "backend.h"
+#include "buffer_pool.h"
+#include "image_io.h"
 #include <string.h>
 #include <math.h>
-#include <sys/stat.h> // For mkdir on Unix-like systems
-#include <errno.h>    // For errno and EEXIST on Unix-like systems
+#include <stdint.h>
 #include <omp.h>      // Include OpenMP header
+#include <pthread.h>  // Mutexes and condition variables for the pipeline queues
 
-#ifdef _WIN32
-#include <direct.h> // For mkdir on Windows
-#define mkdir(dir) _mkdir(dir) // Define mkdir for Windows
+// SIMD stencil kernels are compiled per ISA with target attributes and picked at runtime
+#ifndef USE_SIMD
+#define USE_SIMD 1
+#endif
+#if USE_SIMD && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#elif USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define SIMD_NEON 1
+#include <arm_neon.h>
 #endif
 
-#define PROGRESS_BAR_WIDTH 50  // Width of the progress bar
-
-// Function to print the progress bar
-void printProgressBar(int current, int total) {
-    float percentage = (float)current / total;
-    int completed = (int)(percentage * PROGRESS_BAR_WIDTH);
-    
-    printf("\r[");  
-    for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) {
-        if (i < completed) printf("=");
-        else printf(" ");
-    }
-    printf("] %d%%", (int)(percentage * 100));
-    fflush(stdout);
-}
-
-// Function to apply Gaussian filter with OpenMP parallelization
-void applyGaussianFilter(unsigned char *image_data, int width, int height) {
-    int kernel_size = 5;
-    double sigma = 1.5;
-    double kernel[5][5];
-    double sum = 0.0;
-
-    // Compute the Gaussian kernel (this is small and fast, so keep sequential)
-    for (int i = 0; i < kernel_size; i++) {
-        for (int j = 0; j < kernel_size; j++) {
-            double x = i - kernel_size / 2;
-            double y = j - kernel_size / 2;
-            kernel[i][j] = exp(-(x * x + y * y) / (2 * sigma * sigma));
-            sum += kernel[i][j];
-        }
-    }
-
-    // Normalize the kernel
-    for (int i = 0; i < kernel_size; i++)
-        for (int j = 0; j < kernel_size; j++)
-            kernel[i][j] /= sum;
-
-    unsigned char *temp = (unsigned char *)malloc(width * height);
-    if (!temp) return;
-
-    int offset = kernel_size / 2;
-    
-    // Parallelize the main filtering loop
-    #pragma omp parallel for schedule(dynamic)
-    for (int i = offset; i < height - offset; i++) {
-        for (int j = offset; j < width - offset; j++) {
-            double pixel_value = 0.0;
-            for (int k = -offset; k <= offset; k++) {
-                for (int l = -offset; l <= offset; l++) {
-                    pixel_value += image_data[(i + k) * width + (j + l)] * kernel[k + offset][l + offset];
-                }
+#ifndef _WIN32
+#include <unistd.h>   // For sysconf (cache size detection)
+#endif
+
+// Cache-blocked tiling of the fused filter; 0 = derive from the L2 cache size / thread count
+#define TILE_WIDTH 0
+#define TILE_HEIGHT 0
+#define TILE_MIN_HEIGHT 64               // Keeps the ring warm-up overhead per tile small
+#define DEFAULT_L2_CACHE_SIZE (256 * 1024)
+
+// Pipeline mode: bounded queue depth (images in flight per stage) and thread split
+#define PIPELINE_QUEUE_DEPTH 8
+#define PIPELINE_MIN_THREADS 3       // One reader, one filter worker and one writer
+
+#define MAX_KERNEL_SIZE MAX_FILTER_SIZE  // Largest supported Gaussian kernel
+
+// Cached Gaussian kernel for one (size, sigma) pair
+typedef struct GaussianKernel {
+    int size;
+    double sigma;
+    float weights[MAX_KERNEL_SIZE];                           // Normalized 1D weights (separable path)
+    int16_t weights_q15[MAX_KERNEL_SIZE];                     // 1D weights in Q15, summing to 1.0 (SIMD path)
+    struct GaussianKernel *next;
+} GaussianKernel;
+
+// How the backend spreads its share of the images over the OpenMP threads
+typedef enum {
+    PARALLEL_AUTO,    // Whole images per thread when there are enough images, rows otherwise
+    PARALLEL_ROWS,    // One image at a time, rows of each filter split across threads
+    PARALLEL_IMAGES,  // Whole images handed to worker threads, each filtering on its own
+    PARALLEL_PIPELINE // Reader, filter and writer threads connected by bounded queues
+} ParallelMode;
+
+// Per-thread scratch buffers, grown on demand and reused across images
+typedef struct {
+    unsigned char *ring;          // window_size Gaussian rows (fused filter)
+    const unsigned char **rows;   // Row pointers into the ring
+    float *vertical;              // Vertical pass of the separable Gaussian
+    uint16_t *fixed_row;          // Fixed-point vertical pass / column sums (SIMD kernels)
+    unsigned char *tile_row;      // One output row of a tile, before it is copied out
+    int *column_sums;             // Box filter column sums
+    uint32_t *column_sum;         // Local-statistics running sums of x
+    uint32_t *column_sum_sq;      // Local-statistics running sums of x^2
+    unsigned char *fill_rows[2];  // Rows of a constant border's fill, for the Gaussian and the box of a pass
+    int row_width, row_window;    // Size the row buffers were allocated for
+    uint8_t *histograms;          // Median column histograms, MEDIAN_COLUMN_BINS per column
+    int histogram_columns;        // Columns the histograms were allocated for
+
+    unsigned char *plane;         // Intermediate frame between passes of the filter chain
+    size_t plane_size;
+    unsigned char *output;        // Filtered frame handed to the encoder
+    size_t output_size;
+} FilterScratch;
+
+// A stage's border as the 8-bit kernels see it (filter_chain.h). Window rows
+// beyond the top and bottom edge are looked up with borderRow, so the kernels
+// only handle the columns beyond the left and right edge themselves.
+typedef struct {
+    BorderMode mode;
+    int fill;                       // BORDER_CONSTANT sample
+    const unsigned char *fill_row;  // A row of fill samples as wide as the scratch rows
+} RowBorder;
+
+static const RowBorder keep_border = { BORDER_KEEP, 0, NULL };
+
+static inline int fillU8(double fill) {
+    return (int)(fill < 0 ? 0 : (fill > 255 ? 255 : fill));
+}
+
+// Row r of image (rows stride pixels apart), which may lie beyond the top or bottom edge
+static inline const unsigned char *borderRow(const unsigned char *image_data, int stride, int height, int r,
+                                             const RowBorder *border) {
+    int y = borderIndex(r, height, border->mode);
+    return y < 0 ? border->fill_row : image_data + (size_t)y * stride;
+}
+
+// Make sure the row buffers of scratch fit rows of the given width and window size
+static int reserveRowScratch(FilterScratch *scratch, int width, int window_size) {
+    if (width <= scratch->row_width && window_size <= scratch->row_window) return 1;
+
+    int new_width = width > scratch->row_width ? width : scratch->row_width;
+    int new_window = window_size > scratch->row_window ? window_size : scratch->row_window;
+
+    free(scratch->ring);
+    free(scratch->rows);
+    free(scratch->vertical);
+    free(scratch->fixed_row);
+    free(scratch->tile_row);
+    free(scratch->column_sums);
+    free(scratch->column_sum);
+    free(scratch->column_sum_sq);
+    free(scratch->fill_rows[0]);
+    free(scratch->fill_rows[1]);
+
+    scratch->ring = (unsigned char *)malloc((size_t)new_window * new_width);
+    scratch->rows = (const unsigned char **)malloc(new_window * sizeof(unsigned char *));
+    scratch->vertical = (float *)malloc(new_width * sizeof(float));
+    scratch->fixed_row = (uint16_t *)malloc(new_width * sizeof(uint16_t));
+    scratch->tile_row = (unsigned char *)malloc(new_width);
+    scratch->column_sums = (int *)malloc(new_width * sizeof(int));
+    scratch->column_sum = (uint32_t *)malloc(new_width * sizeof(uint32_t));
+    scratch->column_sum_sq = (uint32_t *)malloc(new_width * sizeof(uint32_t));
+    scratch->fill_rows[0] = (unsigned char *)malloc(new_width);
+    scratch->fill_rows[1] = (unsigned char *)malloc(new_width);
+
+    if (!scratch->ring || !scratch->rows || !scratch->vertical || !scratch->fixed_row || !scratch->tile_row ||
+        !scratch->column_sums ||
+        !scratch->column_sum || !scratch->column_sum_sq || !scratch->fill_rows[0] || !scratch->fill_rows[1]) {
+        scratch->row_width = scratch->row_window = 0;
+        return 0;
+    }
+    scratch->row_width = new_width;
+    scratch->row_window = new_window;
+    return 1;
+}
+
+// The border of stage for rows of up to width pixels, its fill row in fill_rows[slot]
+// (scratch must hold rows that wide)
+static RowBorder stageBorder(const FilterStage *stage, FilterScratch *scratch, int slot, int width) {
+    RowBorder border = { stage->border, fillU8(stage->fill), scratch->fill_rows[slot] };
+    if (border.mode == BORDER_CONSTANT) memset(scratch->fill_rows[slot], border.fill, width);
+    return border;
+}
+
+// Make sure a scratch frame buffer can hold size pixels (contents are not kept)
+static int reserveFrameBuffer(unsigned char **buffer, size_t *capacity, size_t size) {
+    if (size <= *capacity) return 1;
+
+    poolFree(*buffer);
+    *buffer = (unsigned char *)poolMalloc(size);
+    *capacity = *buffer ? size : 0;
+    return *buffer != NULL;
+}
+
+static void freeScratch(FilterScratch *scratch) {
+    free(scratch->ring);
+    free(scratch->rows);
+    free(scratch->vertical);
+    free(scratch->fixed_row);
+    free(scratch->tile_row);
+    free(scratch->column_sums);
+    free(scratch->column_sum);
+    free(scratch->column_sum_sq);
+    free(scratch->fill_rows[0]);
+    free(scratch->fill_rows[1]);
+    free(scratch->histograms);
+    poolFree(scratch->plane);
+    poolFree(scratch->output);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Look up (or compute and cache) the Gaussian kernel for a given size and sigma.
+// Kernels are built once per (size, sigma) and never freed, so the returned
+// pointer stays valid for the lifetime of the program.
+// Returns NULL if kernel_size is not an odd number in [1, MAX_KERNEL_SIZE].
+const GaussianKernel *getGaussianKernel(int kernel_size, double sigma) {
+    static GaussianKernel *cache = NULL;
+    GaussianKernel *entry;
+
+    if (kernel_size < 1 || kernel_size > MAX_KERNEL_SIZE || kernel_size % 2 == 0 || sigma <= 0)
+        return NULL;
+
+    #pragma omp critical(gaussian_kernel_cache)
+    {
+        for (entry = cache; entry; entry = entry->next)
+            if (entry->size == kernel_size && entry->sigma == sigma) break;
+
+        if (!entry && (entry = (GaussianKernel *)malloc(sizeof(GaussianKernel)))) {
+            int offset = kernel_size / 2;
+            double sum_1d = 0.0;
+
+            entry->size = kernel_size;
+            entry->sigma = sigma;
+
+            // 1D kernel for the separable path: the 2D Gaussian is its outer product
+            double weights_1d[MAX_KERNEL_SIZE];
+            for (int i = 0; i < kernel_size; i++) {
+                double x = i - offset;
+                weights_1d[i] = exp(-(x * x) / (2 * sigma * sigma));
+                sum_1d += weights_1d[i];
             }
-            temp[i * width + j] = (unsigned char)(pixel_value < 0 ? 0 : (pixel_value > 255 ? 255 : pixel_value));
+            for (int i = 0; i < kernel_size; i++)
+                entry->weights[i] = (float)(weights_1d[i] / sum_1d);
+
+            // Q15 weights for the fixed-point kernels; the rounding error goes to the centre tap
+            int q15_sum = 0;
+            for (int i = 0; i < kernel_size; i++) {
+                int weight = (int)floor(weights_1d[i] / sum_1d * 32768.0 + 0.5);
+                entry->weights_q15[i] = (int16_t)(weight < 32767 ? weight : 32767);
+                q15_sum += weight;
+            }
+            int centre = entry->weights_q15[offset] + 32768 - q15_sum;
+            entry->weights_q15[offset] = (int16_t)(centre < 32767 ? centre : 32767);
+
+            entry->next = cache;
+            cache = entry;
         }
     }
 
-    // Copy border pixels (not processed by the filter)
-    for (int i = 0; i < offset; i++) {
-        for (int j = 0; j < width; j++) {
-            temp[i * width + j] = image_data[i * width + j];
-            temp[(height - i - 1) * width + j] = image_data[(height - i - 1) * width + j];
+    return entry;
+}
+
+// ---------------------------------------------------------------------------
+// SIMD 5x5 stencil kernels
+//
+// Each kernel computes the interior columns [2, width - 2) of one output row from
+// five input rows; the caller handles border rows and columns. Arithmetic is
+// 16-bit fixed point so one vector holds 8 (SSE4.1), 16 (AVX2/NEON) or 32
+// (AVX-512) pixels:
+//  - Gaussian: pixels are scaled to Q7 (p << 7) and multiplied by Q15 weights
+//    with a rounding high multiply ((a * b + 2^14) >> 15) in both separable
+//    passes, then truncated back to 8 bits. This stays within one gray level of
+//    the float/double scalar Gaussian.
+//  - Box mean: exact 16-bit sums, divided by 25 as (sum * 5243) >> 17, which is
+//    exact for every possible 5x5 sum of 8-bit pixels.
+// The scalar helpers below implement the same fixed-point math and handle the
+// row tails, so every ISA gives bit-identical results.
+// ---------------------------------------------------------------------------
+
+#define BOX25_MULTIPLIER 5243  // floor(sum / 25) == (sum * 5243) >> 17 for sum <= 25 * 255
+
+static inline int mulhrsQ15(int a, int b) {
+    return (a * b + 0x4000) >> 15;
+}
+
+static void gaussianVertical5Fixed(const unsigned char *const rows[5], const int16_t weights[5],
+                                   uint16_t *vertical, int from, int width) {
+    for (int j = from; j < width; j++) {
+        int acc = 0;
+        for (int k = 0; k < 5; k++)
+            acc += mulhrsQ15(rows[k][j] << 7, weights[k]);
+        vertical[j] = (uint16_t)acc;
+    }
+}
+
+static void gaussianHorizontal5Fixed(const uint16_t *vertical, const int16_t weights[5],
+                                     unsigned char *out_row, int from, int width) {
+    for (int j = from; j < width - 2; j++) {
+        int acc = 0;
+        for (int l = 0; l < 5; l++)
+            acc += mulhrsQ15(vertical[j - 2 + l], weights[l]);
+        out_row[j] = (unsigned char)(acc >> 7);
+    }
+}
+
+static void boxVertical5(const unsigned char *const rows[5], uint16_t *column_sums, int from, int width) {
+    for (int j = from; j < width; j++)
+        column_sums[j] = rows[0][j] + rows[1][j] + rows[2][j] + rows[3][j] + rows[4][j];
+}
+
+static void boxHorizontal5(const uint16_t *column_sums, unsigned char *out_row, int from, int width) {
+    for (int j = from; j < width - 2; j++) {
+        int sum = column_sums[j - 2] + column_sums[j - 1] + column_sums[j] + column_sums[j + 1] + column_sums[j + 2];
+        out_row[j] = (unsigned char)((sum * BOX25_MULTIPLIER) >> 17);
+    }
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse4.1")))
+static void gaussianRow5_sse41(const unsigned char *const rows[5], const int16_t weights[5],
+                               uint16_t *vertical, unsigned char *out_row, int width) {
+    __m128i w[5];
+    int j;
+
+    for (int k = 0; k < 5; k++) w[k] = _mm_set1_epi16(weights[k]);
+
+    for (j = 0; j + 8 <= width; j += 8) {
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < 5; k++) {
+            __m128i p = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(rows[k] + j)));
+            acc = _mm_add_epi16(acc, _mm_mulhrs_epi16(_mm_slli_epi16(p, 7), w[k]));
+        }
+        _mm_storeu_si128((__m128i *)(vertical + j), acc);
+    }
+    gaussianVertical5Fixed(rows, weights, vertical, j, width);
+
+    for (j = 2; j + 8 + 2 <= width; j += 8) {
+        __m128i acc = _mm_setzero_si128();
+        for (int l = 0; l < 5; l++)
+            acc = _mm_add_epi16(acc, _mm_mulhrs_epi16(_mm_loadu_si128((const __m128i *)(vertical + j - 2 + l)), w[l]));
+        acc = _mm_srli_epi16(acc, 7);
+        _mm_storel_epi64((__m128i *)(out_row + j), _mm_packus_epi16(acc, acc));
+    }
+    gaussianHorizontal5Fixed(vertical, weights, out_row, j, width);
+}
+
+__attribute__((target("sse4.1")))
+static void boxRow5_sse41(const unsigned char *const rows[5], uint16_t *column_sums,
+                          unsigned char *out_row, int width) {
+    const __m128i multiplier = _mm_set1_epi16(BOX25_MULTIPLIER);
+    int j;
+
+    for (j = 0; j + 8 <= width; j += 8) {
+        __m128i sum = _mm_setzero_si128();
+        for (int k = 0; k < 5; k++)
+            sum = _mm_add_epi16(sum, _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(rows[k] + j))));
+        _mm_storeu_si128((__m128i *)(column_sums + j), sum);
+    }
+    boxVertical5(rows, column_sums, j, width);
+
+    for (j = 2; j + 8 + 2 <= width; j += 8) {
+        __m128i sum = _mm_setzero_si128();
+        for (int l = 0; l < 5; l++)
+            sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i *)(column_sums + j - 2 + l)));
+        sum = _mm_srli_epi16(_mm_mulhi_epu16(sum, multiplier), 1);
+        _mm_storel_epi64((__m128i *)(out_row + j), _mm_packus_epi16(sum, sum));
+    }
+    boxHorizontal5(column_sums, out_row, j, width);
+}
+
+__attribute__((target("avx2")))
+static void gaussianRow5_avx2(const unsigned char *const rows[5], const int16_t weights[5],
+                              uint16_t *vertical, unsigned char *out_row, int width) {
+    __m256i w[5];
+    int j;
+
+    for (int k = 0; k < 5; k++) w[k] = _mm256_set1_epi16(weights[k]);
+
+    for (j = 0; j + 16 <= width; j += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < 5; k++) {
+            __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k] + j)));
+            acc = _mm256_add_epi16(acc, _mm256_mulhrs_epi16(_mm256_slli_epi16(p, 7), w[k]));
         }
+        _mm256_storeu_si256((__m256i *)(vertical + j), acc);
+    }
+    gaussianVertical5Fixed(rows, weights, vertical, j, width);
+
+    for (j = 2; j + 16 + 2 <= width; j += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int l = 0; l < 5; l++)
+            acc = _mm256_add_epi16(acc, _mm256_mulhrs_epi16(_mm256_loadu_si256((const __m256i *)(vertical + j - 2 + l)), w[l]));
+        acc = _mm256_srli_epi16(acc, 7);
+        _mm_storeu_si128((__m128i *)(out_row + j),
+                         _mm_packus_epi16(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+    }
+    gaussianHorizontal5Fixed(vertical, weights, out_row, j, width);
+}
+
+__attribute__((target("avx2")))
+static void boxRow5_avx2(const unsigned char *const rows[5], uint16_t *column_sums,
+                         unsigned char *out_row, int width) {
+    const __m256i multiplier = _mm256_set1_epi16(BOX25_MULTIPLIER);
+    int j;
+
+    for (j = 0; j + 16 <= width; j += 16) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int k = 0; k < 5; k++)
+            sum = _mm256_add_epi16(sum, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k] + j))));
+        _mm256_storeu_si256((__m256i *)(column_sums + j), sum);
+    }
+    boxVertical5(rows, column_sums, j, width);
+
+    for (j = 2; j + 16 + 2 <= width; j += 16) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int l = 0; l < 5; l++)
+            sum = _mm256_add_epi16(sum, _mm256_loadu_si256((const __m256i *)(column_sums + j - 2 + l)));
+        sum = _mm256_srli_epi16(_mm256_mulhi_epu16(sum, multiplier), 1);
+        _mm_storeu_si128((__m128i *)(out_row + j),
+                         _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
     }
-    
-    for (int i = offset; i < height - offset; i++) {
-        for (int j = 0; j < offset; j++) {
-            temp[i * width + j] = image_data[i * width + j];
-            temp[i * width + (width - j - 1)] = image_data[i * width + (width - j - 1)];
+    boxHorizontal5(column_sums, out_row, j, width);
+}
+
+__attribute__((target("avx512bw")))
+static void gaussianRow5_avx512(const unsigned char *const rows[5], const int16_t weights[5],
+                                uint16_t *vertical, unsigned char *out_row, int width) {
+    __m512i w[5];
+    int j;
+
+    for (int k = 0; k < 5; k++) w[k] = _mm512_set1_epi16(weights[k]);
+
+    for (j = 0; j + 32 <= width; j += 32) {
+        __m512i acc = _mm512_setzero_si512();
+        for (int k = 0; k < 5; k++) {
+            __m512i p = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(rows[k] + j)));
+            acc = _mm512_add_epi16(acc, _mm512_mulhrs_epi16(_mm512_slli_epi16(p, 7), w[k]));
         }
+        _mm512_storeu_si512((void *)(vertical + j), acc);
     }
+    gaussianVertical5Fixed(rows, weights, vertical, j, width);
 
-    memcpy(image_data, temp, width * height);
-    free(temp);
+    for (j = 2; j + 32 + 2 <= width; j += 32) {
+        __m512i acc = _mm512_setzero_si512();
+        for (int l = 0; l < 5; l++)
+            acc = _mm512_add_epi16(acc, _mm512_mulhrs_epi16(_mm512_loadu_si512((const void *)(vertical + j - 2 + l)), w[l]));
+        _mm256_storeu_si256((__m256i *)(out_row + j), _mm512_cvtepi16_epi8(_mm512_srli_epi16(acc, 7)));
+    }
+    gaussianHorizontal5Fixed(vertical, weights, out_row, j, width);
 }
 
-// Function to apply Wiener filter (approximation) with OpenMP parallelization
-void applyWienerFilter(unsigned char *image_data, int width, int height) {
-    int kernel_size = 5;
-    int kernel_area = kernel_size * kernel_size;
+__attribute__((target("avx512bw")))
+static void boxRow5_avx512(const unsigned char *const rows[5], uint16_t *column_sums,
+                           unsigned char *out_row, int width) {
+    const __m512i multiplier = _mm512_set1_epi16(BOX25_MULTIPLIER);
+    int j;
 
-    unsigned char *temp = (unsigned char *)malloc(width * height);
-    if (!temp) return;
+    for (j = 0; j + 32 <= width; j += 32) {
+        __m512i sum = _mm512_setzero_si512();
+        for (int k = 0; k < 5; k++)
+            sum = _mm512_add_epi16(sum, _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(rows[k] + j))));
+        _mm512_storeu_si512((void *)(column_sums + j), sum);
+    }
+    boxVertical5(rows, column_sums, j, width);
 
-    int offset = kernel_size / 2;
-    
-    // Parallelize the main filtering loop
-    #pragma omp parallel for schedule(dynamic)
-    for (int i = offset; i < height - offset; i++) {
-        for (int j = offset; j < width - offset; j++) {
-            int sum = 0;
-            for (int k = -offset; k <= offset; k++) {
-                for (int l = -offset; l <= offset; l++) {
-                    sum += image_data[(i + k) * width + (j + l)];
-                }
+    for (j = 2; j + 32 + 2 <= width; j += 32) {
+        __m512i sum = _mm512_setzero_si512();
+        for (int l = 0; l < 5; l++)
+            sum = _mm512_add_epi16(sum, _mm512_loadu_si512((const void *)(column_sums + j - 2 + l)));
+        sum = _mm512_srli_epi16(_mm512_mulhi_epu16(sum, multiplier), 1);
+        _mm256_storeu_si256((__m256i *)(out_row + j), _mm512_cvtepi16_epi8(sum));
+    }
+    boxHorizontal5(column_sums, out_row, j, width);
+}
+#endif // SIMD_X86
+
+#ifdef SIMD_NEON
+static void gaussianRow5_neon(const unsigned char *const rows[5], const int16_t weights[5],
+                              uint16_t *vertical, unsigned char *out_row, int width) {
+    int16_t *vertical_s16 = (int16_t *)vertical;
+    int j;
+
+    // vqrdmulh computes (2 * a * b + 2^15) >> 16, the same rounding as mulhrsQ15
+    for (j = 0; j + 16 <= width; j += 16) {
+        int16x8_t acc_lo = vdupq_n_s16(0), acc_hi = vdupq_n_s16(0);
+        for (int k = 0; k < 5; k++) {
+            uint8x16_t p = vld1q_u8(rows[k] + j);
+            int16x8_t lo = vreinterpretq_s16_u16(vshll_n_u8(vget_low_u8(p), 7));
+            int16x8_t hi = vreinterpretq_s16_u16(vshll_n_u8(vget_high_u8(p), 7));
+            acc_lo = vaddq_s16(acc_lo, vqrdmulhq_n_s16(lo, weights[k]));
+            acc_hi = vaddq_s16(acc_hi, vqrdmulhq_n_s16(hi, weights[k]));
+        }
+        vst1q_s16(vertical_s16 + j, acc_lo);
+        vst1q_s16(vertical_s16 + j + 8, acc_hi);
+    }
+    gaussianVertical5Fixed(rows, weights, vertical, j, width);
+
+    for (j = 2; j + 16 + 2 <= width; j += 16) {
+        int16x8_t acc_lo = vdupq_n_s16(0), acc_hi = vdupq_n_s16(0);
+        for (int l = 0; l < 5; l++) {
+            acc_lo = vaddq_s16(acc_lo, vqrdmulhq_n_s16(vld1q_s16(vertical_s16 + j - 2 + l), weights[l]));
+            acc_hi = vaddq_s16(acc_hi, vqrdmulhq_n_s16(vld1q_s16(vertical_s16 + j + 6 + l), weights[l]));
+        }
+        vst1q_u8(out_row + j, vcombine_u8(vqshrun_n_s16(acc_lo, 7), vqshrun_n_s16(acc_hi, 7)));
+    }
+    gaussianHorizontal5Fixed(vertical, weights, out_row, j, width);
+}
+
+static void boxRow5_neon(const unsigned char *const rows[5], uint16_t *column_sums,
+                         unsigned char *out_row, int width) {
+    int j;
+
+    for (j = 0; j + 16 <= width; j += 16) {
+        uint16x8_t sum_lo = vdupq_n_u16(0), sum_hi = vdupq_n_u16(0);
+        for (int k = 0; k < 5; k++) {
+            uint8x16_t p = vld1q_u8(rows[k] + j);
+            sum_lo = vaddw_u8(sum_lo, vget_low_u8(p));
+            sum_hi = vaddw_u8(sum_hi, vget_high_u8(p));
+        }
+        vst1q_u16(column_sums + j, sum_lo);
+        vst1q_u16(column_sums + j + 8, sum_hi);
+    }
+    boxVertical5(rows, column_sums, j, width);
+
+    for (j = 2; j + 8 + 2 <= width; j += 8) {
+        uint16x8_t sum = vdupq_n_u16(0);
+        for (int l = 0; l < 5; l++)
+            sum = vaddq_u16(sum, vld1q_u16(column_sums + j - 2 + l));
+        uint32x4_t lo = vshrq_n_u32(vmull_n_u16(vget_low_u16(sum), BOX25_MULTIPLIER), 17);
+        uint32x4_t hi = vshrq_n_u32(vmull_n_u16(vget_high_u16(sum), BOX25_MULTIPLIER), 17);
+        vst1_u8(out_row + j, vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));
+    }
+    boxHorizontal5(column_sums, out_row, j, width);
+}
+#endif // SIMD_NEON
+
+// Runtime-selected 5x5 row kernels; NULL entries fall back to the scalar float path
+typedef struct {
+    const char *name;
+    void (*gaussianRow5)(const unsigned char *const rows[5], const int16_t weights[5],
+                         uint16_t *vertical, unsigned char *out_row, int width);
+    void (*boxRow5)(const unsigned char *const rows[5], uint16_t *column_sums,
+                    unsigned char *out_row, int width);
+} StencilKernels;
+
+static StencilKernels stencil_kernels = { "scalar", NULL, NULL };
+
+// Pick the widest SIMD kernels the CPU supports. Call once before filtering;
+// until then (or without SIMD support) the scalar kernels are used.
+void initStencilKernels(void) {
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        stencil_kernels = (StencilKernels){ "avx512bw", gaussianRow5_avx512, boxRow5_avx512 };
+    } else if (__builtin_cpu_supports("avx2")) {
+        stencil_kernels = (StencilKernels){ "avx2", gaussianRow5_avx2, boxRow5_avx2 };
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        stencil_kernels = (StencilKernels){ "sse4.1", gaussianRow5_sse41, boxRow5_sse41 };
+    }
+#elif defined(SIMD_NEON)
+    stencil_kernels = (StencilKernels){ "neon", gaussianRow5_neon, boxRow5_neon };
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Stencils specialized on the kernel radius
+//
+// The float passes of the separable Gaussian and the box-mean sums, generated
+// by DEFINE_*_STENCIL once per radius up to STENCIL_MAX_RADIUS with the tap
+// count a compile-time constant, plus once ("any") with the taps passed in,
+// for larger kernels. With a constant tap count the taps are unrolled (GCC
+// unroll asks for it at -O2 too) and the columns vectorized. Every instance
+// runs the same expression in the same order, so the specializations give the
+// generic loop's results bit for bit. The border mode needs no specialization:
+// edge columns are computed apart from these interior loops. stencilsU8() and
+// the wide filters pick the instance for a kernel at runtime.
+// ---------------------------------------------------------------------------
+
+#define STENCIL_MAX_RADIUS 7  // Largest radius (15x15 window) with specialized stencils
+
+// M(NAME, RADIUS, ...) for the generic stencil and every specialized radius. In
+// the generic one RADIUS reads the stencil's taps argument.
+#define FOR_EACH_STENCIL_RADIUS(M, ...) \
+    M(any, (taps / 2), __VA_ARGS__) M(1, 1, __VA_ARGS__) M(2, 2, __VA_ARGS__) M(3, 3, __VA_ARGS__) \
+    M(4, 4, __VA_ARGS__) M(5, 5, __VA_ARGS__) M(6, 6, __VA_ARGS__) M(7, 7, __VA_ARGS__)
+
+#define STENCIL_ENTRY(NAME, RADIUS, PREFIX) PREFIX##_##NAME,
+
+static inline unsigned char gaussianToU8(float value) {
+    return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline uint16_t gaussianToU16(float value) {
+    return (uint16_t)(value < 0.0f ? 0.0f : (value > 65535.0f ? 65535.0f : value));
+}
+
+static inline float gaussianToF32(float value) {
+    return value;
+}
+
+// Vertical Gaussian pass over the 2 * RADIUS + 1 8-bit rows into vertical
+#define DEFINE_GAUSSIAN_VERTICAL_STENCIL(NAME, RADIUS, UNUSED)                                          \
+static void gaussianVertical_##NAME(const unsigned char *const *rows, const float *weights, int taps,  \
+                                    float *vertical, int width) {                                       \
+    (void)taps;                                                                                         \
+    _Pragma("omp simd")                                                                                 \
+    for (int j = 0; j < width; j++) {                                                                   \
+        float value = 0.0f;                                                                             \
+        _Pragma("GCC unroll 16")                                                                        \
+        for (int k = 0; k < 2 * RADIUS + 1; k++)                                                        \
+            value += rows[k][j] * weights[k];                                                           \
+        vertical[j] = value;                                                                            \
+    }                                                                                                   \
+}
+
+// Horizontal Gaussian pass from vertical into columns [from, to) of out_row
+#define DEFINE_GAUSSIAN_HORIZONTAL_STENCIL(NAME, RADIUS, SUFFIX, TYPE, FROM_FLOAT)                      \
+static void gaussianHorizontal_##SUFFIX##_##NAME(const float *vertical, const float *weights, int taps, \
+                                                 TYPE *out_row, int from, int to) {                     \
+    (void)taps;                                                                                         \
+    _Pragma("omp simd")                                                                                 \
+    for (int j = from; j < to; j++) {                                                                   \
+        float value = 0.0f;                                                                             \
+        _Pragma("GCC unroll 16")                                                                        \
+        for (int l = 0; l < 2 * RADIUS + 1; l++)                                                        \
+            value += weights[l] * vertical[j - RADIUS + l];                                             \
+        out_row[j] = FROM_FLOAT(value);                                                                 \
+    }                                                                                                   \
+}
+
+// Sums of the 2 * RADIUS + 1 8-bit rows into column_sums
+#define DEFINE_BOX_VERTICAL_STENCIL(NAME, RADIUS, UNUSED)                                               \
+static void boxVertical_##NAME(const unsigned char *const *rows, int taps, int *column_sums,            \
+                               int width) {                                                             \
+    (void)taps;                                                                                         \
+    _Pragma("omp simd")                                                                                 \
+    for (int j = 0; j < width; j++) {                                                                   \
+        int sum = 0;                                                                                    \
+        _Pragma("GCC unroll 16")                                                                        \
+        for (int k = 0; k < 2 * RADIUS + 1; k++)                                                        \
+            sum += rows[k][j];                                                                          \
+        column_sums[j] = sum;                                                                           \
+    }                                                                                                   \
+}
+
+// Box mean from column_sums into columns [from, to) of out_row
+#define DEFINE_BOX_HORIZONTAL_STENCIL(NAME, RADIUS, SUFFIX, TYPE, SUM_TYPE)                             \
+static void boxHorizontal_##SUFFIX##_##NAME(const SUM_TYPE *column_sums, int taps, TYPE *out_row,      \
+                                            int from, int to) {                                         \
+    SUM_TYPE count = (SUM_TYPE)((2 * RADIUS + 1) * (2 * RADIUS + 1));                                   \
+    (void)taps;                                                                                         \
+    _Pragma("omp simd")                                                                                 \
+    for (int j = from; j < to; j++) {                                                                   \
+        SUM_TYPE sum = 0;                                                                               \
+        _Pragma("GCC unroll 16")                                                                        \
+        for (int l = 0; l < 2 * RADIUS + 1; l++)                                                        \
+            sum += column_sums[j - RADIUS + l];                                                         \
+        out_row[j] = (TYPE)(sum / count);                                                               \
+    }                                                                                                   \
+}
+
+FOR_EACH_STENCIL_RADIUS(DEFINE_GAUSSIAN_VERTICAL_STENCIL, 0)
+FOR_EACH_STENCIL_RADIUS(DEFINE_GAUSSIAN_HORIZONTAL_STENCIL, u8, unsigned char, gaussianToU8)
+FOR_EACH_STENCIL_RADIUS(DEFINE_BOX_VERTICAL_STENCIL, 0)
+
+// The 8-bit float Gaussian and box column-sum passes for one radius
+typedef struct {
+    void (*gaussian_vertical)(const unsigned char *const *rows, const float *weights, int taps,
+                              float *vertical, int width);
+    void (*gaussian_horizontal)(const float *vertical, const float *weights, int taps,
+                                unsigned char *out_row, int from, int to);
+    void (*box_vertical)(const unsigned char *const *rows, int taps, int *column_sums, int width);
+} StencilsU8;
+
+#define STENCILS_U8_ENTRY(NAME, RADIUS, UNUSED) \
+    { gaussianVertical_##NAME, gaussianHorizontal_u8_##NAME, boxVertical_##NAME },
+
+// Indexed by radius; entry 0 is the generic one
+static const StencilsU8 stencils_u8[STENCIL_MAX_RADIUS + 1] = {
+    FOR_EACH_STENCIL_RADIUS(STENCILS_U8_ENTRY, 0)
+};
+
+// The stencils for a kernel of radius radius: its specialization, or the generic one
+static inline const StencilsU8 *stencilsU8(int radius) {
+    return &stencils_u8[radius <= STENCIL_MAX_RADIUS ? radius : 0];
+}
+
+// Add (or, without add, remove) window row r of a local-statistics filter to
+// the running column sums. Rows beyond the edge of a keep border add nothing.
+static void localStatisticsRow(const unsigned char *image_data, int width, int height, int r, int add,
+                               const RowBorder *border, uint32_t *column_sum, uint32_t *column_sum_sq) {
+    if (border->mode == BORDER_KEEP && (r < 0 || r >= height)) return;
+
+    const unsigned char *row = borderRow(image_data, width, height, r, border);
+    if (add) {
+        for (int j = 0; j < width; j++) {
+            column_sum[j] += row[j];
+            column_sum_sq[j] += row[j] * row[j];
+        }
+    } else {
+        for (int j = 0; j < width; j++) {
+            column_sum[j] -= row[j];
+            column_sum_sq[j] -= row[j] * row[j];
+        }
+    }
+}
+
+// Running sums of window column x beyond the left or right edge (of a border other than keep)
+static void localStatisticsEdgeColumn(const uint32_t *column_sum, const uint32_t *column_sum_sq, int width,
+                                      int x, int window_size, const RowBorder *border,
+                                      uint32_t *sum, uint32_t *sum_sq) {
+    int c = borderIndex(x, width, border->mode);
+    *sum = c < 0 ? (uint32_t)(window_size * border->fill) : column_sum[c];
+    *sum_sq = c < 0 ? (uint32_t)(window_size * border->fill * border->fill) : column_sum_sq[c];
+}
+
+// Frost estimate of pixel (i, j) from the mean and variance of its window: the
+// window weighted by distance from the centre, clipped at the image edges for a
+// keep border and completed by the border otherwise, summed in the same order
+// as the serial reference
+static double frostPixel(const unsigned char *image_data, int width, int height, int i, int j, int offset,
+                         double mean, double variance, const FilterStage *stage, const RowBorder *border) {
+    double weights[2 * MAX_FILTER_SIZE];
+    frostWeights(frostCoefficient(stage, mean, variance), offset, weights);
+
+    double sum = 0.0, weight_sum = 0.0;
+    if (i >= offset && i < height - offset && j >= offset && j < width - offset) {
+        for (int k = -offset; k <= offset; k++) {
+            const unsigned char *row = image_data + (size_t)(i + k) * width + j;
+            for (int l = -offset; l <= offset; l++) {
+                double weight = weights[abs(k) + abs(l)];
+                sum += weight * row[l];
+                weight_sum += weight;
             }
-            temp[i * width + j] = sum / kernel_area;
+        }
+        return sum / weight_sum;
+    }
+
+    for (int k = -offset; k <= offset; k++) {
+        if (border->mode == BORDER_KEEP && (i + k < 0 || i + k >= height)) continue;
+        const unsigned char *row = borderRow(image_data, width, height, i + k, border);
+        for (int l = -offset; l <= offset; l++) {
+            int x = borderIndex(j + l, width, border->mode);
+            if (border->mode == BORDER_KEEP && x != j + l) continue;
+            double weight = weights[abs(k) + abs(l)];
+            sum += weight * (x < 0 ? border->fill : row[x]);
+            weight_sum += weight;
         }
     }
+    return sum / weight_sum;
+}
+
+// Process output rows [first, last) of a local-statistics stage (the adaptive
+// Wiener, Lee, enhanced Lee or Frost filter).
+// Local sums of x and x^2 are kept as running column sums over the vertical window
+// and slid horizontally, so the mean and variance of each window cost O(1)
+// regardless of its size (Frost then weighs its window, in O(size^2)).
+// Windows are clipped at the image edges for a keep border and completed by the
+// border otherwise. If output_data is NULL, nothing is written and the sum of
+// local variances over the band is returned (for noise estimation).
+static double localStatisticsBand(const unsigned char *image_data, unsigned char *output_data,
+                                  int width, int height, const FilterStage *stage, double noise_variance,
+                                  const RowBorder *border, int first, int last,
+                                  uint32_t *column_sum, uint32_t *column_sum_sq) {
+    int window_size = stage->size;
+    int offset = window_size / 2;
+    int frost = stage->kind == FILTER_FROST;
+    int keep = border->mode == BORDER_KEEP;
+    double variance_sum = 0.0;
+    uint32_t column, column_sq;
+
+    // Column sums over rows [first - offset, first + offset]
+    memset(column_sum, 0, width * sizeof(uint32_t));
+    memset(column_sum_sq, 0, width * sizeof(uint32_t));
+    for (int r = first - offset; r <= first + offset; r++)
+        localStatisticsRow(image_data, width, height, r, 1, border, column_sum, column_sum_sq);
+
+    for (int i = first; i < last; i++) {
+        int window_rows = (i + offset < height ? i + offset : height - 1) - (i - offset > 0 ? i - offset : 0) + 1;
+        uint64_t sum = 0, sum_sq = 0;
+
+        // Horizontal window [-offset, offset] around column 0
+        for (int l = 0; l <= offset && l < width; l++) {
+            sum += column_sum[l];
+            sum_sq += column_sum_sq[l];
+        }
+        for (int l = -offset; !keep && l <= offset; l++) {
+            if (l >= 0 && l < width) continue;
+            localStatisticsEdgeColumn(column_sum, column_sum_sq, width, l, window_size, border, &column,
+                                      &column_sq);
+            sum += column;
+            sum_sq += column_sq;
+        }
 
-    // Copy border pixels (not processed by the filter)
-    for (int i = 0; i < offset; i++) {
         for (int j = 0; j < width; j++) {
-            temp[i * width + j] = image_data[i * width + j];
-            temp[(height - i - 1) * width + j] = image_data[(height - i - 1) * width + j];
+            int window_cols = (j + offset < width ? j + offset : width - 1) - (j - offset > 0 ? j - offset : 0) + 1;
+            double n = keep ? (double)window_rows * window_cols : (double)window_size * window_size;
+            double mean = sum / n;
+            double variance = sum_sq / n - mean * mean;
+            if (variance < 0) variance = 0;  // Rounding noise on flat regions
+
+            if (!output_data) {
+                variance_sum += variance;
+            } else {
+                int x = image_data[(size_t)i * width + j];
+                double value = frost ? frostPixel(image_data, width, height, i, j, offset, mean, variance, stage,
+                                                  border)
+                                     : localStatisticsValue(stage, noise_variance, x, mean, variance);
+                value += 0.5;
+                output_data[(size_t)i * width + j] = (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+            }
+
+            // Slide the horizontal window one column to the right
+            if (j + offset + 1 < width) {
+                sum += column_sum[j + offset + 1];
+                sum_sq += column_sum_sq[j + offset + 1];
+            } else if (!keep) {
+                localStatisticsEdgeColumn(column_sum, column_sum_sq, width, j + offset + 1, window_size, border,
+                                          &column, &column_sq);
+                sum += column;
+                sum_sq += column_sq;
+            }
+            if (j - offset >= 0) {
+                sum -= column_sum[j - offset];
+                sum_sq -= column_sum_sq[j - offset];
+            } else if (!keep) {
+                localStatisticsEdgeColumn(column_sum, column_sum_sq, width, j - offset, window_size, border,
+                                          &column, &column_sq);
+                sum -= column;
+                sum_sq -= column_sq;
+            }
         }
+
+        // Slide the vertical window one row down
+        localStatisticsRow(image_data, width, height, i + offset + 1, 1, border, column_sum, column_sum_sq);
+        localStatisticsRow(image_data, width, height, i - offset, 0, border, column_sum, column_sum_sq);
     }
-    
-    for (int i = offset; i < height - offset; i++) {
-        for (int j = 0; j < offset; j++) {
-            temp[i * width + j] = image_data[i * width + j];
-            temp[i * width + (width - j - 1)] = image_data[i * width + (width - j - 1)];
+
+    return variance_sum;
+}
+
+// Local-statistics filter with OpenMP parallelization: for each pixel the local
+// mean and variance over a window_size x window_size window give the adaptive
+// Wiener gain max(var - noise, 0) / max(var, noise) applied to (x - mean) (as in
+// MATLAB's wiener2), or the Lee, enhanced Lee or Frost estimate (filter_chain.h).
+// A negative adaptive Wiener noise variance means "estimate it" as the mean of
+// the local variances. Except for Frost, cost per pixel is independent of
+// window_size. output_data must not alias image_data.
+void applyLocalStatisticsFilter(const unsigned char *image_data, unsigned char *output_data,
+                                int width, int height, const FilterStage *stage) {
+    int window_size = stage->size;
+    double noise_variance = stage->noise;
+    if (window_size < 1 || window_size % 2 == 0) return;
+
+    // Noise estimation needs a first pass over the local statistics
+    int estimate_noise = stage->kind == FILTER_ADAPTIVE_WIENER && noise_variance < 0;
+    double variance_sum = 0.0;
+
+    #pragma omp parallel
+    {
+        int num_threads = omp_get_num_threads();
+        int thread_id = omp_get_thread_num();
+        int band = (height + num_threads - 1) / num_threads;
+        int first = thread_id * band;
+        int last = first + band < height ? first + band : height;
+
+        FilterScratch scratch = {0};
+        int have_scratch = reserveRowScratch(&scratch, width, 1);
+        RowBorder border = have_scratch ? stageBorder(stage, &scratch, 0, width) : keep_border;
+
+        if (have_scratch && first < last && estimate_noise) {
+            double band_sum = localStatisticsBand(image_data, NULL, width, height, stage, 0.0, &border,
+                                                  first, last, scratch.column_sum, scratch.column_sum_sq);
+            #pragma omp atomic
+            variance_sum += band_sum;
+        }
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            if (estimate_noise) noise_variance = variance_sum / ((double)width * height);
         }
+
+        if (have_scratch && first < last)
+            localStatisticsBand(image_data, output_data, width, height, stage, noise_variance, &border,
+                                first, last, scratch.column_sum, scratch.column_sum_sq);
+
+        freeScratch(&scratch);
     }
+}
 
-    memcpy(image_data, temp, width * height);
-    free(temp);
+// Columns [0, *left) and [*right, width) of a row are the ones a window of
+// radius offset does not fit around
+static inline void edgeColumns(int width, int offset, int *left, int *right) {
+    *left = offset < width ? offset : width;
+    *right = width - offset > *left ? width - offset : *left;
 }
 
-// Function to process the dataset and save the processed images in a different folder
-void processDataset(const char *json_path, const char *image_dir, const char *output_dir) {
-    double start_time, end_time;
+// Edge column j of the 5x5 fixed-point Gaussian, from its vertical pass
+static unsigned char gaussianEdge5(const uint16_t *vertical, const int16_t weights[5], int width, int j,
+                                   const RowBorder *border) {
+    int fill = 0;
+    for (int k = 0; k < 5; k++)
+        fill += mulhrsQ15(border->fill << 7, weights[k]);
 
-    FILE *file = fopen(json_path, "r");
-    if (!file) {
-        printf("Could not open JSON file: %s\n", json_path);
-        return;
+    int acc = 0;
+    for (int l = 0; l < 5; l++) {
+        int x = borderIndex(j - 2 + l, width, border->mode);
+        acc += mulhrsQ15(x < 0 ? fill : vertical[x], weights[l]);
+    }
+    return (unsigned char)(acc >> 7);
+}
+
+// Edge column j of the float separable Gaussian, from its vertical pass
+static unsigned char gaussianEdge(const float *vertical, const GaussianKernel *kernel, int width, int j,
+                                  const RowBorder *border) {
+    int offset = kernel->size / 2;
+    float fill = 0.0f;
+    for (int k = 0; k < kernel->size; k++)
+        fill += border->fill * kernel->weights[k];
+
+    float pixel_value = 0.0f;
+    for (int l = 0; l < kernel->size; l++) {
+        int x = borderIndex(j - offset + l, width, border->mode);
+        pixel_value += (x < 0 ? fill : vertical[x]) * kernel->weights[l];
     }
+    return gaussianToU8(pixel_value);
+}
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    char *json_data = (char *)malloc(length + 1);
-    fread(json_data, 1, length, file);
-    json_data[length] = '\0';
-    fclose(file);
+// Compute row r of the Gaussian-filtered image into out_row using the separable
+// kernel: a vertical pass into the float scratch row, then a horizontal pass
+// (or the SIMD fixed-point kernel for 5x5, using fixed_row as scratch).
+// The interior runs unchanged whatever the border; the rows the window runs off
+// come from borderRow and the edge columns are computed separately, or, for a
+// keep border, border rows and columns are copied from the input.
+// Works on `width` columns of rows that are `stride` pixels apart, so a tile can
+// pass a window of the image; the window's edge columns are then only valid
+// where they coincide with the image edge.
+static void gaussianRow(const unsigned char *image_data, int stride, int width, int height, int r,
+                        const GaussianKernel *kernel, const RowBorder *border, float *vertical,
+                        uint16_t *fixed_row, unsigned char *out_row) {
+    int offset = kernel->size / 2;
+    const unsigned char *in_row = image_data + (size_t)r * stride;
+    int keep = border->mode == BORDER_KEEP;
+    int left, right;
 
-    cJSON *root = cJSON_Parse(json_data);
-    if (!root) {
-        printf("Error parsing JSON\n");
-        free(json_data);
+    if (keep && (r < offset || r >= height - offset)) {
+        memcpy(out_row, in_row, width);
         return;
     }
 
-    cJSON *images = cJSON_GetObjectItem(root, "images");
-    if (!cJSON_IsArray(images)) {
-        printf("Invalid JSON format\n");
-        cJSON_Delete(root);
-        free(json_data);
+    const unsigned char *rows[MAX_KERNEL_SIZE];
+    for (int k = 0; k < kernel->size; k++)
+        rows[k] = borderRow(image_data, stride, height, r - offset + k, border);
+    edgeColumns(width, offset, &left, &right);
+
+    // 5x5 kernels go through the SIMD fixed-point path when available
+    if (kernel->size == 5 && stencil_kernels.gaussianRow5 && width >= 5) {
+        stencil_kernels.gaussianRow5(rows, kernel->weights_q15, fixed_row, out_row, width);
+        for (int j = 0; j < left; j++)
+            out_row[j] = keep ? in_row[j] : gaussianEdge5(fixed_row, kernel->weights_q15, width, j, border);
+        for (int j = right; j < width; j++)
+            out_row[j] = keep ? in_row[j] : gaussianEdge5(fixed_row, kernel->weights_q15, width, j, border);
         return;
     }
 
-    int total_images = cJSON_GetArraySize(images);
-    int processed_images = 0;
+    const StencilsU8 *stencils = stencilsU8(offset);
+    stencils->gaussian_vertical(rows, kernel->weights, kernel->size, vertical, width);
+
+    for (int j = 0; j < left; j++)
+        out_row[j] = keep ? in_row[j] : gaussianEdge(vertical, kernel, width, j, border);
+    for (int j = right; j < width; j++)
+        out_row[j] = keep ? in_row[j] : gaussianEdge(vertical, kernel, width, j, border);
+
+    stencils->gaussian_horizontal(vertical, kernel->weights, kernel->size, out_row, offset, width - offset);
+}
+
+// Box mean of edge column j from the column sums
+static unsigned char boxEdge(const int *column_sums, int window_size, int width, int j, const RowBorder *border) {
+    int offset = window_size / 2;
+    int sum = 0;
+    for (int l = -offset; l <= offset; l++) {
+        int x = borderIndex(j + l, width, border->mode);
+        sum += x < 0 ? window_size * border->fill : column_sums[x];
+    }
+    return (unsigned char)(sum / (window_size * window_size));
+}
+
+// Compute one row of the box mean from window_size consecutive Gaussian rows,
+// using per-column sums and a sliding horizontal window (SIMD kernel for 5x5).
+// Edge columns are computed from the column sums the border maps them to, or,
+// for a keep border, keep the value of the centre row, as in the serial filter.
+static void boxMeanRow(const unsigned char **rows, int window_size, int width, const RowBorder *border,
+                       int *column_sums, uint16_t *fixed_row, unsigned char *out_row) {
+    int kernel_area = window_size * window_size;
+    int offset = window_size / 2;
+    int left, right;
+
+    edgeColumns(width, offset, &left, &right);
+    if (border->mode == BORDER_KEEP) {
+        for (int j = 0; j < left; j++) out_row[j] = rows[offset][j];
+        for (int j = right; j < width; j++) out_row[j] = rows[offset][j];
+        if (width < window_size) return;
+    }
 
-    // Create the output directory if it doesn't exist
-    if (mkdir(output_dir) == -1 && errno != EEXIST) {
-        printf("Error creating output directory: %s\n", output_dir);
-        cJSON_Delete(root);
-        free(json_data);
+    // 5x5 box means go through the (exact) SIMD kernel when available
+    if (window_size == 5 && stencil_kernels.boxRow5 && width >= 5) {
+        stencil_kernels.boxRow5(rows, fixed_row, out_row, width);
+        if (border->mode == BORDER_KEEP) return;
+
+        // The edge columns only need the column sums of the window's width at either edge
+        for (int j = 0; j < 5; j++) {
+            column_sums[j] = fixed_row[j];
+            column_sums[width - 1 - j] = fixed_row[width - 1 - j];
+        }
+    } else {
+        stencilsU8(offset)->box_vertical(rows, window_size, column_sums, width);
+
+        if (width >= window_size) {
+            int sum = 0;
+            for (int l = 0; l < window_size; l++)
+                sum += column_sums[l];
+
+            for (int j = offset; j < width - offset; j++) {
+                out_row[j] = sum / kernel_area;
+                if (j + offset + 1 < width)
+                    sum += column_sums[j + offset + 1] - column_sums[j - offset];
+            }
+        }
+        if (border->mode == BORDER_KEEP) return;
+    }
+
+    for (int j = 0; j < left; j++) out_row[j] = boxEdge(column_sums, window_size, width, j, border);
+    for (int j = right; j < width; j++) out_row[j] = boxEdge(column_sums, window_size, width, j, border);
+}
+
+// Process the output tile rows [first, last) x columns [x0, x1) of the fused
+// Gaussian -> Wiener filter. Only the columns the tile depends on (its halo of
+// window_size / 2 + kernel_size / 2 pixels) are filtered, and only the last
+// window_size Gaussian rows are kept, in the scratch ring buffer indexed by row
+// number modulo window_size. Full-width tiles write straight to the output.
+// Box window rows beyond the top and bottom edge are the Gaussian rows of the
+// image the box border maps them to, which are always still in the ring.
+static void fusedGaussianWienerTile(const unsigned char *image_data, unsigned char *output_data,
+                                    int width, int height, const GaussianKernel *kernel,
+                                    const RowBorder *gaussian_border, int window_size, const RowBorder *box_border,
+                                    int first, int last, int x0, int x1, FilterScratch *scratch) {
+    int offset = window_size / 2;
+    int halo = offset + kernel->size / 2;
+    int span_begin = x0 - halo > 0 ? x0 - halo : 0;
+    int span_end = x1 + halo < width ? x1 + halo : width;
+    int span = span_end - span_begin;
+    const unsigned char *window = image_data + span_begin;
+    int direct = span_begin == x0 && span_end == x1;
+    int next_row = -1;  // Next Gaussian row to compute into the ring
+
+    for (int i = first; i < last; i++) {
+        unsigned char *out_row = direct ? output_data + (size_t)i * width + x0 : scratch->tile_row;
+
+        if (box_border->mode == BORDER_KEEP && (i < offset || i >= height - offset)) {
+            // Border rows of the box filter keep the Gaussian result
+            gaussianRow(window, width, span, height, i, kernel, gaussian_border, scratch->vertical,
+                        scratch->fixed_row, out_row);
+        } else {
+            int lo = i - offset > 0 ? i - offset : 0;
+            int hi = i + offset < height - 1 ? i + offset : height - 1;
+            if (next_row < lo) next_row = lo;
+            for (; next_row <= hi; next_row++)
+                gaussianRow(window, width, span, height, next_row, kernel, gaussian_border, scratch->vertical,
+                            scratch->fixed_row, scratch->ring + (size_t)(next_row % window_size) * span);
+
+            for (int k = 0; k < window_size; k++) {
+                int m = borderIndex(i - offset + k, height, box_border->mode);
+                scratch->rows[k] = m < 0 ? box_border->fill_row : scratch->ring + (size_t)(m % window_size) * span;
+            }
+
+            boxMeanRow(scratch->rows, window_size, span, box_border, scratch->column_sums, scratch->fixed_row,
+                       out_row);
+        }
+
+        if (!direct)
+            memcpy(output_data + (size_t)i * width + x0, out_row + (x0 - span_begin), x1 - x0);
+    }
+}
+
+// L2 cache size of this machine (per core), or a conservative default
+static long cacheSizeL2(void) {
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+    long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (size > 0) return size;
+#endif
+    return DEFAULT_L2_CACHE_SIZE;
+}
+
+// Pick a tile width whose working set (ring rows, Gaussian input rows and the
+// per-column scratch) fits in half the L2 cache, in whole 64-byte cache lines so
+// neighbouring tiles never share a line of the output
+int autoTileWidth(int kernel_size, int window_size) {
+    size_t bytes_per_column = window_size + kernel_size + sizeof(float) + sizeof(uint16_t) + sizeof(int) + 1;
+    int tile_width = (int)(cacheSizeL2() / 2 / bytes_per_column);
+
+    tile_width -= tile_width % 64;
+    return tile_width > 64 ? tile_width : 64;
+}
+
+// Cache-blocked fused Gaussian -> Wiener filter. The frame is split into
+// tile_width x tile_height output tiles, each computed from its own halo, and
+// the tiles are spread statically over the threads. Wide frames thus stream
+// through L1/L2 one tile at a time instead of full rows, and each thread works
+// on a contiguous block of tiles. Pass 0 for either size to auto-tune it:
+// the width from the L2 cache size, the height so every thread gets several tiles.
+// The output is that of gaussianRow followed by boxMeanRow, whatever the tile sizes.
+void applyFusedGaussianWienerTiled(const unsigned char *image_data, unsigned char *output_data,
+                                   int width, int height, const FilterStage *gaussian, const FilterStage *box,
+                                   int tile_width, int tile_height) {
+    const GaussianKernel *kernel = getGaussianKernel(gaussian->size, gaussian->sigma);
+    int kernel_size = gaussian->size;
+    int window_size = box->size;
+    if (!kernel || window_size < 1 || window_size % 2 == 0) return;
+
+    if (tile_width <= 0) tile_width = autoTileWidth(kernel_size, window_size);
+    if (tile_width > width) tile_width = width;
+    if (tile_height <= 0) {
+        tile_height = height / (4 * omp_get_max_threads());
+        if (tile_height < TILE_MIN_HEIGHT) tile_height = TILE_MIN_HEIGHT;
+    }
+    if (tile_height > height) tile_height = height;
+
+    int tiles_x = (width + tile_width - 1) / tile_width;
+    int tiles_y = (height + tile_height - 1) / tile_height;
+    int halo = window_size / 2 + kernel_size / 2;
+    int span = tile_width + 2 * halo < width ? tile_width + 2 * halo : width;
+
+    #pragma omp parallel
+    {
+        FilterScratch scratch = {0};
+        int have_scratch = reserveRowScratch(&scratch, span, window_size);
+        RowBorder gaussian_border = have_scratch ? stageBorder(gaussian, &scratch, 0, span) : keep_border;
+        RowBorder box_border = have_scratch ? stageBorder(box, &scratch, 1, span) : keep_border;
+
+        #pragma omp for schedule(static)
+        for (int t = 0; t < tiles_x * tiles_y; t++) {
+            if (!have_scratch) continue;
+
+            int y0 = (t / tiles_x) * tile_height;
+            int x0 = (t % tiles_x) * tile_width;
+            int y1 = y0 + tile_height < height ? y0 + tile_height : height;
+            int x1 = x0 + tile_width < width ? x0 + tile_width : width;
+            fusedGaussianWienerTile(image_data, output_data, width, height, kernel, &gaussian_border, window_size,
+                                    &box_border, y0, y1, x0, x1, &scratch);
+        }
+        freeScratch(&scratch);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Median
+//
+// The sliding histogram median of Perreault and Hebert: every column of a strip
+// keeps the histogram of its window_size rows around the current output row,
+// updated by one pixel in and one out per row, and the window's histogram is
+// slid along the row by adding the column entering it and subtracting the one
+// leaving it. Histograms have 16 coarse bins (the high nibble) over the 256
+// fine ones. Only the coarse bins of the window are slid at every column; the
+// fine bins under a coarse bin are brought up to date when the median falls in
+// it, which on real images is mostly the same few bins from one column to the
+// next, so each pixel costs about the same whatever the window size. Strips
+// are as wide as half the L2 cache holds column histograms for, and with
+// row_parallel the strips are split into tiles spread over the threads, as the
+// fused Gaussian -> Wiener filter is.
+// ---------------------------------------------------------------------------
+
+#define MEDIAN_BINS 256
+#define MEDIAN_COARSE_BINS 16
+#define MEDIAN_FINE_BINS (MEDIAN_BINS / MEDIAN_COARSE_BINS)     // Fine bins per coarse bin
+#define MEDIAN_COLUMN_BINS (MEDIAN_BINS + MEDIAN_COARSE_BINS)  // Fine bins, then coarse bins
+
+// The histogram of the window around one output column, slid along the row
+typedef struct {
+    const uint8_t *histograms;       // Column histograms of the span, from column span_begin on
+    const uint8_t *fill_column;      // Histogram of a column of fill samples (constant border)
+    int span_begin, width, offset;
+    BorderMode mode;
+    uint16_t coarse[MEDIAN_COARSE_BINS];
+    uint16_t fine[MEDIAN_BINS];
+    int updated[MEDIAN_COARSE_BINS];  // Column the fine bins under each coarse bin are for
+} MedianWindow;
+
+// Make sure scratch holds column histograms for the given number of columns
+static int reserveHistogramScratch(FilterScratch *scratch, int columns) {
+    if (columns <= scratch->histogram_columns) return 1;
+
+    free(scratch->histograms);
+    scratch->histograms = (uint8_t *)malloc((size_t)columns * MEDIAN_COLUMN_BINS);
+    scratch->histogram_columns = scratch->histograms ? columns : 0;
+    return scratch->histograms != NULL;
+}
+
+static inline void histogramAdd(uint8_t *histogram, int value, int count) {
+    histogram[value] += count;
+    histogram[MEDIAN_BINS + value / MEDIAN_FINE_BINS] += count;
+}
+
+// Add row (from column span_begin on) to, or without add remove it from, the span's column histograms
+static void medianRow(const unsigned char *row, int span_begin, int span, int add, uint8_t *histograms) {
+    int count = add ? 1 : -1;
+    for (int c = 0; c < span; c++)
+        histogramAdd(histograms + (size_t)c * MEDIAN_COLUMN_BINS, row[span_begin + c], count);
+}
+
+// Histogram of window column x: that of the column the border maps it to, or the fill column
+static inline const uint8_t *columnHistogram(const MedianWindow *window, int x) {
+    int c = borderIndex(x, window->width, window->mode);
+    return c < 0 ? window->fill_column : window->histograms + (size_t)(c - window->span_begin) * MEDIAN_COLUMN_BINS;
+}
+
+// Add (sign 1) or subtract (sign -1) count bins of a column histogram from bins of the window
+static inline void medianBins(uint16_t *bins, const uint8_t *column, int count, int sign) {
+    if (sign > 0) {
+        _Pragma("omp simd")
+        for (int b = 0; b < count; b++) bins[b] += column[b];
+    } else {
+        _Pragma("omp simd")
+        for (int b = 0; b < count; b++) bins[b] -= column[b];
+    }
+}
+
+// Start the window of output column j: coarse bins summed, no fine bins up to date
+static void medianWindowStart(MedianWindow *window, int j, int window_size) {
+    memset(window->coarse, 0, sizeof(window->coarse));
+    for (int l = j - window->offset; l <= j + window->offset; l++)
+        medianBins(window->coarse, columnHistogram(window, l) + MEDIAN_BINS, MEDIAN_COARSE_BINS, 1);
+    for (int bin = 0; bin < MEDIAN_COARSE_BINS; bin++) window->updated[bin] = j - window_size;
+}
+
+// Bring the fine bins under coarse bin bin up to date for output column j:
+// slid from the column they are for when that is close, summed again otherwise
+static void medianFineBins(MedianWindow *window, int bin, int j, int window_size) {
+    uint16_t *fine = window->fine + bin * MEDIAN_FINE_BINS;
+    int from = window->updated[bin];
+    int first = bin * MEDIAN_FINE_BINS;
+
+    if (2 * (j - from) > window_size) {
+        memset(fine, 0, MEDIAN_FINE_BINS * sizeof(uint16_t));
+        for (int l = j - window->offset; l <= j + window->offset; l++)
+            medianBins(fine, columnHistogram(window, l) + first, MEDIAN_FINE_BINS, 1);
+    } else {
+        for (int x = from + 1; x <= j; x++) {
+            medianBins(fine, columnHistogram(window, x + window->offset) + first, MEDIAN_FINE_BINS, 1);
+            medianBins(fine, columnHistogram(window, x - window->offset - 1) + first, MEDIAN_FINE_BINS, -1);
+        }
+    }
+    window->updated[bin] = j;
+}
+
+// The rank-th smallest sample (from 1) of the window around output column j
+static inline unsigned char medianOf(MedianWindow *window, int j, int window_size, int rank) {
+    int count = 0, bin = 0;
+    while (count + window->coarse[bin] < rank) count += window->coarse[bin++];
+    if (window->updated[bin] != j) medianFineBins(window, bin, j, window_size);
+
+    int value = bin * MEDIAN_FINE_BINS;
+    while (count + window->fine[value] < rank) count += window->fine[value++];
+    return (unsigned char)value;
+}
+
+// Median of output rows [first, last) x columns [x0, x1). Window rows beyond
+// the top and bottom edge come from borderRow and columns beyond the left and
+// right edge are the histograms of the columns the border maps them to (or of
+// a column of fill); with a keep border the pixels the window does not fit
+// around keep the input, as in the serial filter.
+static void medianTile(const unsigned char *image_data, unsigned char *output_data, int width, int height,
+                       int window_size, const RowBorder *border, int first, int last, int x0, int x1,
+                       uint8_t *histograms) {
+    int offset = window_size / 2;
+    int rank = (window_size * window_size + 1) / 2;
+    int i0 = first, i1 = last, j0 = x0, j1 = x1;
+
+    if (border->mode == BORDER_KEEP) {
+        int left, right;
+        edgeColumns(width, offset, &left, &right);
+        for (int i = first; i < last; i++) {
+            const unsigned char *row = image_data + (size_t)i * width;
+            unsigned char *out_row = output_data + (size_t)i * width;
+            if (i < offset || i >= height - offset) {
+                memcpy(out_row + x0, row + x0, x1 - x0);
+                continue;
+            }
+            for (int j = x0; j < x1 && j < left; j++) out_row[j] = row[j];
+            for (int j = right > x0 ? right : x0; j < x1; j++) out_row[j] = row[j];
+        }
+        if (i0 < offset) i0 = offset;
+        if (i1 > height - offset) i1 = height - offset;
+        if (j0 < left) j0 = left;
+        if (j1 > right) j1 = right;
+    }
+    if (i0 >= i1 || j0 >= j1) return;
+
+    // Column histograms of the span the windows of columns [j0, j1) cover
+    int span_begin = j0 - offset > 0 ? j0 - offset : 0;
+    int span_end = j1 + offset < width ? j1 + offset : width;
+    int span = span_end - span_begin;
+    uint8_t fill_column[MEDIAN_COLUMN_BINS] = {0};
+    histogramAdd(fill_column, border->fill, window_size);
+    MedianWindow window = { histograms, fill_column, span_begin, width, offset, border->mode, {0}, {0}, {0} };
+
+    memset(histograms, 0, (size_t)span * MEDIAN_COLUMN_BINS);
+    for (int r = i0 - offset; r <= i0 + offset; r++)
+        medianRow(borderRow(image_data, width, height, r, border), span_begin, span, 1, histograms);
+
+    for (int i = i0; i < i1; i++) {
+        unsigned char *out_row = output_data + (size_t)i * width;
+
+        medianWindowStart(&window, j0, window_size);
+        for (int j = j0; j < j1; j++) {
+            out_row[j] = medianOf(&window, j, window_size, rank);
+            if (j + 1 < j1) {
+                medianBins(window.coarse, columnHistogram(&window, j + offset + 1) + MEDIAN_BINS,
+                           MEDIAN_COARSE_BINS, 1);
+                medianBins(window.coarse, columnHistogram(&window, j - offset) + MEDIAN_BINS,
+                           MEDIAN_COARSE_BINS, -1);
+            }
+        }
+
+        // Slide the column histograms one row down
+        if (i + 1 < i1) {
+            medianRow(borderRow(image_data, width, height, i - offset, border), span_begin, span, 0, histograms);
+            medianRow(borderRow(image_data, width, height, i + offset + 1, border), span_begin, span, 1,
+                      histograms);
+        }
+    }
+}
+
+// Width of the median strips: as many columns as half the L2 cache holds the
+// histograms of, in whole cache lines of output
+static int medianTileWidth(int window_size) {
+    int tile_width = (int)(cacheSizeL2() / 2 / MEDIAN_COLUMN_BINS) - (window_size - 1);
+    tile_width -= tile_width % 64;
+    return tile_width > 64 ? tile_width : 64;
+}
+
+// Median filter of stage (see medianTile) from image_data into output_data,
+// which must not alias. With row_parallel the frame is split into tiles spread
+// over all threads; otherwise it runs on the calling thread, in strips, with
+// the worker's scratch buffers. Returns 0 if scratch could not be allocated.
+static int applyMedianFilter(const unsigned char *image_data, unsigned char *output_data, int width, int height,
+                             const FilterStage *stage, FilterScratch *scratch, int row_parallel) {
+    int window_size = stage->size;
+    int tile_width = medianTileWidth(window_size);
+    if (tile_width > width) tile_width = width;
+    int span = tile_width + window_size - 1 < width ? tile_width + window_size - 1 : width;
+    int tiles_x = (width + tile_width - 1) / tile_width;
+
+    if (!row_parallel) {
+        if (!reserveRowScratch(scratch, width, 1) || !reserveHistogramScratch(scratch, span)) return 0;
+        RowBorder border = stageBorder(stage, scratch, 0, width);
+        for (int x0 = 0; x0 < width; x0 += tile_width) {
+            int x1 = x0 + tile_width < width ? x0 + tile_width : width;
+            medianTile(image_data, output_data, width, height, window_size, &border, 0, height, x0, x1,
+                       scratch->histograms);
+        }
+        return 1;
+    }
+
+    int tile_height = height / (4 * omp_get_max_threads());
+    if (tile_height < TILE_MIN_HEIGHT) tile_height = TILE_MIN_HEIGHT;
+    if (tile_height > height) tile_height = height;
+    int tiles_y = (height + tile_height - 1) / tile_height;
+    int ok = 1;
+
+    #pragma omp parallel
+    {
+        FilterScratch local = {0};
+        int have_scratch = reserveRowScratch(&local, width, 1) && reserveHistogramScratch(&local, span);
+        if (!have_scratch) {
+            #pragma omp atomic write
+            ok = 0;
+        }
+        RowBorder border = have_scratch ? stageBorder(stage, &local, 0, width) : keep_border;
+
+        #pragma omp for schedule(static)
+        for (int t = 0; t < tiles_x * tiles_y; t++) {
+            if (!have_scratch) continue;
+
+            int y0 = (t / tiles_x) * tile_height;
+            int x0 = (t % tiles_x) * tile_width;
+            int y1 = y0 + tile_height < height ? y0 + tile_height : height;
+            int x1 = x0 + tile_width < width ? x0 + tile_width : width;
+            medianTile(image_data, output_data, width, height, window_size, &border, y0, y1, x0, x1,
+                       local.histograms);
+        }
+        freeScratch(&local);
+    }
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// 16-bit and float32 samples
+//
+// The Gaussian and box stages of the filter chain for u16 and f32 images,
+// generated per type by DEFINE_WIDE_FILTER. The separable Gaussian goes through a float row, the
+// box mean through per-column sums, and the inner loops run over contiguous
+// columns so the compiler vectorizes them for the target ISA. Borders follow
+// the 8-bit filters: window rows beyond the edge are looked up (or are the
+// fill), edge columns are computed on their own, and with a keep border
+// Gaussian border pixels keep the input value and Wiener border pixels keep
+// the Gaussian value. u16 results and fill values are clamped and truncated
+// like the 8-bit reference; f32 results are not quantized. Stages run one
+// pass each (no fusion); the local-statistics and median stages are 8-bit only,
+// so the images of chains with them are loaded as 8 bits (DatasetJob.wide_samples).
+// ---------------------------------------------------------------------------
+
+#define DEFINE_WIDE_FILTER(SUFFIX, TYPE, SUM_TYPE, FROM_FLOAT)                                          \
+FOR_EACH_STENCIL_RADIUS(DEFINE_GAUSSIAN_HORIZONTAL_STENCIL, SUFFIX, TYPE, FROM_FLOAT)                   \
+FOR_EACH_STENCIL_RADIUS(DEFINE_BOX_HORIZONTAL_STENCIL, SUFFIX, TYPE, SUM_TYPE)                          \
+                                                                                                        \
+/* The interior stencils by radius, entry 0 the generic one */                                          \
+typedef void (*GaussianHorizontal_##SUFFIX)(const float *, const float *, int, TYPE *, int, int);       \
+typedef void (*BoxHorizontal_##SUFFIX)(const SUM_TYPE *, int, TYPE *, int, int);                        \
+static const GaussianHorizontal_##SUFFIX gaussian_horizontal_##SUFFIX[STENCIL_MAX_RADIUS + 1] = {       \
+    FOR_EACH_STENCIL_RADIUS(STENCIL_ENTRY, gaussianHorizontal_##SUFFIX)                                 \
+};                                                                                                      \
+static const BoxHorizontal_##SUFFIX box_horizontal_##SUFFIX[STENCIL_MAX_RADIUS + 1] = {                 \
+    FOR_EACH_STENCIL_RADIUS(STENCIL_ENTRY, boxHorizontal_##SUFFIX)                                      \
+};                                                                                                      \
+                                                                                                        \
+static TYPE gaussianEdge_##SUFFIX(const float *vertical, const GaussianKernel *kernel, int width,       \
+                                  int x, BorderMode border, float fill_column) {                        \
+    float value = 0.0f;                                                                                 \
+    for (int l = 0; l < kernel->size; l++) {                                                            \
+        int c = borderIndex(x - kernel->size / 2 + l, width, border);                                   \
+        value += kernel->weights[l] * (c < 0 ? fill_column : vertical[c]);                              \
+    }                                                                                                   \
+    return FROM_FLOAT(value);                                                                           \
+}                                                                                                       \
+                                                                                                        \
+static void gaussianRow_##SUFFIX(const TYPE *image, int width, int height, int r,                       \
+                                 const GaussianKernel *kernel, const FilterStage *stage,                \
+                                 float *vertical, TYPE *out_row) {                                      \
+    int radius = kernel->size / 2;                                                                      \
+    BorderMode border = stage->border;                                                                  \
+    int keep = border == BORDER_KEEP;                                                                   \
+    const TYPE *row = image + (size_t)r * width;                                                        \
+    if (keep && (r < radius || r >= height - radius || width <= 2 * radius)) {                          \
+        memcpy(out_row, row, width * sizeof(TYPE));                                                     \
+        return;                                                                                         \
+    }                                                                                                   \
+                                                                                                        \
+    TYPE fill = FROM_FLOAT((float)stage->fill);                                                         \
+    float fill_column = 0.0f;                                                                           \
+    for (int x = 0; x < width; x++) vertical[x] = 0.0f;                                                 \
+    for (int k = 0; k < kernel->size; k++) {                                                            \
+        int y = borderIndex(r - radius + k, height, border);                                            \
+        float weight = kernel->weights[k];                                                              \
+        fill_column += weight * (float)fill;                                                            \
+        if (y < 0) {                                                                                    \
+            _Pragma("omp simd")                                                                         \
+            for (int x = 0; x < width; x++) vertical[x] += weight * (float)fill;                        \
+            continue;                                                                                   \
+        }                                                                                               \
+        const TYPE *src = image + (size_t)y * width;                                                    \
+        _Pragma("omp simd")                                                                             \
+        for (int x = 0; x < width; x++) vertical[x] += weight * (float)src[x];                          \
+    }                                                                                                   \
+                                                                                                        \
+    int left, right;                                                                                    \
+    edgeColumns(width, radius, &left, &right);                                                          \
+    for (int x = 0; x < left; x++)                                                                      \
+        out_row[x] = keep ? row[x]                                                                      \
+                          : gaussianEdge_##SUFFIX(vertical, kernel, width, x, border, fill_column);     \
+    for (int x = right; x < width; x++)                                                                 \
+        out_row[x] = keep ? row[x]                                                                      \
+                          : gaussianEdge_##SUFFIX(vertical, kernel, width, x, border, fill_column);     \
+    int stencil = radius <= STENCIL_MAX_RADIUS ? radius : 0;                                            \
+    gaussian_horizontal_##SUFFIX[stencil](vertical, kernel->weights, kernel->size, out_row, radius,     \
+                                          width - radius);                                              \
+}                                                                                                       \
+                                                                                                        \
+static TYPE boxEdge_##SUFFIX(const SUM_TYPE *column_sums, int window_size, int width, int x,            \
+                             BorderMode border, SUM_TYPE fill_column) {                                 \
+    SUM_TYPE sum = 0;                                                                                   \
+    for (int l = -(window_size / 2); l <= window_size / 2; l++) {                                       \
+        int c = borderIndex(x + l, width, border);                                                      \
+        sum += c < 0 ? fill_column : column_sums[c];                                                    \
+    }                                                                                                   \
+    return (TYPE)(sum / (SUM_TYPE)(window_size * window_size));                                         \
+}                                                                                                       \
+                                                                                                        \
+static void boxRow_##SUFFIX(const TYPE *plane, int width, int height, int r, const FilterStage *stage,  \
+                            SUM_TYPE *column_sums, TYPE *out_row) {                                     \
+    int window_size = stage->size;                                                                      \
+    int half = window_size / 2;                                                                         \
+    BorderMode border = stage->border;                                                                  \
+    int keep = border == BORDER_KEEP;                                                                   \
+    const TYPE *row = plane + (size_t)r * width;                                                        \
+    if (keep && (r < half || r >= height - half || width <= 2 * half)) {                                \
+        memcpy(out_row, row, width * sizeof(TYPE));                                                     \
+        return;                                                                                         \
+    }                                                                                                   \
+                                                                                                        \
+    TYPE fill = FROM_FLOAT((float)stage->fill);                                                         \
+    SUM_TYPE fill_column = 0;                                                                           \
+    for (int x = 0; x < width; x++) column_sums[x] = 0;                                                 \
+    for (int k = -half; k <= half; k++) {                                                               \
+        int y = borderIndex(r + k, height, border);                                                     \
+        fill_column += fill;                                                                            \
+        if (y < 0) {                                                                                    \
+            _Pragma("omp simd")                                                                         \
+            for (int x = 0; x < width; x++) column_sums[x] += fill;                                     \
+            continue;                                                                                   \
+        }                                                                                               \
+        const TYPE *src = plane + (size_t)y * width;                                                    \
+        _Pragma("omp simd")                                                                             \
+        for (int x = 0; x < width; x++) column_sums[x] += src[x];                                       \
+    }                                                                                                   \
+                                                                                                        \
+    int left, right;                                                                                    \
+    edgeColumns(width, half, &left, &right);                                                            \
+    for (int x = 0; x < left; x++)                                                                      \
+        out_row[x] = keep ? row[x]                                                                      \
+                          : boxEdge_##SUFFIX(column_sums, window_size, width, x, border, fill_column);  \
+    for (int x = right; x < width; x++)                                                                 \
+        out_row[x] = keep ? row[x]                                                                      \
+                          : boxEdge_##SUFFIX(column_sums, window_size, width, x, border, fill_column);  \
+    int stencil = half <= STENCIL_MAX_RADIUS ? half : 0;                                                \
+    box_horizontal_##SUFFIX[stencil](column_sums, window_size, out_row, half, width - half);            \
+}                                                                                                       \
+                                                                                                        \
+                                                                                                        \
+                                                                                                        \
+/* Run the chain's Gaussian and box stages one pass at a time, alternating   */ \
+/* between an intermediate plane and output_data so the last pass lands in   */ \
+/* output_data. With row_parallel the rows of each pass are split across the */ \
+/* threads. Returns 0 if a buffer could not be allocated or the chain has a  */ \
+/* stage without a wide implementation (local statistics or median).         */ \
+static int filterImage_##SUFFIX(const TYPE *image_data, TYPE *output_data, int width, int height,      \
+                                const FilterChain *chain, int row_parallel) {                           \
+    const GaussianKernel *kernels[MAX_CHAIN_STAGES];                                                    \
+    for (int i = 0; i < chain->count; i++) {                                                            \
+        const FilterStage *stage = &chain->stages[i];                                                   \
+        if (stage->kind != FILTER_GAUSSIAN && stage->kind != FILTER_BOX) return 0;                      \
+        kernels[i] = stage->kind == FILTER_GAUSSIAN ? getGaussianKernel(stage->size, stage->sigma) : NULL; \
+        if (stage->kind == FILTER_GAUSSIAN && !kernels[i]) return 0;                                    \
+    }                                                                                                   \
+                                                                                                        \
+    TYPE *plane = NULL;                                                                                 \
+    if (chain->count > 1) {                                                                             \
+        plane = (TYPE *)poolMalloc((size_t)width * height * sizeof(TYPE));                              \
+        if (!plane) return 0;                                                                           \
+    }                                                                                                   \
+    int ok = 1;                                                                                         \
+                                                                                                        \
+    _Pragma("omp parallel if(row_parallel)")                                                            \
+    {                                                                                                   \
+        float *vertical = (float *)poolMalloc(width * sizeof(float));                                   \
+        SUM_TYPE *column_sums = (SUM_TYPE *)poolMalloc(width * sizeof(SUM_TYPE));                       \
+        if (!vertical || !column_sums) {                                                                \
+            _Pragma("omp atomic write")                                                                 \
+            ok = 0;                                                                                     \
+        }                                                                                               \
+        _Pragma("omp barrier")                                                                          \
+                                                                                                        \
+        const TYPE *src = image_data;                                                                   \
+        for (int i = 0; ok && i < chain->count; i++) {                                                  \
+            TYPE *dst = (chain->count - 1 - i) % 2 == 0 ? output_data : plane;                          \
+            _Pragma("omp for schedule(static)")                                                         \
+            for (int r = 0; r < height; r++) {                                                          \
+                if (kernels[i])                                                                         \
+                    gaussianRow_##SUFFIX(src, width, height, r, kernels[i], &chain->stages[i], vertical, \
+                                         dst + (size_t)r * width);                                      \
+                else                                                                                    \
+                    boxRow_##SUFFIX(src, width, height, r, &chain->stages[i], column_sums,              \
+                                    dst + (size_t)r * width);                                           \
+            }                                                                                           \
+            src = dst;                                                                                  \
+        }                                                                                               \
+        poolFree(vertical);                                                                             \
+        poolFree(column_sums);                                                                          \
+    }                                                                                                   \
+                                                                                                        \
+    poolFree(plane);                                                                                    \
+    return ok;                                                                                          \
+}
+
+DEFINE_WIDE_FILTER(u16, uint16_t, uint32_t, gaussianToU16)
+DEFINE_WIDE_FILTER(f32, float, float, gaussianToF32)
+
+// Filter a u16 or f32 image (see DEFINE_WIDE_FILTER). Returns 0 on failure.
+static int filterWideImage(const void *image_data, void *output_data, int width, int height,
+                           int dtype, const FilterChain *chain, int row_parallel) {
+    switch (dtype) {
+        case PIXEL_U16:
+            return filterImage_u16((const uint16_t *)image_data, (uint16_t *)output_data, width, height,
+                                   chain, row_parallel);
+        case PIXEL_F32:
+            return filterImage_f32((const float *)image_data, (float *)output_data, width, height,
+                                   chain, row_parallel);
+        default:
+            return 0;
+    }
+}
+
+// Row r of the box mean of src into dst; border rows of a keep border keep the input
+static void boxMeanPassRow(const unsigned char *src, unsigned char *dst, int width, int height, int window_size,
+                           const RowBorder *border, int r, FilterScratch *scratch) {
+    int offset = window_size / 2;
+    unsigned char *out_row = dst + (size_t)r * width;
+
+    if (border->mode == BORDER_KEEP && (r < offset || r >= height - offset)) {
+        memcpy(out_row, src + (size_t)r * width, width);
         return;
     }
+    for (int k = 0; k < window_size; k++)
+        scratch->rows[k] = borderRow(src, width, height, r - offset + k, border);
+    boxMeanRow(scratch->rows, window_size, width, border, scratch->column_sums, scratch->fixed_row, out_row);
+}
+
+// Run one pass of the chain, stage i (or stages i and i + 1 when they fuse),
+// from src into dst, which must not alias. With row_parallel the rows or tiles
+// are split across all threads; otherwise the pass runs on the calling thread
+// with the worker's scratch buffers. Returns 0 on failure.
+static int filterPassU8(const unsigned char *src, unsigned char *dst, int width, int height,
+                        const FilterChain *chain, int i, FilterScratch *scratch, int row_parallel) {
+    const FilterStage *stage = &chain->stages[i];
+    const GaussianKernel *kernel = NULL;
+    if (stage->kind == FILTER_GAUSSIAN && !(kernel = getGaussianKernel(stage->size, stage->sigma))) return 0;
+
+    if (chainFusesAt(chain, i)) {
+        const FilterStage *box = &chain->stages[i + 1];
+        int window_size = box->size;
+        if (row_parallel) {
+            // Gaussian and Wiener in a single fused, cache-blocked pass
+            applyFusedGaussianWienerTiled(src, dst, width, height, stage, box, TILE_WIDTH, TILE_HEIGHT);
+            return 1;
+        }
+        if (!reserveRowScratch(scratch, width, window_size)) return 0;
+
+        // Wide frames are processed in cache-sized column strips
+        RowBorder gaussian_border = stageBorder(stage, scratch, 0, width);
+        RowBorder box_border = stageBorder(box, scratch, 1, width);
+        int tile_width = TILE_WIDTH > 0 ? TILE_WIDTH : autoTileWidth(stage->size, window_size);
+        for (int x0 = 0; x0 < width; x0 += tile_width) {
+            int x1 = x0 + tile_width < width ? x0 + tile_width : width;
+            fusedGaussianWienerTile(src, dst, width, height, kernel, &gaussian_border, window_size, &box_border,
+                                    0, height, x0, x1, scratch);
+        }
+        return 1;
+    }
+
+    if (usesLocalStatistics(stage->kind)) {
+        if (row_parallel) {
+            applyLocalStatisticsFilter(src, dst, width, height, stage);
+            return 1;
+        }
+        if (!reserveRowScratch(scratch, width, 1)) return 0;
+
+        RowBorder border = stageBorder(stage, scratch, 0, width);
+        double noise_variance = stage->noise;
+        if (stage->kind == FILTER_ADAPTIVE_WIENER && noise_variance < 0)
+            noise_variance = localStatisticsBand(src, NULL, width, height, stage, 0.0, &border, 0, height,
+                                                 scratch->column_sum, scratch->column_sum_sq)
+                             / ((double)width * height);
+        localStatisticsBand(src, dst, width, height, stage, noise_variance, &border, 0, height,
+                            scratch->column_sum, scratch->column_sum_sq);
+        return 1;
+    }
+    if (stage->kind == FILTER_MEDIAN)
+        return applyMedianFilter(src, dst, width, height, stage, scratch, row_parallel);
+
+    // A Gaussian or box mean on its own, row by row
+    int ok = 1;
+    #pragma omp parallel if(row_parallel)
+    {
+        FilterScratch local = {0};
+        FilterScratch *rows = row_parallel ? &local : scratch;
+        int have_scratch = reserveRowScratch(rows, width, stage->size);
+        if (!have_scratch) {
+            #pragma omp atomic write
+            ok = 0;
+        }
+        RowBorder border = have_scratch ? stageBorder(stage, rows, 0, width) : keep_border;
+
+        #pragma omp for schedule(static)
+        for (int r = 0; r < height; r++) {
+            if (!have_scratch) continue;
+            if (kernel)
+                gaussianRow(src, width, width, height, r, kernel, &border, rows->vertical, rows->fixed_row,
+                            dst + (size_t)r * width);
+            else
+                boxMeanPassRow(src, dst, width, height, stage->size, &border, r, rows);
+        }
+        freeScratch(&local);
+    }
+    return ok;
+}
+
+// Run the filter chain on an 8-bit image. image_data is left untouched; passes
+// alternate between output_data and the scratch plane so that the last one
+// lands in output_data. See filterPassU8 for row_parallel.
+static int filterImageU8(const unsigned char *image_data, unsigned char *output_data, int width, int height,
+                         const FilterChain *chain, FilterScratch *scratch, int row_parallel) {
+    int passes = chainPassCount(chain);
+    if (passes > 1 && !reserveFrameBuffer(&scratch->plane, &scratch->plane_size, (size_t)width * height))
+        return 0;
+
+    const unsigned char *src = image_data;
+    for (int i = 0, pass = 0; i < chain->count; i++, pass++) {
+        unsigned char *dst = (passes - 1 - pass) % 2 == 0 ? output_data : scratch->plane;
+        if (!filterPassU8(src, dst, width, height, chain, i, scratch, row_parallel)) return 0;
+        if (chainFusesAt(chain, i)) i++;
+        src = dst;
+    }
+    return 1;
+}
+
+// Load, filter and save one image. With row_parallel set, the filters split
+// the rows of the image across all threads; otherwise the image is processed
+// by the calling thread alone. A converted raw copy of the image is preferred;
+// when the output is raw too and keeps the image's size, the filters read the
+// mapped input and write straight into the mapped output file. Stage timings go to image's record in
+// the run report, under thread. Returns 1 if the output image was written.
+static int processImage(DatasetJob *job, int image, FilterScratch *scratch, int row_parallel, int thread) {
+    char image_path[512], output_path[512], raw_path[520], temp_path[524];
+    InputImage input;
+    SarRawImage raw_output;
+    const OutputOptions *output = job->output;
+    RunReport *report = job->report;
+
+    datasetImagePaths(job, image, image_path, output_path);
+    if (!loadInputImage(image_path, job->wide_samples, &input, job->prefetch, report, image, thread)) return 0;
+
+    int raw_input = input.is_raw;
+    int width = input.width, height = input.height, dtype = input.dtype;
+    int out_width, out_height;
+    int resizing = outputSize(output, width, height, &out_width, &out_height);
+    int mapped_output = raw_input && !resizing && (output->format == OUTPUT_AUTO || output->format == OUTPUT_RAW);
+    unsigned char *output_data;
+
+    // A mapped output is filtered under a temporary name and renamed once complete,
+    // so an image that fails leaves no output file behind
+    if (mapped_output) {
+        snprintf(raw_path, sizeof(raw_path), "%s%s", output_path, SAR_RAW_EXTENSION);
+        snprintf(temp_path, sizeof(temp_path), "%s.tmp", raw_path);
+        if (sarRawCreate(temp_path, width, height, dtype, &raw_output) != SAR_RAW_OK) {
+            freeInputImage(&input);
+            return 0;
+        }
+        output_data = raw_output.pixels;
+    } else {
+        if (!reserveFrameBuffer(&scratch->output, &scratch->output_size,
+                                (size_t)width * height * pixelSize(dtype))) {
+            printf("\nOut of memory processing image: %s\n", image_path);
+            freeInputImage(&input);
+            return 0;
+        }
+        output_data = scratch->output;
+    }
 
-    // Get number of available threads
-    int num_threads = omp_get_max_threads();
-    printf("Processing with %d OpenMP threads\n", num_threads);
+    double filter_start = omp_get_wtime();
+    int filtered = dtype == PIXEL_U8
+        ? filterImageU8((const unsigned char *)input.pixels, output_data, width, height, job->chain, scratch,
+                        row_parallel)
+        : filterWideImage(input.pixels, output_data, width, height, dtype, job->chain, row_parallel);
+    runReportStage(report, image, thread, STAGE_FILTER, omp_get_wtime() - filter_start);
 
-    start_time = omp_get_wtime(); // Use OpenMP timing for more accuracy
+    freeInputImage(&input);
+    // A mapped output file already holds the filtered pixels; flushing it is its encode stage
+    if (mapped_output) {
+        double flush_start = omp_get_wtime();
+        sarRawClose(&raw_output);
+        int renamed = 0;
+        if (filtered) {
+            remove(raw_path);
+            renamed = rename(temp_path, raw_path) == 0;
+        }
+        if (!renamed) remove(temp_path);
+        runReportStage(report, image, thread, STAGE_ENCODE, omp_get_wtime() - flush_start);
+        runReportBytes(report, image, thread, 0,
+                       renamed ? SAR_RAW_HEADER_SIZE + (size_t)width * height * pixelSize(dtype) : 0);
+        if (filtered && !renamed) {
+            printf("\nError writing %s\n", raw_path);
+            return 0;
+        }
+    }
 
-    // Process images
-    // Note: We don't parallelize this outer loop because file I/O might cause conflicts
-    // Instead, we parallelize the filter application inside each image
-    cJSON *image_item;
-    cJSON_ArrayForEach(image_item, images) {
-        cJSON *file_name = cJSON_GetObjectItem(image_item, "file_name");
-        if (!cJSON_IsString(file_name)) continue;
+    if (!filtered) {
+        printf("\nOut of memory filtering %s image: %s\n", pixelTypeName(dtype), image_path);
+        return 0;
+    }
 
-        char image_path[512];
-        char output_path[512];
-        
-        // Original image path
-        sprintf(image_path, "%s/%s", image_dir, file_name->valuestring);
-        
-        // Output path for processed images
-        sprintf(output_path, "%s/%s", output_dir, file_name->valuestring);
+    if (mapped_output) return 1;
 
-        int width, height, channels;
-        unsigned char *image_data = stbi_load(image_path, &width, &height, &channels, STBI_grey);
-        if (!image_data) {
-            printf("\nCould not read image: %s\n", image_path);
-            continue;
+    // A row-parallel image is scaled by all threads too, which leaves saveOutputImage nothing to scale
+    void *resized = NULL;
+    if (resizing && row_parallel) {
+        resized = resizeOutputImage(output_data, width, height, dtype, output, omp_get_max_threads(), &width,
+                                    &height, report, image, thread);
+        if (!resized) {
+            printf("\nOut of memory resizing image: %s\n", image_path);
+            return 0;
         }
+        output_data = (unsigned char *)resized;
+    }
+
+    // Save processed image to the new location
+    int written = saveOutputImage(output_path, output_data, width, height, dtype, output, raw_input, report, image,
+                                  thread);
+    poolFree(resized);
+    return written;
+}
+
+// Bounded blocking FIFO connecting two pipeline stages.
+// push blocks while the queue is full (backpressure on the producer);
+// pop blocks while it is empty and returns NULL once it is closed and drained.
+typedef struct {
+    void **items;
+    int capacity;
+    int head;
+    int count;
+    int producers;      // Producers still running; the queue closes when this reaches 0
+    // Depth statistics for the run report, updated under lock
+    int max_depth;
+    long long depth_sum;
+    long pushes;
+    long full_waits;
+    long empty_waits;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} BoundedQueue;
+
+static int initQueue(BoundedQueue *queue, int capacity, int producers) {
+    queue->items = (void **)malloc(capacity * sizeof(void *));
+    if (!queue->items) return 0;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->producers = producers;
+    queue->max_depth = 0;
+    queue->depth_sum = 0;
+    queue->pushes = 0;
+    queue->full_waits = 0;
+    queue->empty_waits = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return 1;
+}
+
+static void destroyQueue(BoundedQueue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+}
+
+static void pushQueue(BoundedQueue *queue, void *item) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity) queue->full_waits++;
+    while (queue->count == queue->capacity)
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    if (queue->count > queue->max_depth) queue->max_depth = queue->count;
+    queue->depth_sum += queue->count;
+    queue->pushes++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *popQueue(BoundedQueue *queue) {
+    void *item = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0 && queue->producers > 0) queue->empty_waits++;
+    while (queue->count == 0 && queue->producers > 0)
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
 
-        // Apply filters
-        applyGaussianFilter(image_data, width, height);
-        applyWienerFilter(image_data, width, height);
+// Hand the queue's depth statistics to the run report
+static void reportQueue(RunReport *report, const char *name, const BoundedQueue *queue) {
+    QueueTiming timing;
+    timing.name = name;
+    timing.capacity = queue->capacity;
+    timing.max_depth = queue->max_depth;
+    timing.mean_depth = queue->pushes ? (double)queue->depth_sum / queue->pushes : 0.0;
+    timing.pushes = queue->pushes;
+    timing.full_waits = queue->full_waits;
+    timing.empty_waits = queue->empty_waits;
+    runReportQueue(report, &timing);
+}
+
+// Called by each producer when it is done; wakes consumers once all are done
+static void finishProducer(BoundedQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    if (--queue->producers == 0)
+        pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
 
-        // Save processed image to the new location
-        stbi_write_png(output_path, width, height, 1, image_data, width);
-        stbi_image_free(image_data);
+// One image travelling through the pipeline
+typedef struct {
+    int index;                    // Manifest index
+    InputImage input;             // Decoded (stbi allocated, from the pool) or mapped raw input
+    unsigned char *output_data;   // Filtered output (pool allocated)
+} PipelineItem;
 
-        // Update progress bar (with thread safety)
-        #pragma omp critical
+// Three-stage pipeline: readers decode images into decoded_queue, filter workers
+// move them to filtered_queue, writers encode and save them. Bounded queues keep
+// at most PIPELINE_QUEUE_DEPTH images waiting per stage, so decode, filtering and
+// PNG encoding of different images overlap without unbounded memory use.
+// Returns the number of images written.
+static int runPipeline(DatasetJob *job, const BackendShare *share) {
+    RunReport *report = job->report;
+    int num_readers = 0, num_workers = 0, num_writers = 0;
+    int queues_ready = 0;
+    int next_file = 0;
+    int written_images = 0;
+    BoundedQueue decoded_queue, filtered_queue;
+
+    #pragma omp parallel num_threads(share->num_threads)
+    {
+        // Split roles over the team we actually got (the runtime may give fewer threads)
+        #pragma omp single
         {
-            processed_images++;
-            printProgressBar(processed_images, total_images);
+            int team_size = omp_get_num_threads();
+            if (team_size >= PIPELINE_MIN_THREADS) {
+                num_readers = team_size / 4 > 0 ? team_size / 4 : 1;
+                num_writers = team_size / 4 > 0 ? team_size / 4 : 1;
+                num_workers = team_size - num_readers - num_writers;
+
+                if (initQueue(&decoded_queue, PIPELINE_QUEUE_DEPTH, num_readers)) {
+                    if (initQueue(&filtered_queue, PIPELINE_QUEUE_DEPTH, num_workers))
+                        queues_ready = 1;
+                    else
+                        destroyQueue(&decoded_queue);
+                }
+                if (queues_ready)
+                    printf("Pipeline: %d reader, %d filter and %d writer threads\n",
+                           num_readers, num_workers, num_writers);
+            }
+        }
+
+        int role = omp_get_thread_num();
+        int thread_id = share->first_thread + role;
+
+        if (!queues_ready) {
+            // Not enough threads or memory for a pipeline: nothing to do
+        } else if (role < num_readers) {
+            // Reader: decode images in manifest order
+            for (;;) {
+                int k;
+                #pragma omp atomic capture
+                k = next_file++;
+                if (k >= share->count) break;
+
+                int n = share->images[k];
+                char image_path[512], output_path[512];
+                datasetImagePaths(job, n, image_path, output_path);
+
+                PipelineItem *item = (PipelineItem *)calloc(1, sizeof(PipelineItem));
+                if (!item || !loadInputImage(image_path, job->wide_samples, &item->input, job->prefetch, report, n,
+                                             thread_id)) {
+                    datasetImageDone(job, n, thread_id, 0);
+                    free(item);
+                    continue;
+                }
+                item->index = n;
+                pushQueue(&decoded_queue, item);
+            }
+            finishProducer(&decoded_queue);
+        } else if (role < num_readers + num_workers) {
+            // Filter worker: whole images on this thread with private scratch buffers
+            FilterScratch scratch = {0};
+            PipelineItem *item;
+
+            while ((item = (PipelineItem *)popQueue(&decoded_queue))) {
+                InputImage *input = &item->input;
+                double filter_start = omp_get_wtime();
+                item->output_data = (unsigned char *)poolMalloc((size_t)input->width * input->height *
+                                                                pixelSize(input->dtype));
+                int filtered = 0;
+                if (item->output_data) {
+                    filtered = input->dtype == PIXEL_U8
+                        ? filterImageU8((const unsigned char *)input->pixels, item->output_data, input->width,
+                                        input->height, job->chain, &scratch, 0)
+                        : filterWideImage(input->pixels, item->output_data, input->width, input->height,
+                                          input->dtype, job->chain, 0);
+                }
+                runReportStage(report, item->index, thread_id, STAGE_FILTER, omp_get_wtime() - filter_start);
+                freeInputImage(input);
+                if (!filtered) {
+                    printf("\nOut of memory filtering %s image: %s\n", pixelTypeName(input->dtype),
+                           job->manifest->images[item->index].file_name);
+                    datasetImageDone(job, item->index, thread_id, 0);
+                    poolFree(item->output_data);
+                    free(item);
+                    continue;
+                }
+                pushQueue(&filtered_queue, item);
+            }
+            freeScratch(&scratch);
+            finishProducer(&filtered_queue);
+        } else {
+            // Writer: encode and save
+            PipelineItem *item;
+
+            while ((item = (PipelineItem *)popQueue(&filtered_queue))) {
+                char image_path[512], output_path[512];
+                datasetImagePaths(job, item->index, image_path, output_path);
+
+                int written = saveOutputImage(output_path, item->output_data, item->input.width,
+                                              item->input.height, item->input.dtype, job->output,
+                                              item->input.is_raw, report, item->index, thread_id);
+                datasetImageDone(job, item->index, thread_id, written);
+                poolFree(item->output_data);
+                free(item);
+
+                #pragma omp atomic
+                written_images += written;
+            }
+        }
+        poolReleaseThreadCache();
+    }
+
+    if (!queues_ready) {
+        printf("Could not start the pipeline\n");
+        return 0;
+    }
+    reportQueue(report, "decoded", &decoded_queue);
+    reportQueue(report, "filtered", &filtered_queue);
+    destroyQueue(&decoded_queue);
+    destroyQueue(&filtered_queue);
+    return written_images;
+}
+
+static ParallelMode openmp_mode = PARALLEL_AUTO;
+static const FilterChain *openmp_chain;
+static FilterScratch frame_scratch;
+
+static int openmpAvailable(void) {
+    return 1;
+}
+
+// Every chain runs on 8-bit frames, and on wide frames when chainFiltersWide accepts it
+static int openmpSupports(const FilterChain *chain, int verbose) {
+    (void)chain;
+    (void)verbose;
+    return 1;
+}
+
+// --mode auto|rows|images|pipeline (see ParallelMode)
+static int openmpParseOption(int argc, char **argv, int *i) {
+    static const char *const names[] = {"auto", "rows", "images", "pipeline"};
+    if (strcmp(argv[*i], "--mode") != 0) return 0;
+    if (*i + 1 >= argc) return -1;
+
+    const char *value = argv[++*i];
+    for (int m = 0; m < 4; m++) {
+        if (strcmp(value, names[m]) == 0) {
+            openmp_mode = (ParallelMode)m;
+            return 1;
         }
     }
+    printf("Unknown OpenMP mode: %s\n", value);
+    return -1;
+}
 
-    cJSON_Delete(root);
-    free(json_data);
+static int openmpPrepare(const FilterChain *chain) {
+    // Select the SIMD stencil kernels for this CPU
+    initStencilKernels();
+    printf("Stencil kernels: %s, %d OpenMP threads\n", stencil_kernels.name, omp_get_max_threads());
+    openmp_chain = chain;
+    return omp_get_max_threads();
+}
 
-    end_time = omp_get_wtime();
-    
-    printf("\nProcessing time: %.3f seconds\n", end_time - start_time);
+// A pipeline needs a few images per thread in flight to overlap its stages
+static int openmpGrain(void) {
+    int threads = omp_get_max_threads();
+    return openmp_mode == PARALLEL_PIPELINE ? 2 * threads : threads;
 }
 
-int main() {
-    printf("Starting parallelized model training...\n");
+static int openmpRun(DatasetJob *job, BackendShare *share) {
+    int num_threads = share->num_threads;
+    int written_images = 0;
 
-    // Set number of OpenMP threads (optional, can also be controlled by environment variable OMP_NUM_THREADS)
-    // Uncomment and adjust if you want to specify a specific number of threads
-    // omp_set_num_threads(4);
+    // PARALLEL_AUTO picks per-image or per-row parallelism; PARALLEL_PIPELINE overlaps
+    // decoding, filtering and PNG encoding of different images
+    ParallelMode mode = openmp_mode;
+    if (mode == PARALLEL_AUTO)
+        mode = share->count >= num_threads ? PARALLEL_IMAGES : PARALLEL_ROWS;
+    if (mode == PARALLEL_PIPELINE && num_threads < PIPELINE_MIN_THREADS)
+        mode = PARALLEL_IMAGES;
+    // Announced on the first call only when the images come in chunks
+    if (!share->mode[0])
+        printf("Processing with %d OpenMP threads (%s)\n", num_threads,
+               mode == PARALLEL_PIPELINE ? "decode/filter/encode pipeline" :
+               mode == PARALLEL_IMAGES ? "one image per thread" : "rows split across threads");
+    share->mode = mode == PARALLEL_PIPELINE ? "pipeline" : mode == PARALLEL_IMAGES ? "images" : "rows";
 
-    processDataset("C:/Users/V Abhiram/Desktop/IT301M/project/SARscope/test/_annotations.coco.json", 
-                   "C:/Users/V Abhiram/Desktop/IT301M/project/SARscope/test",
-                   "C:/Users/V Abhiram/Desktop/IT301M/project/SARscope/test/processed_images");
+    if (mode == PARALLEL_PIPELINE) {
+        written_images = runPipeline(job, share);
+    } else if (mode == PARALLEL_IMAGES) {
+        // Each worker decodes, filters and encodes whole images with its own scratch buffers.
+        // Dynamic scheduling absorbs the uneven cost of file I/O and compression.
+        #pragma omp parallel num_threads(num_threads)
+        {
+            FilterScratch scratch = {0};
+            int thread_id = share->first_thread + omp_get_thread_num();
+
+            #pragma omp for schedule(dynamic, 1) reduction(+:written_images)
+            for (int k = 0; k < share->count; k++) {
+                int n = share->images[k];
+                int written = processImage(job, n, &scratch, 0, thread_id);
+                datasetImageDone(job, n, thread_id, written);
+                written_images += written;
+            }
+            freeScratch(&scratch);
+            poolReleaseThreadCache();
+        }
+    } else {
+        // One image at a time; the filters parallelize over rows internally
+        FilterScratch scratch = {0};
+
+        for (int k = 0; k < share->count; k++) {
+            int n = share->images[k];
+            int written = processImage(job, n, &scratch, 1, share->first_thread);
+            datasetImageDone(job, n, share->first_thread, written);
+            written_images += written;
+        }
+        freeScratch(&scratch);
+    }
+    return written_images;
+}
+
+// One frame, rows split across the threads, in the filters processImage uses
+static int openmpFilterFrame(const void *src, void *dst, int width, int height, int dtype) {
+    if (dtype == PIXEL_U8)
+        return filterImageU8((const unsigned char *)src, (unsigned char *)dst, width, height, openmp_chain,
+                             &frame_scratch, 1);
+    return filterWideImage(src, dst, width, height, dtype, openmp_chain, 1);
+}
+
+static void openmpRelease(void) {
+    freeScratch(&frame_scratch);
+    openmp_chain = NULL;
+}
 
-    printf("\nTraining complete.\n");
-    return 0;
-}
\ No newline at end of file
+const FilterBackend openmp_backend = {
+    "openmp",
+    "[--mode auto|rows|images|pipeline]",
+    1,
+    openmpAvailable,
+    openmpSupports,
+    openmpParseOption,
+    openmpPrepare,
+    openmpGrain,
+    openmpRun,
+    openmpFilterFrame,
+    openmpRelease,
+};
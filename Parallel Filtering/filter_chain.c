@@ -0,0 +1,299 @@
+#include "filter_chain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_CHAIN_SPEC 4096
+
+static const FilterStage default_stages[] = {
+    { FILTER_GAUSSIAN, 5, 1.5, 0.0, BORDER_KEEP, 0.0, 0.0, 0.0 },
+    { FILTER_BOX, 5, 0.0, 0.0, BORDER_KEEP, 0.0, 0.0, 0.0 },
+};
+
+void defaultFilterChain(FilterChain *chain) {
+    memset(chain, 0, sizeof(*chain));
+    chain->count = 2;
+    memcpy(chain->stages, default_stages, sizeof(default_stages));
+}
+
+int isDefaultFilterChain(const FilterChain *chain) {
+    if (chain->count != 2) return 0;
+    for (int i = 0; i < 2; i++) {
+        const FilterStage *stage = &chain->stages[i], *expected = &default_stages[i];
+        if (stage->kind != expected->kind || stage->size != expected->size) return 0;
+        if (stage->kind == FILTER_GAUSSIAN && stage->sigma != expected->sigma) return 0;
+        if (stage->border != BORDER_KEEP) return 0;
+    }
+    return 1;
+}
+
+int sameFilterChain(const FilterChain *a, const FilterChain *b) {
+    if (a->count != b->count) return 0;
+    for (int i = 0; i < a->count; i++) {
+        const FilterStage *x = &a->stages[i], *y = &b->stages[i];
+        if (x->kind != y->kind || x->size != y->size || x->sigma != y->sigma || x->noise != y->noise ||
+            x->border != y->border || x->fill != y->fill || x->looks != y->looks || x->damping != y->damping)
+            return 0;
+    }
+    return 1;
+}
+
+const char *filterKindName(FilterKind kind) {
+    switch (kind) {
+        case FILTER_GAUSSIAN: return "gaussian";
+        case FILTER_BOX: return "wiener";
+        case FILTER_ADAPTIVE_WIENER: return "adaptive-wiener";
+        case FILTER_LEE: return "lee";
+        case FILTER_ENHANCED_LEE: return "enhanced-lee";
+        case FILTER_FROST: return "frost";
+        case FILTER_MEDIAN: return "median";
+        default: return "unknown";
+    }
+}
+
+int usesLocalStatistics(FilterKind kind) {
+    return kind == FILTER_ADAPTIVE_WIENER || kind == FILTER_LEE || kind == FILTER_ENHANCED_LEE ||
+           kind == FILTER_FROST;
+}
+
+static int takesLooks(FilterKind kind) {
+    return kind == FILTER_LEE || kind == FILTER_ENHANCED_LEE;
+}
+
+static int takesDamping(FilterKind kind) {
+    return kind == FILTER_ENHANCED_LEE || kind == FILTER_FROST;
+}
+
+static const char *const border_names[] = {"keep", "replicate", "reflect", "constant"};
+
+const char *borderModeName(BorderMode mode) {
+    return mode >= BORDER_KEEP && mode <= BORDER_CONSTANT ? border_names[mode] : "unknown";
+}
+
+static int parseBorderMode(const char *name, BorderMode *mode) {
+    for (int m = BORDER_KEEP; m <= BORDER_CONSTANT; m++) {
+        if (strcmp(name, border_names[m]) == 0) {
+            *mode = (BorderMode)m;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Parse one stage, "name[:key=value...]", modifying text in place
+static int parseStage(char *text, FilterStage *stage) {
+    char *name = strtok(text, ":");
+    if (!name) return -1;
+
+    memset(stage, 0, sizeof(*stage));
+    stage->size = 5;
+    if (strcmp(name, "gaussian") == 0) {
+        stage->kind = FILTER_GAUSSIAN;
+        stage->sigma = 1.5;
+    } else if (strcmp(name, "wiener") == 0 || strcmp(name, "box") == 0) {
+        stage->kind = FILTER_BOX;
+    } else if (strcmp(name, "adaptive-wiener") == 0) {
+        stage->kind = FILTER_ADAPTIVE_WIENER;
+        stage->noise = -1.0;
+    } else if (strcmp(name, "lee") == 0) {
+        stage->kind = FILTER_LEE;
+    } else if (strcmp(name, "enhanced-lee") == 0) {
+        stage->kind = FILTER_ENHANCED_LEE;
+    } else if (strcmp(name, "frost") == 0) {
+        stage->kind = FILTER_FROST;
+    } else if (strcmp(name, "median") == 0) {
+        stage->kind = FILTER_MEDIAN;
+    } else {
+        printf("Unknown filter: %s\n", name);
+        return -1;
+    }
+    stage->looks = takesLooks(stage->kind) ? 1.0 : 0.0;
+    stage->damping = takesDamping(stage->kind) ? 1.0 : 0.0;
+
+    char *param;
+    while ((param = strtok(NULL, ":"))) {
+        char *value = strchr(param, '=');
+        char *end;
+        if (!value) {
+            printf("Filter parameter without a value: %s\n", param);
+            return -1;
+        }
+        *value++ = '\0';
+
+        if (strcmp(param, "border") == 0) {
+            if (parseBorderMode(value, &stage->border) != 0) {
+                printf("Unknown border mode (keep, replicate, reflect or constant): %s\n", value);
+                return -1;
+            }
+            continue;
+        }
+        double number = strtod(value, &end);
+        if (end == value || *end != '\0') {
+            printf("Invalid value for %s: %s\n", param, value);
+            return -1;
+        }
+        if (strcmp(param, "size") == 0) {
+            stage->size = (int)number;
+            if (stage->size != number || stage->size < 1 || stage->size > MAX_FILTER_SIZE || stage->size % 2 == 0) {
+                printf("%s size must be odd and at most %d: %s\n", name, MAX_FILTER_SIZE, value);
+                return -1;
+            }
+        } else if (strcmp(param, "sigma") == 0 && stage->kind == FILTER_GAUSSIAN) {
+            if (number <= 0) {
+                printf("gaussian sigma must be positive: %s\n", value);
+                return -1;
+            }
+            stage->sigma = number;
+        } else if (strcmp(param, "noise") == 0 && stage->kind == FILTER_ADAPTIVE_WIENER) {
+            stage->noise = number;
+        } else if (strcmp(param, "looks") == 0 && takesLooks(stage->kind)) {
+            if (number <= 0) {
+                printf("%s looks must be positive: %s\n", name, value);
+                return -1;
+            }
+            stage->looks = number;
+        } else if (strcmp(param, "damping") == 0 && takesDamping(stage->kind)) {
+            if (number < 0) {
+                printf("%s damping must not be negative: %s\n", name, value);
+                return -1;
+            }
+            stage->damping = number;
+        } else if (strcmp(param, "fill") == 0) {
+            stage->fill = number;
+        } else {
+            printf("Unknown %s parameter: %s\n", name, param);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) text++;
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) *--end = '\0';
+    return text;
+}
+
+int parseFilterChain(const char *spec, FilterChain *chain) {
+    char buffer[MAX_CHAIN_SPEC];
+    if (strlen(spec) >= sizeof(buffer)) {
+        printf("Filter chain too long\n");
+        return -1;
+    }
+    strcpy(buffer, spec);
+
+    FilterChain parsed;
+    memset(&parsed, 0, sizeof(parsed));
+
+    // Stages are split first, since parseStage tokenizes each one in turn
+    char *stages[MAX_CHAIN_STAGES + 1];
+    int count = 0;
+    for (char *p = buffer, *next; p; p = next) {
+        next = strpbrk(p, ",\n");
+        if (next) *next++ = '\0';
+        char *comment = strchr(p, '#');
+        if (comment) *comment = '\0';
+        p = trim(p);
+        if (*p == '\0') continue;
+        if (count == MAX_CHAIN_STAGES) {
+            printf("Filter chain has more than %d stages\n", MAX_CHAIN_STAGES);
+            return -1;
+        }
+        stages[count++] = p;
+    }
+    if (count == 0) {
+        printf("Filter chain is empty\n");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (parseStage(stages[i], &parsed.stages[i]) != 0) return -1;
+    }
+    parsed.count = count;
+    *chain = parsed;
+    return 0;
+}
+
+int loadFilterChain(const char *path, FilterChain *chain) {
+    char buffer[MAX_CHAIN_SPEC];
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Could not open filter chain file: %s\n", path);
+        return -1;
+    }
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    int too_long = !feof(file);
+    fclose(file);
+    if (too_long) {
+        printf("Filter chain file too long: %s\n", path);
+        return -1;
+    }
+    buffer[length] = '\0';
+
+    // Comments run to the end of the line, so they are cut before lines are joined
+    for (char *p = buffer; (p = strchr(p, '#'));) {
+        while (*p && *p != '\n') *p++ = ' ';
+    }
+    return parseFilterChain(buffer, chain);
+}
+
+int parseChainOption(int argc, char **argv, int *i, FilterChain *chain) {
+    int is_file = strcmp(argv[*i], "--chain-file") == 0;
+    if (!is_file && strcmp(argv[*i], "--chain") != 0) return 0;
+    if (*i + 1 >= argc) return -1;
+
+    const char *value = argv[++*i];
+    return (is_file ? loadFilterChain(value, chain) : parseFilterChain(value, chain)) == 0 ? 1 : -1;
+}
+
+void formatFilterChain(const FilterChain *chain, char *buffer, int size) {
+    int used = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < chain->count && used < size; i++) {
+        const FilterStage *stage = &chain->stages[i];
+        used += snprintf(buffer + used, size - used, "%s%s:size=%d", i ? "," : "",
+                         filterKindName(stage->kind), stage->size);
+        if (used >= size) break;
+        if (stage->kind == FILTER_GAUSSIAN)
+            used += snprintf(buffer + used, size - used, ":sigma=%g", stage->sigma);
+        else if (stage->kind == FILTER_ADAPTIVE_WIENER)
+            used += snprintf(buffer + used, size - used, ":noise=%g", stage->noise);
+        if (used < size && takesLooks(stage->kind))
+            used += snprintf(buffer + used, size - used, ":looks=%g", stage->looks);
+        if (used < size && takesDamping(stage->kind))
+            used += snprintf(buffer + used, size - used, ":damping=%g", stage->damping);
+        // keep stages are written as before, so saved journals still match
+        if (used < size && stage->border != BORDER_KEEP)
+            used += snprintf(buffer + used, size - used, ":border=%s", borderModeName(stage->border));
+        if (used < size && stage->border == BORDER_CONSTANT)
+            used += snprintf(buffer + used, size - used, ":fill=%g", stage->fill);
+    }
+}
+
+int chainFusesAt(const FilterChain *chain, int i) {
+    return i + 1 < chain->count && chain->stages[i].kind == FILTER_GAUSSIAN &&
+           chain->stages[i + 1].kind == FILTER_BOX;
+}
+
+int chainFiltersWide(const FilterChain *chain) {
+    for (int i = 0; i < chain->count; i++)
+        if (chain->stages[i].kind != FILTER_GAUSSIAN && chain->stages[i].kind != FILTER_BOX) return 0;
+    return 1;
+}
+
+int chainPassCount(const FilterChain *chain) {
+    int passes = 0;
+    for (int i = 0; i < chain->count; i++, passes++) {
+        if (chainFusesAt(chain, i)) i++;
+    }
+    return passes;
+}
+
+int chainHaloRows(const FilterChain *chain) {
+    int rows = 0;
+    for (int i = 0; i < chain->count; i++) rows += chain->stages[i].size / 2;
+    return rows;
+}
@@ -0,0 +1,190 @@
+#ifndef FILTER_CHAIN_H
+#define FILTER_CHAIN_H
+
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ordered list of filter stages, given on the command line or in a file, run
+// by whichever backend the binary implements. A chain is written as stages
+// separated by commas (or newlines in a file, where # starts a comment), each
+// a filter name followed by :key=value parameters:
+//
+//   gaussian:size=5:sigma=1.5,wiener:size=5
+//
+//   gaussian         size (odd, default 5), sigma (default 1.5)
+//   wiener / box     size (odd, default 5): the box-mean Wiener approximation
+//   adaptive-wiener  size (odd, default 5), noise (default -1 = estimate per image)
+//   lee              size (odd, default 5), looks (default 1): Lee's speckle filter
+//   enhanced-lee     size (odd, default 5), looks (default 1), damping (default 1)
+//   frost            size (odd, default 5), damping (default 1)
+//   median           size (odd, default 5)
+//
+// looks is the equivalent number of looks of the speckle, whose coefficient of
+// variation is then sqrt(1 / looks). The adaptive Wiener, Lee and Frost
+// filters work from the local mean and variance of each window (see
+// localStatisticsValue and frostCoefficient), the median from its histogram.
+//
+// Every stage also takes border=keep|replicate|reflect|constant, how its window
+// is completed where it runs off the image, and fill (default 0), the value of
+// the samples outside the image for border=constant (clamped to the sample
+// range). keep, the default, leaves the pixels the window does not fit around
+// as they come in (the adaptive Wiener, Lee and Frost filters shrink their
+// window to the image instead); the other modes filter every pixel. Every
+// backend handles the modes the same way, inside its kernels.
+//
+// Backends fuse a Gaussian directly followed by a box mean into a single pass
+// (see chainFusesAt); every other stage runs on its own.
+
+#define MAX_CHAIN_STAGES 16
+#define MAX_FILTER_SIZE 31   // Largest window or kernel size of any stage
+#define FILTER_CHAIN_OPTIONS "[--chain SPEC] [--chain-file FILE]"
+
+typedef enum {
+    FILTER_GAUSSIAN,
+    FILTER_BOX,              // Box mean, called "wiener" throughout this project
+    FILTER_ADAPTIVE_WIENER,  // Local-statistics Wiener (MATLAB wiener2)
+    FILTER_LEE,              // Lee's minimum mean square error speckle filter
+    FILTER_ENHANCED_LEE,     // Lopes' enhanced Lee: smooths less on edges and point targets
+    FILTER_FROST,            // Exponentially weighted window, narrower where the window varies
+    FILTER_MEDIAN
+} FilterKind;
+
+typedef enum {
+    BORDER_KEEP,        // Pixels the window does not fit around are not filtered
+    BORDER_REPLICATE,   // The edge sample repeats: a a | a b c
+    BORDER_REFLECT,     // Mirrored about the edge sample: c b | a b c
+    BORDER_CONSTANT     // Samples outside the image are FilterStage.fill
+} BorderMode;
+
+typedef struct {
+    FilterKind kind;
+    int size;       // Kernel or window size (odd)
+    double sigma;   // Gaussian only
+    double noise;   // Adaptive Wiener noise variance; negative = estimate per image
+    BorderMode border;
+    double fill;    // BORDER_CONSTANT only
+    double looks;   // Lee and enhanced Lee: equivalent number of looks
+    double damping; // Enhanced Lee and Frost
+} FilterStage;
+
+typedef struct {
+    FilterStage stages[MAX_CHAIN_STAGES];
+    int count;
+} FilterChain;
+
+// The chain every binary ran before chains were configurable: 5x5 Gaussian
+// (sigma 1.5) then the 5x5 box mean
+void defaultFilterChain(FilterChain *chain);
+int isDefaultFilterChain(const FilterChain *chain);
+
+// 1 if both chains run the same stages with the same parameters
+int sameFilterChain(const FilterChain *a, const FilterChain *b);
+
+// Parse a chain spec. Returns 0 on success; errors are reported on stdout.
+int parseFilterChain(const char *spec, FilterChain *chain);
+
+// Read a chain from a file (one or more stages per line). Returns 0 on success.
+int loadFilterChain(const char *path, FilterChain *chain);
+
+// Parse --chain SPEC or --chain-file FILE at argv[*i], advancing *i past its argument.
+// Returns 1 if it was a chain option, 0 if not, -1 if it is invalid.
+int parseChainOption(int argc, char **argv, int *i, FilterChain *chain);
+
+// Write the chain back in spec form
+void formatFilterChain(const FilterChain *chain, char *buffer, int size);
+
+const char *filterKindName(FilterKind kind);
+const char *borderModeName(BorderMode mode);
+
+// 1 if stage i is a Gaussian followed by a box mean, which run as one fused pass
+int chainFusesAt(const FilterChain *chain, int i);
+
+// 1 if every stage has a u16/f32 implementation (Gaussian and box), so that wide
+// images keep their samples. Backends decode the images of any other chain to
+// 8 bits, like the serial reference, and skip wide raw files.
+int chainFiltersWide(const FilterChain *chain);
+
+// Number of passes over the image once fusable pairs are merged
+int chainPassCount(const FilterChain *chain);
+
+// Rows above and below a band the chain reads to filter the band exactly: the sum of the stage radii
+int chainHaloRows(const FilterChain *chain);
+
+// 1 for the stages that filter from the local mean and variance of each window
+int usesLocalStatistics(FilterKind kind);
+
+#ifdef __CUDACC__
+#define CHAIN_FUNCTION __host__ __device__ static inline
+#else
+#define CHAIN_FUNCTION static inline
+#endif
+
+// Where sample i of a row or column of n samples comes from when a window runs
+// off the edge: i itself inside [0, n), otherwise the edge sample (replicate),
+// the sample mirrored about the edge (reflect, repeated for windows wider than
+// the image) or -1 for the fill value (constant). Keep stages never ask.
+CHAIN_FUNCTION int borderIndex(int i, int n, int mode) {
+    if (i >= 0 && i < n) return i;
+    if (mode == BORDER_CONSTANT) return -1;
+    if (mode == BORDER_REFLECT) {
+        if (n == 1) return 0;
+        int period = 2 * n - 2;
+        i %= period;
+        if (i < 0) i += period;
+        return i < n ? i : period - i;
+    }
+    return i < 0 ? 0 : n - 1;
+}
+
+// Filtered value (before rounding) of sample x, whose window has the given mean
+// and variance, for the adaptive Wiener (with noise variance noise), Lee and
+// enhanced Lee stages. Lee blends the mean and x by 1 - Cu^2 / Ci^2, where Ci
+// is the window's coefficient of variation and Cu the speckle's; enhanced Lee
+// takes the mean where Ci <= Cu, keeps x where Ci >= sqrt(1 + 2 / looks) and
+// blends by exp(-damping (Ci - Cu) / (Cmax - Ci)) in between.
+CHAIN_FUNCTION double localStatisticsValue(const FilterStage *stage, double noise, double x, double mean,
+                                           double variance) {
+    if (stage->kind == FILTER_ADAPTIVE_WIENER) {
+        double value = mean;
+        double denominator = variance > noise ? variance : noise;
+        if (denominator > 0) value += (variance > noise ? variance - noise : 0) / denominator * (x - mean);
+        return value;
+    }
+    if (mean <= 0) return mean;
+
+    double cu2 = 1.0 / stage->looks;
+    double ci2 = variance / (mean * mean);
+    if (stage->kind == FILTER_LEE) return ci2 > cu2 ? mean + (1.0 - cu2 / ci2) * (x - mean) : mean;
+
+    double cu = sqrt(cu2), ci = sqrt(ci2), cmax = sqrt(1.0 + 2.0 * cu2);
+    if (ci <= cu) return mean;
+    if (ci >= cmax) return x;
+    double weight = exp(-stage->damping * (ci - cu) / (cmax - ci));
+    return mean * weight + x * (1.0 - weight);
+}
+
+// Frost's decay per unit of distance for a window of the given mean and
+// variance: damping * Ci^2. The window sample at (k, l) from the centre weighs
+// exp(-coefficient * (|k| + |l|)); the filtered value is the weighted mean.
+CHAIN_FUNCTION double frostCoefficient(const FilterStage *stage, double mean, double variance) {
+    return mean > 0 ? stage->damping * variance / (mean * mean) : 0.0;
+}
+
+#define FROST_MAX_DECAY 700.0  // Weights below exp(-700) are 0 rather than subnormal (and slow)
+
+// Frost weights by distance |k| + |l| from the centre, for distances up to 2 * radius
+CHAIN_FUNCTION void frostWeights(double coefficient, int radius, double *weights) {
+    double decay = coefficient < FROST_MAX_DECAY ? exp(-coefficient) : 0.0;
+    weights[0] = 1.0;
+    for (int d = 1; d <= 2 * radius; d++)
+        weights[d] = coefficient * d < FROST_MAX_DECAY ? weights[d - 1] * decay : 0.0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
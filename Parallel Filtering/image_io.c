@@ -0,0 +1,143 @@
+#include "image_io.h"
+#include "buffer_pool.h"
+#include "codec.h"
+
+#define STBI_MALLOC(sz) poolMalloc(sz)
+#define STBI_REALLOC(p, newsz) poolRealloc(p, newsz)
+#define STBI_FREE(p) poolFree(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STBIW_MALLOC(sz) poolMalloc(sz)
+#define STBIW_REALLOC(p, newsz) poolRealloc(p, newsz)
+#define STBIW_FREE(p) poolFree(p)
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#define STBIR_MALLOC(size, user_data) ((void)(user_data), poolMalloc(size))
+#define STBIR_FREE(ptr, user_data) ((void)(user_data), poolFree(ptr))
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize2.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decode an image file read into memory to grayscale with the first codec that
+// takes it (codec.h): 16-bit for 16-bit PNGs when wide is set, 8-bit otherwise.
+// Frees file_data.
+static void *decodeImage(unsigned char *file_data, size_t size, int wide, InputImage *input, RunReport *report,
+                         int image, int thread) {
+    double start_time = wallClockSeconds();
+    void *pixels = decodeGray(file_data, size, wide, &input->width, &input->height, &input->dtype);
+    free(file_data);
+    runReportStage(report, image, thread, STAGE_DECODE, wallClockSeconds() - start_time);
+    return pixels;
+}
+
+int loadInputImage(const char *image_path, int wide, InputImage *input, Prefetcher *prefetch, RunReport *report,
+                   int image, int thread) {
+    char raw_path[512];
+    size_t size;
+    memset(input, 0, sizeof(*input));
+    snprintf(raw_path, sizeof(raw_path), "%s%s", image_path, SAR_RAW_EXTENSION);
+
+    // The prefetcher only reads files ahead that have no raw copy
+    unsigned char *file_data = prefetch ? prefetchTake(prefetch, image, &size, report, thread) : NULL;
+    if (file_data) {
+        input->pixels = decodeImage(file_data, size, wide, input, report, image, thread);
+        if (!input->pixels) printf("\nCould not read image: %s\n", image_path);
+        return input->pixels != NULL;
+    }
+
+    // A converted raw copy (sar_convert) is mapped instead of decoded
+    double start_time = wallClockSeconds();
+    int raw_status = sarRawOpen(raw_path, &input->raw);
+    if (raw_status == SAR_RAW_ERROR) return 0;
+
+    if (raw_status == SAR_RAW_OK) {
+        if (!wide && input->raw.dtype != PIXEL_U8) {
+            printf("\nSkipping %s image: %s\n", pixelTypeName(input->raw.dtype), raw_path);
+            sarRawClose(&input->raw);
+            return 0;
+        }
+        input->is_raw = 1;
+        input->pixels = input->raw.pixels;
+        input->width = input->raw.width;
+        input->height = input->raw.height;
+        input->dtype = input->raw.dtype;
+        runReportStage(report, image, thread, STAGE_READ, wallClockSeconds() - start_time);
+        runReportBytes(report, image, thread, (size_t)input->width * input->height * pixelSize(input->dtype), 0);
+        return 1;
+    }
+
+    file_data = readFileTimed(report, image, thread, image_path, &size);
+    input->pixels = file_data ? decodeImage(file_data, size, wide, input, report, image, thread) : NULL;
+    if (!input->pixels) {
+        printf("\nCould not read image: %s\n", image_path);
+        return 0;
+    }
+    return 1;
+}
+
+void freeInputImage(InputImage *input) {
+    if (input->is_raw) sarRawClose(&input->raw);
+    else stbi_image_free(input->pixels);
+    input->pixels = NULL;
+}
+
+void *resizeOutputImage(const void *pixels, int width, int height, int dtype, const OutputOptions *output,
+                        int threads, int *out_width, int *out_height, RunReport *report, int image, int thread) {
+    static const stbir_datatype datatypes[] = {STBIR_TYPE_UINT8, STBIR_TYPE_UINT16, STBIR_TYPE_FLOAT};
+    STBIR_RESIZE resize;
+    double start_time = wallClockSeconds();
+
+    outputSize(output, width, height, out_width, out_height);
+    void *resized = poolMalloc((size_t)*out_width * *out_height * pixelSize(dtype));
+    if (!resized) return NULL;
+
+    // SAR samples are linear intensities, so 8-bit ones are not treated as sRGB
+    stbir_resize_init(&resize, pixels, width, height, 0, resized, *out_width, *out_height, 0, STBIR_1CHANNEL,
+                      datatypes[dtype - PIXEL_U8]);
+    int ok;
+    if (threads > 1) {
+        int splits = stbir_build_samplers_with_splits(&resize, threads);
+        ok = splits > 0;
+        #pragma omp parallel for num_threads(splits) reduction(&&:ok) if(splits > 1)
+        for (int s = 0; s < splits; s++) ok = stbir_resize_extended_split(&resize, s, 1) && ok;
+        stbir_free_samplers(&resize);
+    } else {
+        ok = stbir_resize_extended(&resize);
+    }
+    runReportStage(report, image, thread, STAGE_RESIZE, wallClockSeconds() - start_time);
+    if (!ok) {
+        poolFree(resized);
+        return NULL;
+    }
+    return resized;
+}
+
+int saveOutputImage(const char *output_path, const void *pixels, int width, int height, int dtype,
+                    const OutputOptions *output, int raw_input, RunReport *report, int image, int thread) {
+    size_t bytes_written = 0;
+    int out_width, out_height;
+    void *resized = NULL;
+
+    if (outputSize(output, width, height, &out_width, &out_height)) {
+        resized = resizeOutputImage(pixels, width, height, dtype, output, 1, &out_width, &out_height, report,
+                                    image, thread);
+        if (!resized) {
+            printf("\nOut of memory resizing image: %s\n", output_path);
+            return 0;
+        }
+        pixels = resized;
+    }
+
+    double start_time = wallClockSeconds();
+    int written = writeOutputImage(output_path, pixels, out_width, out_height, dtype, output, raw_input,
+                                   &bytes_written);
+    runReportStage(report, image, thread, STAGE_ENCODE, wallClockSeconds() - start_time);
+    runReportBytes(report, image, thread, 0, bytes_written);
+    poolFree(resized);
+    return written;
+}
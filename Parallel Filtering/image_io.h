@@ -0,0 +1,55 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "sar_raw.h"
+#include "output_format.h"
+#include "run_report.h"
+#include "prefetch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Loading and saving dataset images for every backend. This is also the one
+// place the stb implementations are compiled, with their allocations routed
+// through the buffer pool, so decoded frames are recycled between images.
+
+typedef struct {
+    void *pixels;       // Row-major width*height samples of dtype
+    int width;
+    int height;
+    int dtype;          // PixelType
+    int is_raw;         // Mapped from a converted raw copy (selects the "auto" output format)
+    SarRawImage raw;
+} InputImage;
+
+// Load the image at image_path. A converted raw copy (image_path followed by
+// SAR_RAW_EXTENSION) is mapped when it exists; otherwise the file is read
+// whole and decoded to grayscale, so I/O and decoding are timed as separate
+// stages of image in report. With a prefetcher (NULL for none) a file it has
+// read ahead is decoded from memory instead. 16-bit PNGs and wide raw files
+// keep their samples when wide is set; without it 16-bit PNGs are decoded to
+// 8 bits and wide raw files are skipped. Returns 1 on success; failures are
+// reported on stdout.
+int loadInputImage(const char *image_path, int wide, InputImage *input, Prefetcher *prefetch, RunReport *report,
+                   int image, int thread);
+void freeInputImage(InputImage *input);
+
+// Scale a filtered image to the output size of output (outputSize) with
+// stb_image_resize2, split across threads OpenMP threads, recording it as the
+// resize stage of image. Returns the scaled image (free with poolFree) and its
+// size, or NULL if out of memory.
+void *resizeOutputImage(const void *pixels, int width, int height, int dtype, const OutputOptions *output,
+                        int threads, int *out_width, int *out_height, RunReport *report, int image, int thread);
+
+// Encode and save one image (see writeOutputImage), recording it as the
+// encode stage of image. An image that is not at the output size yet is
+// scaled to it first, by the calling thread. Returns 1 if the image was written.
+int saveOutputImage(const char *output_path, const void *pixels, int width, int height, int dtype,
+                    const OutputOptions *output, int raw_input, RunReport *report, int image, int thread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
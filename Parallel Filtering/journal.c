@@ -0,0 +1,283 @@
+#include "journal.h"
+#include "sar_raw.h"
+#include "cluster.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#define JOURNAL_HEADER "# sar_filter journal v1\n"
+#define HASH_BUFFER_SIZE (64 * 1024)
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// Stat that reports 64-bit sizes on Windows too
+#ifdef _WIN32
+typedef struct _stati64 FileStat;
+#define statFile _stati64
+#else
+typedef struct stat FileStat;
+#define statFile stat
+#endif
+
+// 64-bit FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * FNV_PRIME;
+    return hash;
+}
+
+int parseJournalMode(const char *name, JournalMode *mode) {
+    if (strcmp(name, "mtime") == 0) *mode = JOURNAL_MTIME;
+    else if (strcmp(name, "hash") == 0) *mode = JOURNAL_HASH;
+    else return -1;
+    return 0;
+}
+
+const char *journalModeName(JournalMode mode) {
+    switch (mode) {
+        case JOURNAL_MTIME: return "mtime";
+        case JOURNAL_HASH: return "hash";
+        default: return "off";
+    }
+}
+
+uint64_t journalSettings(const FilterChain *chain, const OutputOptions *output, int wide_samples) {
+    char text[1024];
+    int used = snprintf(text, sizeof(text), "%s png:%d %s", outputFormatName(output), pngLevel(output),
+                        wide_samples ? "wide " : "");
+    if (output->resize_width || output->resize_height)
+        used += snprintf(text + used, sizeof(text) - used, "resize:%dx%d ", output->resize_width,
+                         output->resize_height);
+    if (used > 0 && used < (int)sizeof(text)) formatFilterChain(chain, text + used, sizeof(text) - used);
+    return hashBytes(FNV_OFFSET, text, strlen(text));
+}
+
+static uint64_t hashFile(const char *path) {
+    unsigned char *buffer = (unsigned char *)malloc(HASH_BUFFER_SIZE);
+    FILE *file = buffer ? fopen(path, "rb") : NULL;
+    uint64_t hash = FNV_OFFSET;
+    size_t length;
+
+    if (!file) {
+        free(buffer);
+        return 0;
+    }
+    while ((length = fread(buffer, 1, HASH_BUFFER_SIZE, file)) > 0) hash = hashBytes(hash, buffer, length);
+    fclose(file);
+    free(buffer);
+    return hash;
+}
+
+// Key of the file processDataset would load for image: its raw copy if there is one
+static void inputKey(JournalMode mode, const char *image_dir, const char *file_name, JournalEntry *key) {
+    char path[512];
+    FileStat file_stat;
+
+    snprintf(path, sizeof(path), "%s/%s%s", image_dir, file_name, SAR_RAW_EXTENSION);
+    if (statFile(path, &file_stat) != 0) {
+        snprintf(path, sizeof(path), "%s/%s", image_dir, file_name);
+        if (statFile(path, &file_stat) != 0) {
+            key->input_size = (uint64_t)-1;
+            return;
+        }
+    }
+    key->input_size = (uint64_t)file_stat.st_size;
+    key->input_mtime = (int64_t)file_stat.st_mtime;
+    key->input_hash = mode == JOURNAL_HASH ? hashFile(path) : 0;
+}
+
+// The output may carry the extension of any format writeOutputImage falls back to
+static int outputExists(const char *output_dir, const char *file_name, uint64_t size) {
+    static const char *const extensions[] = {"", ".pgm", SAR_RAW_EXTENSION};
+    char path[512];
+    FileStat file_stat;
+
+    for (int e = 0; e < 3; e++) {
+        snprintf(path, sizeof(path), "%s/%s%s", output_dir, file_name, extensions[e]);
+        if (statFile(path, &file_stat) == 0 && (uint64_t)file_stat.st_size == size) return 1;
+    }
+    return 0;
+}
+
+static int entryIsCurrent(const Journal *journal, const JournalEntry *recorded, const JournalEntry *current) {
+    if (recorded->settings != journal->settings || current->input_size == (uint64_t)-1) return 0;
+    if (recorded->input_size != current->input_size) return 0;
+    if (journal->mode == JOURNAL_HASH) return recorded->input_hash != 0 && recorded->input_hash == current->input_hash;
+    return recorded->input_mtime == current->input_mtime;
+}
+
+static void writeEntry(FILE *file, const JournalEntry *entry, const char *file_name) {
+    fprintf(file, "%016" PRIx64 " %" PRIu64 " %" PRId64 " %016" PRIx64 " %" PRIu64 "\t%s\n", entry->settings,
+            entry->input_size, entry->input_mtime, entry->input_hash, entry->output_size, file_name);
+}
+
+// Manifest index of file_name through an open-addressing table of the manifest's names, or -1
+static int findImage(const Manifest *manifest, const int *table, int table_size, const char *file_name) {
+    uint64_t slot = hashBytes(FNV_OFFSET, file_name, strlen(file_name)) % table_size;
+    for (; table[slot] >= 0; slot = (slot + 1) % table_size)
+        if (strcmp(manifest->images[table[slot]].file_name, file_name) == 0) return table[slot];
+    return -1;
+}
+
+// Read the journal's lines into recorded[], by manifest image. Returns the
+// number of lines matched, or -1 if there is no such journal.
+static int readJournal(const char *path, const Manifest *manifest, JournalEntry *recorded, unsigned char *found) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    int table_size = 2 * manifest->count + 1;
+    int *table = (int *)malloc(table_size * sizeof(int));
+    char line[1024];
+    int matched = 0;
+    if (!table) {
+        fclose(file);
+        return 0;
+    }
+    for (int s = 0; s < table_size; s++) table[s] = -1;
+    for (int n = 0; n < manifest->count; n++) {
+        const char *name = manifest->images[n].file_name;
+        uint64_t slot = hashBytes(FNV_OFFSET, name, strlen(name)) % table_size;
+        while (table[slot] >= 0) slot = (slot + 1) % table_size;
+        table[slot] = n;
+    }
+
+    // Later lines win; lines cut short by a crash do not parse and are dropped
+    while (fgets(line, sizeof(line), file)) {
+        JournalEntry entry;
+        char *name = strchr(line, '\t');
+        size_t length = strlen(line);
+        if (line[0] == '#' || !name || length == 0 || line[length - 1] != '\n') continue;
+        line[length - 1] = '\0';
+        *name++ = '\0';
+        if (sscanf(line, "%" SCNx64 " %" SCNu64 " %" SCNd64 " %" SCNx64 " %" SCNu64, &entry.settings,
+                   &entry.input_size, &entry.input_mtime, &entry.input_hash, &entry.output_size) != 5)
+            continue;
+
+        int n = findImage(manifest, table, table_size, name);
+        if (n < 0) continue;
+        recorded[n] = entry;
+        found[n] = 1;
+        matched++;
+    }
+    free(table);
+    fclose(file);
+    return matched;
+}
+
+// Write the journal at path with the up-to-date lines only. Returns 0 on success.
+static int compactJournal(const char *path, const Manifest *manifest, const JournalEntry *recorded,
+                          const unsigned char *up_to_date) {
+    char temp_path[520];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE *file = fopen(temp_path, "w");
+    int ok = file && fputs(JOURNAL_HEADER, file) >= 0;
+    for (int n = 0; ok && n < manifest->count; n++)
+        if (up_to_date[n]) writeEntry(file, &recorded[n], manifest->images[n].file_name);
+    if (file) ok = fclose(file) == 0 && ok;
+    if (ok) {
+        remove(path);
+        ok = rename(temp_path, path) == 0;
+    }
+    if (!ok) remove(temp_path);
+    return ok ? 0 : -1;
+}
+
+int openJournal(Journal *journal, JournalMode mode, const char *image_dir, const char *output_dir,
+                const Manifest *manifest, uint64_t settings, unsigned char *up_to_date) {
+    char path[512], part_path[540];
+    int count = manifest->count;
+    int rank = clusterRank(), size = clusterSize();
+
+    memset(journal, 0, sizeof(*journal));
+    journal->mode = mode;
+    journal->manifest = manifest;
+    journal->image_dir = image_dir;
+    journal->settings = settings;
+    journal->entries = (JournalEntry *)calloc(count > 0 ? count : 1, sizeof(JournalEntry));
+    JournalEntry *recorded = (JournalEntry *)calloc(count > 0 ? count : 1, sizeof(JournalEntry));
+    unsigned char *found = (unsigned char *)calloc(count > 0 ? count : 1, 1);
+    int ok = journal->entries && recorded && found;
+    if (!ok) printf("Out of memory\n");
+    if (!clusterAllOk(ok)) {
+        free(recorded);
+        free(found);
+        closeJournal(journal);
+        return -1;
+    }
+
+    // The main journal, then the parts ranks of a multi-node run appended to
+    snprintf(path, sizeof(path), "%s/%s", output_dir, JOURNAL_FILE_NAME);
+    readJournal(path, manifest, recorded, found);
+    int num_parts = 0;
+    for (;; num_parts++) {
+        snprintf(part_path, sizeof(part_path), "%s.%d", path, num_parts);
+        if (readJournal(part_path, manifest, recorded, found) < 0) break;
+    }
+
+    // Stat (or hash) the inputs of this rank's block; with hashing this reads them whole
+    int first = clusterBlockStart(count, rank, size), last = clusterBlockStart(count, rank + 1, size);
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int n = first; n < last; n++) {
+        JournalEntry *current = &journal->entries[n];
+        current->settings = settings;
+        inputKey(mode, image_dir, manifest->images[n].file_name, current);
+        up_to_date[n] = found[n] && entryIsCurrent(journal, &recorded[n], current) &&
+                        outputExists(output_dir, manifest->images[n].file_name, recorded[n].output_size);
+    }
+    clusterMaxFlags(up_to_date, count);
+
+    // Rank 0 folds everything still current into the main journal. Only then
+    // are the parts emptied, each by its rank, so a crash in between loses nothing.
+    ok = 1;
+    if (rank == 0) {
+        ok = compactJournal(path, manifest, recorded, up_to_date) == 0;
+        for (int p = 0; ok && p < num_parts; p++) {
+            snprintf(part_path, sizeof(part_path), "%s.%d", path, p);
+            if (size == 1 || p >= size) remove(part_path);
+        }
+    }
+    ok = clusterAllOk(ok);
+    free(recorded);
+    free(found);
+
+    if (size > 1) snprintf(part_path, sizeof(part_path), "%s.%d", path, rank);
+    if (ok) journal->file = size > 1 ? fopen(part_path, "w") : fopen(path, "a");
+    if (!clusterAllOk(journal->file != NULL)) {
+        printf("Could not write journal: %s\n", size > 1 ? part_path : path);
+        closeJournal(journal);
+        return -1;
+    }
+    pthread_mutex_init(&journal->lock, NULL);
+    return 0;
+}
+
+void journalImageWritten(Journal *journal, int image, size_t output_size) {
+    JournalEntry entry = journal->entries[image];
+
+    // Images outside this rank's block were not looked at when the journal was opened
+    if (entry.settings == 0) {
+        entry.settings = journal->settings;
+        inputKey(journal->mode, journal->image_dir, journal->manifest->images[image].file_name, &entry);
+    }
+    if (entry.input_size == (uint64_t)-1) return;
+    entry.output_size = output_size;
+
+    // Flushed line by line so a crash loses at most the image being recorded
+    pthread_mutex_lock(&journal->lock);
+    writeEntry(journal->file, &entry, journal->manifest->images[image].file_name);
+    fflush(journal->file);
+    pthread_mutex_unlock(&journal->lock);
+}
+
+void closeJournal(Journal *journal) {
+    if (journal->file) {
+        fclose(journal->file);
+        pthread_mutex_destroy(&journal->lock);
+    }
+    free(journal->entries);
+    journal->file = NULL;
+    journal->entries = NULL;
+}
@@ -0,0 +1,77 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "manifest_loader.h"
+#include "filter_chain.h"
+#include "output_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Journal of the images written into an output directory, for incremental runs
+// (--incremental). Every line records one input (its size and mtime, and its
+// content hash in JOURNAL_HASH mode), a hash of the filter chain and output
+// options it was processed with, and the size of the output written from it.
+// On the next run an image whose input and settings match its line and whose
+// output is still there is skipped. Lines are appended and flushed as images
+// finish, so a run that dies partway keeps everything it wrote; the journal is
+// compacted to the current entries whenever it is opened. In a multi-node run
+// every rank appends to a part of its own (JOURNAL_FILE_NAME.<rank>), which
+// the next run folds back into the main journal.
+
+#define JOURNAL_FILE_NAME ".sar_filter_journal"  // In the output directory
+
+typedef enum {
+    JOURNAL_OFF,
+    JOURNAL_MTIME,  // Inputs are current when their size and mtime match
+    JOURNAL_HASH    // Inputs are current when their size and content hash match (reads every input)
+} JournalMode;
+
+typedef struct {
+    uint64_t settings;      // journalSettings() of the run that wrote the output
+    uint64_t input_size;
+    int64_t input_mtime;
+    uint64_t input_hash;    // 0 unless hashed
+    uint64_t output_size;
+} JournalEntry;
+
+typedef struct {
+    JournalMode mode;
+    const Manifest *manifest;
+    const char *image_dir;
+    uint64_t settings;
+    JournalEntry *entries;  // Current key of the images of this rank's block (settings 0 elsewhere);
+                            // input_size -1 if the input is missing
+    FILE *file;             // Open for appending
+    pthread_mutex_t lock;
+} Journal;
+
+// Parse "mtime" or "hash". Returns 0 on success.
+int parseJournalMode(const char *name, JournalMode *mode);
+const char *journalModeName(JournalMode mode);
+
+// Hash of everything besides the input that decides an output's contents,
+// wide_samples being DatasetJob.wide_samples
+uint64_t journalSettings(const FilterChain *chain, const OutputOptions *output, int wide_samples);
+
+// Open the journal of output_dir and set up_to_date[n] for every image of
+// manifest that need not be processed again. Collective over the ranks of a
+// multi-node run, each of which checks its block of the images. Returns 0 on success.
+int openJournal(Journal *journal, JournalMode mode, const char *image_dir, const char *output_dir,
+                const Manifest *manifest, uint64_t settings, unsigned char *up_to_date);
+
+// Append image, written with an output of output_size bytes. Thread safe.
+void journalImageWritten(Journal *journal, int image, size_t output_size);
+
+void closeJournal(Journal *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,488 @@
+#include "manifest_loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define READ_BUFFER_SIZE (64 * 1024)
+#define MAX_NUMBER_LENGTH 64
+#define CACHE_MAGIC "SARMAN01"
+
+// Stat that reports 64-bit sizes on Windows too (annotation files can exceed 2 GB)
+#ifdef _WIN32
+typedef struct _stati64 FileStat;
+#define statFile _stati64
+#else
+typedef struct stat FileStat;
+#define statFile stat
+#endif
+
+// Buffered reader over the JSON file; the file is never loaded whole
+typedef struct {
+    FILE *file;
+    unsigned char buffer[READ_BUFFER_SIZE];
+    size_t pos;
+    size_t len;
+} JsonReader;
+
+// Growable byte buffer
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+// Manifest under construction: entries store name offsets until the string
+// buffer has stopped moving
+typedef struct {
+    ManifestImage *images;
+    size_t *name_offsets;
+    int count;
+    int capacity;
+    ByteBuffer strings;
+} ManifestBuilder;
+
+// Binary cache layout: header, count records, then strings_size bytes of names.
+// Written in native byte order; it is a local cache, not an interchange format.
+typedef struct {
+    char magic[8];
+    uint64_t json_size;
+    int64_t json_mtime;
+    uint32_t count;
+    uint32_t strings_size;
+} CacheHeader;
+
+typedef struct {
+    uint32_t name_offset;
+    int32_t width;
+    int32_t height;
+} CacheRecord;
+
+static int appendByte(ByteBuffer *buffer, char c) {
+    if (buffer->size == buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        char *data = (char *)realloc(buffer->data, capacity);
+        if (!data) return -1;
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->size++] = c;
+    return 0;
+}
+
+static int peekChar(JsonReader *reader) {
+    if (reader->pos == reader->len) {
+        reader->len = fread(reader->buffer, 1, READ_BUFFER_SIZE, reader->file);
+        reader->pos = 0;
+        if (reader->len == 0) return EOF;
+    }
+    return reader->buffer[reader->pos];
+}
+
+static int nextChar(JsonReader *reader) {
+    int c = peekChar(reader);
+    if (c != EOF) reader->pos++;
+    return c;
+}
+
+// Skip whitespace and return the next character without consuming it
+static int skipWhitespace(JsonReader *reader) {
+    int c = peekChar(reader);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        reader->pos++;
+        c = peekChar(reader);
+    }
+    return c;
+}
+
+static int readHex4(JsonReader *reader, unsigned int *value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = nextChar(reader);
+        *value <<= 4;
+        if (c >= '0' && c <= '9') *value |= c - '0';
+        else if (c >= 'a' && c <= 'f') *value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') *value |= c - 'A' + 10;
+        else return -1;
+    }
+    return 0;
+}
+
+static int appendUtf8(ByteBuffer *out, unsigned int code) {
+    if (code < 0x80) return appendByte(out, (char)code);
+    if (code < 0x800) {
+        return appendByte(out, (char)(0xC0 | (code >> 6))) ||
+               appendByte(out, (char)(0x80 | (code & 0x3F)));
+    }
+    if (code < 0x10000) {
+        return appendByte(out, (char)(0xE0 | (code >> 12))) ||
+               appendByte(out, (char)(0x80 | ((code >> 6) & 0x3F))) ||
+               appendByte(out, (char)(0x80 | (code & 0x3F)));
+    }
+    return appendByte(out, (char)(0xF0 | (code >> 18))) ||
+           appendByte(out, (char)(0x80 | ((code >> 12) & 0x3F))) ||
+           appendByte(out, (char)(0x80 | ((code >> 6) & 0x3F))) ||
+           appendByte(out, (char)(0x80 | (code & 0x3F)));
+}
+
+// Read a string starting at its opening quote. The decoded bytes are appended
+// to out, or dropped when out is NULL.
+static int readString(JsonReader *reader, ByteBuffer *out) {
+    if (nextChar(reader) != '"') return -1;
+
+    for (;;) {
+        int c = nextChar(reader);
+        if (c == EOF) return -1;
+        if (c == '"') return 0;
+
+        if (c == '\\') {
+            c = nextChar(reader);
+            switch (c) {
+                case '"': case '\\': case '/': break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    unsigned int code;
+                    if (readHex4(reader, &code)) return -1;
+                    // Surrogate pair
+                    if (code >= 0xD800 && code <= 0xDBFF) {
+                        unsigned int low;
+                        if (nextChar(reader) != '\\' || nextChar(reader) != 'u' || readHex4(reader, &low)) return -1;
+                        if (low < 0xDC00 || low > 0xDFFF) return -1;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    if (out && appendUtf8(out, code)) return -1;
+                    continue;
+                }
+                default: return -1;
+            }
+        }
+        if (out && appendByte(out, (char)c)) return -1;
+    }
+}
+
+// Read a number (or any other bare literal) into a NUL-terminated token
+static int readLiteral(JsonReader *reader, char *token, size_t capacity) {
+    size_t len = 0;
+    int c = peekChar(reader);
+    while (c != EOF && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        if (token && len + 1 < capacity) token[len] = (char)c;
+        len++;
+        reader->pos++;
+        c = peekChar(reader);
+    }
+    if (token) token[len < capacity ? len : capacity - 1] = '\0';
+    return len > 0 ? 0 : -1;
+}
+
+// Skip any value. Objects and arrays are skipped by bracket depth without
+// recursion, so deeply nested annotations cost nothing.
+static int skipValue(JsonReader *reader) {
+    int c = skipWhitespace(reader);
+    if (c == '"') return readString(reader, NULL);
+    if (c != '{' && c != '[') return readLiteral(reader, NULL, 0);
+
+    int depth = 0;
+    do {
+        c = peekChar(reader);
+        if (c == EOF) return -1;
+        if (c == '"') {
+            if (readString(reader, NULL)) return -1;
+            continue;
+        }
+        reader->pos++;
+        if (c == '{' || c == '[') depth++;
+        else if (c == '}' || c == ']') depth--;
+    } while (depth > 0);
+    return 0;
+}
+
+// Read an object key and the colon after it. Keys are truncated to the buffer.
+static int readKey(JsonReader *reader, ByteBuffer *key) {
+    key->size = 0;
+    if (skipWhitespace(reader) != '"' || readString(reader, key) || appendByte(key, '\0')) return -1;
+    if (skipWhitespace(reader) != ':') return -1;
+    reader->pos++;
+    return 0;
+}
+
+static int readInt(JsonReader *reader, int *value) {
+    char token[MAX_NUMBER_LENGTH];
+    if (readLiteral(reader, token, sizeof(token))) return -1;
+    *value = (int)strtod(token, NULL);
+    return 0;
+}
+
+static int addImage(ManifestBuilder *builder, size_t name_offset, int width, int height) {
+    if (builder->count == builder->capacity) {
+        int capacity = builder->capacity ? builder->capacity * 2 : 1024;
+        ManifestImage *images = (ManifestImage *)realloc(builder->images, capacity * sizeof(ManifestImage));
+        if (!images) return -1;
+        builder->images = images;
+        size_t *name_offsets = (size_t *)realloc(builder->name_offsets, capacity * sizeof(size_t));
+        if (!name_offsets) return -1;
+        builder->name_offsets = name_offsets;
+        builder->capacity = capacity;
+    }
+    builder->images[builder->count].width = width;
+    builder->images[builder->count].height = height;
+    builder->name_offsets[builder->count] = name_offset;
+    builder->count++;
+    return 0;
+}
+
+// Parse one element of "images"; entries without a file_name are dropped
+static int parseImageEntry(JsonReader *reader, ManifestBuilder *builder, ByteBuffer *key) {
+    if (skipWhitespace(reader) != '{') return skipValue(reader);
+    reader->pos++;
+
+    size_t name_offset = 0;
+    int has_name = 0, width = 0, height = 0;
+
+    if (skipWhitespace(reader) == '}') {
+        reader->pos++;
+        return 0;
+    }
+    for (;;) {
+        if (readKey(reader, key)) return -1;
+        int c = skipWhitespace(reader);
+
+        if (strcmp(key->data, "file_name") == 0 && c == '"' && !has_name) {
+            name_offset = builder->strings.size;
+            if (readString(reader, &builder->strings) || appendByte(&builder->strings, '\0')) return -1;
+            has_name = 1;
+        } else if (strcmp(key->data, "width") == 0 && c != '"' && c != '{' && c != '[') {
+            if (readInt(reader, &width)) return -1;
+        } else if (strcmp(key->data, "height") == 0 && c != '"' && c != '{' && c != '[') {
+            if (readInt(reader, &height)) return -1;
+        } else if (skipValue(reader)) {
+            return -1;
+        }
+
+        c = skipWhitespace(reader);
+        reader->pos++;
+        if (c == '}') break;
+        if (c != ',') return -1;
+    }
+    return has_name ? addImage(builder, name_offset, width, height) : 0;
+}
+
+// Scan the top-level object for "images" and stop reading once it has been parsed.
+// Returns 1 when the array was found, 0 when it is missing, -1 on a syntax error.
+static int scanImages(JsonReader *reader, ManifestBuilder *builder) {
+    ByteBuffer key = {0};
+    int result = -1;
+
+    if (skipWhitespace(reader) != '{') goto done;
+    reader->pos++;
+    if (skipWhitespace(reader) == '}') {
+        result = 0;
+        goto done;
+    }
+
+    for (;;) {
+        if (readKey(reader, &key)) goto done;
+
+        if (strcmp(key.data, "images") == 0 && skipWhitespace(reader) == '[') {
+            reader->pos++;
+            if (skipWhitespace(reader) == ']') {
+                result = 1;
+                goto done;
+            }
+            for (;;) {
+                if (parseImageEntry(reader, builder, &key)) goto done;
+                int c = skipWhitespace(reader);
+                reader->pos++;
+                if (c == ']') break;
+                if (c != ',') goto done;
+            }
+            result = 1;
+            goto done;
+        }
+        if (skipValue(reader)) goto done;
+
+        int c = skipWhitespace(reader);
+        reader->pos++;
+        if (c == '}') {
+            result = 0;
+            goto done;
+        }
+        if (c != ',') goto done;
+    }
+
+done:
+    free(key.data);
+    return result;
+}
+
+static void finishManifest(ManifestBuilder *builder, Manifest *manifest) {
+    for (int i = 0; i < builder->count; i++) {
+        builder->images[i].file_name = builder->strings.data + builder->name_offsets[i];
+    }
+    free(builder->name_offsets);
+
+    manifest->images = builder->images;
+    manifest->count = builder->count;
+    manifest->strings = builder->strings.data;
+}
+
+static void freeBuilder(ManifestBuilder *builder) {
+    free(builder->images);
+    free(builder->name_offsets);
+    free(builder->strings.data);
+}
+
+static void cachePathFor(const char *json_path, char *path, size_t size) {
+    snprintf(path, size, "%s%s", json_path, MANIFEST_CACHE_SUFFIX);
+}
+
+// Load the cache when it was written for this exact JSON size and mtime
+static int loadCache(const char *cache_path, const FileStat *json_stat, ManifestBuilder *builder) {
+    FILE *file = fopen(cache_path, "rb");
+    if (!file) return -1;
+
+    CacheHeader header;
+    CacheRecord *records = NULL;
+    int result = -1;
+
+    if (fread(&header, sizeof(header), 1, file) != 1) goto done;
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0) goto done;
+    if (header.json_size != (uint64_t)json_stat->st_size || header.json_mtime != (int64_t)json_stat->st_mtime) goto done;
+    if (header.count > INT32_MAX || header.strings_size == 0) goto done;
+
+    records = (CacheRecord *)malloc((header.count ? header.count : 1) * sizeof(CacheRecord));
+    builder->strings.data = (char *)malloc(header.strings_size);
+    if (!records || !builder->strings.data) goto done;
+    builder->strings.size = builder->strings.capacity = header.strings_size;
+
+    if (fread(records, sizeof(CacheRecord), header.count, file) != header.count) goto done;
+    if (fread(builder->strings.data, 1, header.strings_size, file) != header.strings_size) goto done;
+    if (builder->strings.data[header.strings_size - 1] != '\0') goto done;
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        if (records[i].name_offset >= header.strings_size) goto done;
+        if (addImage(builder, records[i].name_offset, records[i].width, records[i].height)) goto done;
+    }
+    result = 0;
+
+done:
+    free(records);
+    fclose(file);
+    return result;
+}
+
+// Best effort: a cache that cannot be written is simply not used next time
+static void writeCache(const char *cache_path, const FileStat *json_stat, const ManifestBuilder *builder) {
+    if (builder->strings.size == 0 || builder->strings.size > UINT32_MAX) return;
+
+    FILE *file = fopen(cache_path, "wb");
+    if (!file) return;
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.json_size = (uint64_t)json_stat->st_size;
+    header.json_mtime = (int64_t)json_stat->st_mtime;
+    header.count = (uint32_t)builder->count;
+    header.strings_size = (uint32_t)builder->strings.size;
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; ok && i < builder->count; i++) {
+        CacheRecord record = {(uint32_t)builder->name_offsets[i], builder->images[i].width, builder->images[i].height};
+        ok = fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+    ok = ok && fwrite(builder->strings.data, 1, builder->strings.size, file) == builder->strings.size;
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok) remove(cache_path);
+}
+
+int loadManifest(const char *json_path, int use_cache, Manifest *manifest) {
+    ManifestBuilder builder = {0};
+    FileStat json_stat;
+    char cache_path[1024];
+
+    memset(manifest, 0, sizeof(*manifest));
+
+    if (statFile(json_path, &json_stat) != 0) {
+        printf("Could not open JSON file: %s\n", json_path);
+        return -1;
+    }
+    cachePathFor(json_path, cache_path, sizeof(cache_path));
+
+    if (use_cache) {
+        if (loadCache(cache_path, &json_stat, &builder) == 0) {
+            finishManifest(&builder, manifest);
+            return 0;
+        }
+        // Stale or damaged cache: start over from the JSON
+        freeBuilder(&builder);
+        memset(&builder, 0, sizeof(builder));
+    }
+
+    JsonReader *reader = (JsonReader *)malloc(sizeof(JsonReader));
+    if (!reader) {
+        printf("Out of memory loading manifest\n");
+        return -1;
+    }
+    reader->file = fopen(json_path, "rb");
+    reader->pos = reader->len = 0;
+    if (!reader->file) {
+        printf("Could not open JSON file: %s\n", json_path);
+        free(reader);
+        return -1;
+    }
+
+    int found = scanImages(reader, &builder);
+    fclose(reader->file);
+    free(reader);
+
+    if (found < 0) {
+        printf("Error parsing JSON\n");
+        freeBuilder(&builder);
+        return -1;
+    }
+    if (found == 0) {
+        printf("Invalid JSON format\n");
+        freeBuilder(&builder);
+        return -1;
+    }
+
+    if (use_cache) writeCache(cache_path, &json_stat, &builder);
+    finishManifest(&builder, manifest);
+    return 0;
+}
+
+int listManifest(const char *file_names, Manifest *manifest) {
+    ManifestBuilder builder = {0};
+    const char *p = file_names;
+
+    memset(manifest, 0, sizeof(*manifest));
+    for (;;) {
+        const char *end = strchr(p, ',');
+        size_t length = end ? (size_t)(end - p) : strlen(p);
+        size_t offset = builder.strings.size;
+        int ok = length > 0 && addImage(&builder, offset, 0, 0) == 0;
+        for (size_t c = 0; ok && c < length; c++) ok = appendByte(&builder.strings, p[c]) == 0;
+        if (!ok || appendByte(&builder.strings, '\0') != 0) {
+            if (length > 0) printf("Out of memory loading manifest\n");
+            else printf("Empty file name in list: %s\n", file_names);
+            freeBuilder(&builder);
+            return -1;
+        }
+        if (!end) break;
+        p = end + 1;
+    }
+    finishManifest(&builder, manifest);
+    return 0;
+}
+
+void freeManifest(Manifest *manifest) {
+    free(manifest->images);
+    free(manifest->strings);
+    memset(manifest, 0, sizeof(*manifest));
+}
@@ -0,0 +1,47 @@
+#ifndef MANIFEST_LOADER_H
+#define MANIFEST_LOADER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Set to 0 to always rescan the JSON and never read or write the binary cache
+#ifndef MANIFEST_CACHE
+#define MANIFEST_CACHE 1
+#endif
+
+// Cache file written next to the annotations: <json_path><MANIFEST_CACHE_SUFFIX>
+#define MANIFEST_CACHE_SUFFIX ".manifest"
+
+// One entry of the COCO "images" array. width/height are 0 when the entry has none.
+typedef struct {
+    const char *file_name;
+    int width;
+    int height;
+} ManifestImage;
+
+typedef struct {
+    ManifestImage *images;
+    int count;
+    char *strings;  // File names, NUL-separated; images[].file_name points in here
+} Manifest;
+
+// Load images[].file_name/width/height from a COCO annotation file.
+// The JSON is scanned in a single streaming pass that keeps only those fields,
+// so annotations and the rest of the document are never held in memory.
+// With use_cache, a binary cache next to the JSON (keyed by its size and mtime)
+// is used when it is current and rewritten when it is not.
+// Returns 0 on success, -1 on error (after printing what went wrong).
+int loadManifest(const char *json_path, int use_cache, Manifest *manifest);
+
+// Manifest of a comma-separated list of file names, as if read from a JSON
+// whose entries have no sizes. Returns 0 on success, -1 on error.
+int listManifest(const char *file_names, Manifest *manifest);
+
+void freeManifest(Manifest *manifest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+#include "output_format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "stb_image_write.h"
+#include "sar_raw.h"
+#include "codec.h"
+
+#define MAX_RESIZE_SIDE 65535
+
+int parseOutputFormat(const char *name, OutputOptions *options) {
+    options->png_level = -1;
+
+    if (strcmp(name, "auto") == 0) options->format = OUTPUT_AUTO;
+    else if (strcmp(name, "pgm") == 0) options->format = OUTPUT_PGM;
+    else if (strcmp(name, "raw") == 0) options->format = OUTPUT_RAW;
+    else if (strcmp(name, "png") == 0) options->format = OUTPUT_PNG;
+    else if (strncmp(name, "png:", 4) == 0) {
+        char *end;
+        long level = strtol(name + 4, &end, 10);
+        if (*end != '\0' || end == name + 4 || level < 0 || level > 9) return -1;
+        options->format = OUTPUT_PNG;
+        options->png_level = (int)level;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *outputFormatName(const OutputOptions *options) {
+    switch (options->format) {
+        case OUTPUT_PNG: return "png";
+        case OUTPUT_PGM: return "pgm";
+        case OUTPUT_RAW: return "raw";
+        default: return "auto";
+    }
+}
+
+int parseResize(const char *text, OutputOptions *options) {
+    char *end;
+    long width = strtol(text, &end, 10);
+    if (end == text || (*end != 'x' && *end != 'X')) return -1;
+    const char *rest = end + 1;
+    long height = strtol(rest, &end, 10);
+    if (end == rest || *end != '\0' || width < 0 || height < 0 || width > MAX_RESIZE_SIDE ||
+        height > MAX_RESIZE_SIDE || (width == 0 && height == 0))
+        return -1;
+    options->resize_width = (int)width;
+    options->resize_height = (int)height;
+    return 0;
+}
+
+int outputSize(const OutputOptions *options, int width, int height, int *out_width, int *out_height) {
+    int w = options->resize_width, h = options->resize_height;
+    if (w == 0 && h == 0) {
+        w = width;
+        h = height;
+    } else if (w == 0) {
+        w = (int)(((long long)width * h + height / 2) / height);
+    } else if (h == 0) {
+        h = (int)(((long long)height * w + width / 2) / width);
+    }
+    *out_width = w > 0 ? w : 1;
+    *out_height = h > 0 ? h : 1;
+    return *out_width != width || *out_height != height;
+}
+
+int pngLevel(const OutputOptions *options) {
+    return options->png_level >= 0 ? options->png_level : pngEncoder()->default_level;
+}
+
+void applyOutputOptions(const OutputOptions *options) {
+    stbi_write_png_compression_level = pngLevel(options);
+}
+
+// 8-bit PNG through the encoder of codec.h
+static int writePng(const char *path, const void *pixels, int width, int height, int level, size_t *size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return 0;
+
+    *size = 0;
+    int ok = pngEncoder()->write_png(file, (const unsigned char *)pixels, width, height, level, size);
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// 8-bit or 16-bit binary PGM; 16-bit samples are stored big-endian
+static int writePgm(const char *path, const void *pixels, int width, int height, int dtype, size_t *size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return 0;
+
+    int header = fprintf(file, "P5\n%d %d\n%d\n", width, height, dtype == PIXEL_U16 ? 65535 : 255);
+    int ok = header > 0;
+    *size = (size_t)(ok ? header : 0) + (size_t)width * height * pixelSize(dtype);
+    if (dtype == PIXEL_U16) {
+        const uint16_t *samples = (const uint16_t *)pixels;
+        unsigned char *row = (unsigned char *)malloc((size_t)width * 2);
+        ok = ok && row;
+        for (int y = 0; ok && y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint16_t v = samples[(size_t)y * width + x];
+                row[2 * x] = (unsigned char)(v >> 8);
+                row[2 * x + 1] = (unsigned char)(v & 0xFF);
+            }
+            ok = fwrite(row, 2, width, file) == (size_t)width;
+        }
+        free(row);
+    } else {
+        ok = ok && fwrite(pixels, width, height, file) == (size_t)height;
+    }
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+int writeOutputImage(const char *output_path, const void *pixels, int width, int height, int dtype,
+                     const OutputOptions *options, int raw_input, size_t *bytes_written) {
+    char path[1024];
+    size_t size = 0;
+    OutputFormat format = options->format;
+    if (format == OUTPUT_AUTO) format = raw_input ? OUTPUT_RAW : OUTPUT_PNG;
+
+    // stb writes 8-bit PNG only and PGM has no float samples
+    if (format == OUTPUT_PNG && dtype != PIXEL_U8) format = OUTPUT_PGM;
+    if (format == OUTPUT_PGM && dtype == PIXEL_F32) format = OUTPUT_RAW;
+
+    int written;
+    switch (format) {
+        case OUTPUT_RAW:
+            snprintf(path, sizeof(path), "%s%s", output_path, SAR_RAW_EXTENSION);
+            written = sarRawWrite(path, pixels, width, height, dtype, 0, 0) == 0;
+            size = SAR_RAW_HEADER_SIZE + (size_t)width * height * pixelSize(dtype);
+            if (written && bytes_written) *bytes_written = size;
+            return written;
+        case OUTPUT_PGM:
+            snprintf(path, sizeof(path), "%s.pgm", output_path);
+            written = writePgm(path, pixels, width, height, dtype, &size);
+            break;
+        default:
+            snprintf(path, sizeof(path), "%s", output_path);
+            written = writePng(path, pixels, width, height, pngLevel(options), &size);
+            break;
+    }
+    if (!written) printf("\nCould not write image: %s\n", path);
+    else if (bytes_written) *bytes_written = size;
+    return written;
+}
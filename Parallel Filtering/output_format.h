@@ -0,0 +1,58 @@
+#ifndef OUTPUT_FORMAT_H
+#define OUTPUT_FORMAT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// stb's default; 0 stores the deflate stream uncompressed, 9 is slowest
+#define DEFAULT_PNG_COMPRESSION_LEVEL 8
+
+typedef enum {
+    OUTPUT_AUTO,  // Raw for raw (.sarraw) input, PNG otherwise
+    OUTPUT_PNG,
+    OUTPUT_PGM,   // Binary P5 (8 or 16 bit), no compression
+    OUTPUT_RAW    // sar_raw container
+} OutputFormat;
+
+typedef struct {
+    OutputFormat format;
+    int png_level;  // -1 = the PNG encoder's default (codec.h)
+    int resize_width;   // Size the filtered images are scaled to before encoding; 0 x 0 keeps
+    int resize_height;  // their size, and 0 on one side keeps their aspect ratio
+} OutputOptions;
+
+// Parse "auto", "png", "png:<level>", "pgm" or "raw". Returns 0 on success.
+int parseOutputFormat(const char *name, OutputOptions *options);
+
+const char *outputFormatName(const OutputOptions *options);
+
+// Parse a --resize size "WxH" into options. Returns 0 on success.
+int parseResize(const char *text, OutputOptions *options);
+
+// The size a filtered width x height image is written at. Returns 1 if it
+// has to be scaled to get there.
+int outputSize(const OutputOptions *options, int width, int height, int *out_width, int *out_height);
+
+// The zlib level PNGs are written at
+int pngLevel(const OutputOptions *options);
+
+// Set up the encoders once, before any thread writes images
+void applyOutputOptions(const OutputOptions *options);
+
+// Write a grayscale image of PixelType dtype to output_path in the selected format.
+// PGM and raw output get their extension appended to output_path.
+// raw_input says whether the image was read from a raw file (for OUTPUT_AUTO).
+// Formats that cannot hold the samples fall back: PNG to 16-bit PGM for u16,
+// PNG and PGM to raw for f32. Returns 1 if the image was written, and
+// stores the file size in *bytes_written unless it is NULL.
+int writeOutputImage(const char *output_path, const void *pixels, int width, int height, int dtype,
+                     const OutputOptions *options, int raw_input, size_t *bytes_written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PIXEL_TYPE_H
+#define PIXEL_TYPE_H
+
+#include <stddef.h>
+
+// Grayscale sample types carried through loading, filtering and saving.
+// The values are stored in raw file headers; do not renumber.
+typedef enum {
+    PIXEL_U8 = 1,
+    PIXEL_U16 = 2,   // 16-bit PNG/PGM or raw amplitude
+    PIXEL_F32 = 3    // Float amplitude (raw only), often log-scaled
+} PixelType;
+
+// Bytes per sample, or 0 for an unknown type
+static inline size_t pixelSize(int type) {
+    switch (type) {
+        case PIXEL_U8: return 1;
+        case PIXEL_U16: return 2;
+        case PIXEL_F32: return 4;
+        default: return 0;
+    }
+}
+
+static inline const char *pixelTypeName(int type) {
+    switch (type) {
+        case PIXEL_U8: return "u8";
+        case PIXEL_U16: return "u16";
+        case PIXEL_F32: return "f32";
+        default: return "unknown";
+    }
+}
+
+#endif
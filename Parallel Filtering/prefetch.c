@@ -0,0 +1,536 @@
+#include "prefetch.h"
+#include "sar_raw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if USE_IO_URING
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+enum {
+    PREFETCH_IDLE,      // Not handed to a reader
+    PREFETCH_READING,
+    PREFETCH_READY,     // Read, waiting for its worker
+    PREFETCH_TAKEN      // Handed to the worker, or read by it
+};
+
+struct PrefetchEntry {
+    int state;
+    int lane;
+    unsigned char *data;
+    size_t size;
+};
+
+static void imagePath(const Prefetcher *prefetcher, int image, int raw, char *path, size_t size) {
+    snprintf(path, size, "%s/%s%s", prefetcher->image_dir, prefetcher->manifest->images[image].file_name,
+             raw ? SAR_RAW_EXTENSION : "");
+}
+
+// Hand the next image of the lanes to a reader, taking the lanes in turn and
+// keeping at most depth images of each outstanding. Returns -1 if there is none.
+// Called with the lock held.
+static int nextImage(Prefetcher *prefetcher) {
+    for (int i = 0; i < prefetcher->num_lanes; i++) {
+        int l = (prefetcher->next_lane + i) % prefetcher->num_lanes;
+        PrefetchLane *lane = &prefetcher->lanes[l];
+        if (lane->outstanding >= prefetcher->depth) continue;
+
+        // Images a worker got to first are skipped
+        while (lane->next < lane->count && prefetcher->entries[lane->images[lane->next]].state != PREFETCH_IDLE)
+            lane->next++;
+        if (lane->next == lane->count) continue;
+
+        int image = lane->images[lane->next++];
+        prefetcher->entries[image].state = PREFETCH_READING;
+        prefetcher->entries[image].lane = l;
+        lane->outstanding++;
+        prefetcher->next_lane = (l + 1) % prefetcher->num_lanes;
+        return image;
+    }
+    return -1;
+}
+
+// 1 if a lane has images left that wait for room in its window. Called with the lock held.
+static int lanesFull(const Prefetcher *prefetcher) {
+    for (int l = 0; l < prefetcher->num_lanes; l++)
+        if (prefetcher->lanes[l].next < prefetcher->lanes[l].count) return 1;
+    return 0;
+}
+
+static void finishRead(Prefetcher *prefetcher, int image, unsigned char *data, size_t size) {
+    PrefetchEntry *entry = &prefetcher->entries[image];
+    pthread_mutex_lock(&prefetcher->lock);
+    entry->data = data;
+    entry->size = size;
+    entry->state = PREFETCH_READY;
+
+    // How many images are ready ahead of the workers
+    QueueTiming *timing = &prefetcher->timing;
+    int ready = prefetcher->lanes[entry->lane].outstanding;
+    timing->pushes++;
+    prefetcher->ready_sum += ready;
+    if (ready > timing->max_depth) timing->max_depth = ready;
+    pthread_cond_broadcast(&prefetcher->ready);
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+#ifndef _WIN32
+// Have the kernel read the raw copy into the page cache before the worker maps it
+static void adviseRead(int fd) {
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#else
+    (void)fd;
+#endif
+}
+#endif
+
+// Blocking read of image: NULL for a raw copy (after asking the kernel to read it ahead) or on failure
+static unsigned char *readImage(const Prefetcher *prefetcher, int image, size_t *size) {
+    char path[512];
+    imagePath(prefetcher, image, 1, path, sizeof(path));
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        adviseRead(fd);
+        close(fd);
+        return NULL;
+    }
+#else
+    FILE *raw = fopen(path, "rb");
+    if (raw) {
+        fclose(raw);
+        return NULL;
+    }
+#endif
+
+    imagePath(prefetcher, image, 0, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    unsigned char *data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) length = ftell(file);
+    if (length > 0 && fseek(file, 0, SEEK_SET) == 0) data = (unsigned char *)malloc(length);
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = data ? (size_t)length : 0;
+    return data;
+}
+
+// Reader of the thread pool: blocking reads, one image at a time
+static void *readerThread(void *arg) {
+    Prefetcher *prefetcher = (Prefetcher *)arg;
+    for (;;) {
+        int image = -1;
+        pthread_mutex_lock(&prefetcher->lock);
+        while (!prefetcher->stopping && (image = nextImage(prefetcher)) < 0) {
+            if (lanesFull(prefetcher)) prefetcher->timing.full_waits++;
+            pthread_cond_wait(&prefetcher->work, &prefetcher->lock);
+        }
+        pthread_mutex_unlock(&prefetcher->lock);
+        if (image < 0) break;
+
+        size_t size = 0;
+        unsigned char *data = readImage(prefetcher, image, &size);
+        finishRead(prefetcher, image, data, size);
+    }
+    return NULL;
+}
+
+#if USE_IO_URING
+// One io_uring, set up with the raw system calls (no liburing). Every read
+// goes through the steps of a request: open the raw copy, or else open the
+// file, then read it whole, each step submitted when the last one completes.
+
+#define RING_MAX_READ (1u << 30)  // Largest single read submitted
+
+enum {
+    STEP_OPEN_RAW,
+    STEP_OPEN_FILE,
+    STEP_READ
+};
+
+typedef struct {
+    int image;
+    int step;
+    int fd;
+    unsigned char *data;
+    size_t size;
+    size_t done;
+    char path[512];
+} RingRequest;
+
+struct PrefetchRing {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+    unsigned to_submit;         // Queued and not yet taken by the kernel
+    RingRequest *requests;
+    int *free_requests;
+    int num_free;
+    int num_requests;
+    int in_flight;
+};
+
+static void closeRing(PrefetchRing *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map) munmap(ring->sq_map, ring->sq_map_size);
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring->requests);
+    free(ring->free_requests);
+    free(ring);
+}
+
+// NULL if the kernel has no io_uring (or refuses it)
+static PrefetchRing *openRing(int num_requests) {
+    struct io_uring_params params;
+    PrefetchRing *ring = (PrefetchRing *)calloc(1, sizeof(PrefetchRing));
+    if (!ring) return NULL;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, (unsigned)num_requests, &params);
+    ring->requests = (RingRequest *)calloc(num_requests, sizeof(RingRequest));
+    ring->free_requests = (int *)malloc(num_requests * sizeof(int));
+    if (ring->fd < 0 || !ring->requests || !ring->free_requests) {
+        closeRing(ring);
+        return NULL;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) ring->sq_map_size = ring->cq_map_size;
+        ring->cq_map_size = ring->sq_map_size;
+    }
+    void *sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    ring->sq_map = sq_map == MAP_FAILED ? NULL : sq_map;
+    void *cq_map = ring->sq_map;
+    if (ring->sq_map && !(params.features & IORING_FEAT_SINGLE_MMAP))
+        cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_CQ_RING);
+    ring->cq_map = cq_map == MAP_FAILED ? NULL : cq_map;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = ring->cq_map ? mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     ring->fd, IORING_OFF_SQES)
+                              : MAP_FAILED;
+    ring->sqes = sqes == MAP_FAILED ? NULL : (struct io_uring_sqe *)sqes;
+    if (!ring->sqes) {
+        closeRing(ring);
+        return NULL;
+    }
+
+    unsigned char *sq = (unsigned char *)ring->sq_map, *cq = (unsigned char *)ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // No more requests than submission entries, so the ring never fills up
+    ring->num_requests = num_requests < (int)ring->entries ? num_requests : (int)ring->entries;
+    for (int r = 0; r < ring->num_requests; r++) ring->free_requests[r] = r;
+    ring->num_free = ring->num_requests;
+    return ring;
+}
+
+// Queue a submission entry for request r; io_uring_enter submits it
+static struct io_uring_sqe *queueEntry(PrefetchRing *ring, int r, int opcode, int fd) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)opcode;
+    sqe->fd = fd;
+    sqe->user_data = (unsigned long long)r;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+static void queueOpen(PrefetchRing *ring, int r) {
+    struct io_uring_sqe *sqe = queueEntry(ring, r, IORING_OP_OPENAT, AT_FDCWD);
+    sqe->addr = (unsigned long long)(uintptr_t)ring->requests[r].path;
+    sqe->open_flags = O_RDONLY;
+}
+
+static void queueRead(PrefetchRing *ring, int r) {
+    RingRequest *request = &ring->requests[r];
+    size_t left = request->size - request->done;
+    struct io_uring_sqe *sqe = queueEntry(ring, r, IORING_OP_READ, request->fd);
+    sqe->addr = (unsigned long long)(uintptr_t)(request->data + request->done);
+    sqe->len = left < RING_MAX_READ ? (unsigned)left : RING_MAX_READ;
+    sqe->off = request->done;
+}
+
+static void startRequest(Prefetcher *prefetcher, PrefetchRing *ring, int image) {
+    int r = ring->free_requests[--ring->num_free];
+    RingRequest *request = &ring->requests[r];
+    memset(request, 0, sizeof(*request));
+    request->image = image;
+    request->step = STEP_OPEN_RAW;
+    request->fd = -1;
+    imagePath(prefetcher, image, 1, request->path, sizeof(request->path));
+    queueOpen(ring, r);
+    ring->in_flight++;
+}
+
+static void finishRequest(Prefetcher *prefetcher, PrefetchRing *ring, int r, unsigned char *data, size_t size) {
+    RingRequest *request = &ring->requests[r];
+    if (request->fd >= 0) close(request->fd);
+    if (!data) free(request->data);
+    finishRead(prefetcher, request->image, data, size);
+    ring->free_requests[ring->num_free++] = r;
+    ring->in_flight--;
+}
+
+// Take request r one step further with its last step's result
+static void advanceRequest(Prefetcher *prefetcher, PrefetchRing *ring, int r, int result) {
+    RingRequest *request = &ring->requests[r];
+    struct stat file_stat;
+
+    // Kernels without the opcode: the same read, blocking
+    if (result == -EINVAL || result == -EOPNOTSUPP) {
+        size_t size = 0;
+        free(request->data);
+        request->data = NULL;
+        unsigned char *data = readImage(prefetcher, request->image, &size);
+        finishRequest(prefetcher, ring, r, data, size);
+        return;
+    }
+
+    switch (request->step) {
+        case STEP_OPEN_RAW:
+            if (result >= 0) {
+                request->fd = result;
+                adviseRead(result);
+                finishRequest(prefetcher, ring, r, NULL, 0);
+            } else if (result == -ENOENT) {
+                request->step = STEP_OPEN_FILE;
+                imagePath(prefetcher, request->image, 0, request->path, sizeof(request->path));
+                queueOpen(ring, r);
+            } else {
+                finishRequest(prefetcher, ring, r, NULL, 0);
+            }
+            break;
+        case STEP_OPEN_FILE:
+            if (result < 0) {
+                finishRequest(prefetcher, ring, r, NULL, 0);
+                break;
+            }
+            request->fd = result;
+            if (fstat(result, &file_stat) != 0 || file_stat.st_size <= 0 ||
+                !(request->data = (unsigned char *)malloc((size_t)file_stat.st_size))) {
+                finishRequest(prefetcher, ring, r, NULL, 0);
+                break;
+            }
+            request->size = (size_t)file_stat.st_size;
+            request->step = STEP_READ;
+            queueRead(ring, r);
+            break;
+        default:
+            if (result <= 0) {
+                finishRequest(prefetcher, ring, r, NULL, 0);
+                break;
+            }
+            request->done += (size_t)result;
+            if (request->done < request->size) queueRead(ring, r);
+            else finishRequest(prefetcher, ring, r, request->data, request->size);
+            break;
+    }
+}
+
+static void reapCompletions(Prefetcher *prefetcher, PrefetchRing *ring) {
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        int r = (int)cqe->user_data, result = cqe->res;
+        __atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+        advanceRequest(prefetcher, ring, r, result);
+    }
+}
+
+// Driver of the ring: keeps it filled with requests and takes them through their steps
+static void *ringThread(void *arg) {
+    Prefetcher *prefetcher = (Prefetcher *)arg;
+    PrefetchRing *ring = prefetcher->ring;
+    int error = 0;
+
+    for (;;) {
+        int image;
+        pthread_mutex_lock(&prefetcher->lock);
+        while (!prefetcher->stopping && ring->num_free > 0 && (image = nextImage(prefetcher)) >= 0)
+            startRequest(prefetcher, ring, image);
+        if (ring->in_flight == 0) {
+            if (prefetcher->stopping) {
+                pthread_mutex_unlock(&prefetcher->lock);
+                break;
+            }
+            if (lanesFull(prefetcher)) prefetcher->timing.full_waits++;
+            pthread_cond_wait(&prefetcher->work, &prefetcher->lock);
+            pthread_mutex_unlock(&prefetcher->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&prefetcher->lock);
+
+        // Submit what is queued and wait for at least one completion
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS,
+                                 NULL, 0);
+        if (submitted >= 0) {
+            ring->to_submit -= (unsigned)submitted;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            error = errno;
+            break;
+        }
+        reapCompletions(prefetcher, ring);
+    }
+    if (!error) return NULL;
+
+    // The ring failed and what is in flight never completes: those images are
+    // left to their workers, and the rest is read by this thread, blocking
+    printf("\nio_uring failed (%s); prefetching with a blocking reader\n", strerror(error));
+    pthread_mutex_lock(&prefetcher->lock);
+    for (int r = 0; r < ring->num_requests; r++) {
+        int free_request = 0;
+        for (int f = 0; f < ring->num_free; f++) free_request |= ring->free_requests[f] == r;
+        if (free_request) continue;
+        PrefetchEntry *entry = &prefetcher->entries[ring->requests[r].image];
+        entry->state = PREFETCH_IDLE;
+        prefetcher->lanes[entry->lane].outstanding--;
+    }
+    pthread_cond_broadcast(&prefetcher->ready);
+    pthread_mutex_unlock(&prefetcher->lock);
+    return readerThread(prefetcher);
+}
+#endif
+
+int openPrefetcher(Prefetcher *prefetcher, const Manifest *manifest, const char *image_dir, int depth) {
+    memset(prefetcher, 0, sizeof(*prefetcher));
+    prefetcher->manifest = manifest;
+    prefetcher->image_dir = image_dir;
+    prefetcher->depth = depth;
+    prefetcher->entries = (PrefetchEntry *)calloc(manifest->count > 0 ? manifest->count : 1, sizeof(PrefetchEntry));
+    if (!prefetcher->entries) return -1;
+    prefetcher->timing.name = "prefetch";
+    prefetcher->timing.capacity = depth;
+    pthread_mutex_init(&prefetcher->lock, NULL);
+    pthread_cond_init(&prefetcher->work, NULL);
+    pthread_cond_init(&prefetcher->ready, NULL);
+
+#if USE_IO_URING
+    prefetcher->ring = openRing(depth * PREFETCH_MAX_LANES);
+    if (prefetcher->ring && pthread_create(&prefetcher->threads[0], NULL, ringThread, prefetcher) == 0) {
+        prefetcher->num_threads = 1;
+        return 0;
+    }
+    if (prefetcher->ring) closeRing(prefetcher->ring);
+    prefetcher->ring = NULL;
+#endif
+    int threads = depth < PREFETCH_MAX_THREADS ? depth : PREFETCH_MAX_THREADS;
+    while (prefetcher->num_threads < threads &&
+           pthread_create(&prefetcher->threads[prefetcher->num_threads], NULL, readerThread, prefetcher) == 0)
+        prefetcher->num_threads++;
+    if (prefetcher->num_threads > 0) return 0;
+
+    closePrefetcher(prefetcher, NULL);
+    return -1;
+}
+
+void prefetchLane(Prefetcher *prefetcher, int lane, const int *images, int count) {
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->lanes[lane].images = images;
+    prefetcher->lanes[lane].count = count;
+    prefetcher->lanes[lane].next = 0;
+    if (lane >= prefetcher->num_lanes) prefetcher->num_lanes = lane + 1;
+    pthread_cond_broadcast(&prefetcher->work);
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+unsigned char *prefetchTake(Prefetcher *prefetcher, int image, size_t *size, RunReport *report, int thread) {
+    PrefetchEntry *entry = &prefetcher->entries[image];
+    unsigned char *data = NULL;
+    double wait_seconds = 0.0;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    if (entry->state == PREFETCH_IDLE) {
+        entry->state = PREFETCH_TAKEN;
+        prefetcher->own_reads++;
+    } else if (entry->state != PREFETCH_TAKEN) {
+        if (entry->state == PREFETCH_READING) {
+            double start_time = wallClockSeconds();
+            prefetcher->timing.empty_waits++;
+            while (entry->state == PREFETCH_READING) pthread_cond_wait(&prefetcher->ready, &prefetcher->lock);
+            wait_seconds = wallClockSeconds() - start_time;
+        }
+        // A read the ring dropped is back to idle: the worker reads the image
+        if (entry->state == PREFETCH_IDLE) prefetcher->own_reads++;
+        if (entry->state == PREFETCH_READY) {
+            data = entry->data;
+            *size = entry->size;
+            entry->data = NULL;
+            prefetcher->lanes[entry->lane].outstanding--;
+            pthread_cond_broadcast(&prefetcher->work);
+        }
+        entry->state = PREFETCH_TAKEN;
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    if (data) {
+        runReportStage(report, image, thread, STAGE_READ, wait_seconds);
+        runReportBytes(report, image, thread, *size, 0);
+    }
+    return data;
+}
+
+void closePrefetcher(Prefetcher *prefetcher, RunReport *report) {
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->stopping = 1;
+    pthread_cond_broadcast(&prefetcher->work);
+    pthread_mutex_unlock(&prefetcher->lock);
+    for (int t = 0; t < prefetcher->num_threads; t++) pthread_join(prefetcher->threads[t], NULL);
+#if USE_IO_URING
+    if (prefetcher->ring) closeRing(prefetcher->ring);
+#endif
+    prefetcher->ring = NULL;
+    prefetcher->num_threads = 0;
+
+    for (int n = 0; prefetcher->entries && n < prefetcher->manifest->count; n++) free(prefetcher->entries[n].data);
+    free(prefetcher->entries);
+    prefetcher->entries = NULL;
+    pthread_cond_destroy(&prefetcher->ready);
+    pthread_cond_destroy(&prefetcher->work);
+    pthread_mutex_destroy(&prefetcher->lock);
+
+    QueueTiming *timing = &prefetcher->timing;
+    if (timing->pushes > 0) timing->mean_depth = prefetcher->ready_sum / timing->pushes;
+    if (report) runReportQueue(report, timing);
+}
+
+const char *prefetchMethod(const Prefetcher *prefetcher) {
+    return prefetcher->ring ? "io_uring" : "threads";
+}
@@ -0,0 +1,93 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "manifest_loader.h"
+#include "run_report.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads dataset images ahead of the threads that decode and filter them, so
+// that on a high-latency filesystem no worker waits on an open or read. The
+// images are read in the order of one or more lanes (the driver's queue, or
+// each backend's static share), keeping up to depth reads in flight or waiting
+// per lane. Encoded files are read whole into memory and handed to the worker
+// that loads the image (loadInputImage decodes them from memory); for images
+// with a converted raw copy the kernel is told to read the copy ahead, and the
+// worker maps it as usual. An image a worker asks for before its read was
+// started is read by the worker itself.
+//
+// On Linux the reads go through one io_uring driven by a single thread
+// (-DUSE_IO_URING=0 to leave it out); elsewhere, or when the kernel refuses
+// io_uring, a pool of reader threads does blocking reads instead.
+
+#ifndef USE_IO_URING
+#ifdef __linux__
+#define USE_IO_URING 1
+#else
+#define USE_IO_URING 0
+#endif
+#endif
+
+#define PREFETCH_DEPTH 16          // Default --prefetch: reads ahead of each lane
+#define PREFETCH_MAX_LANES 4
+#define PREFETCH_MAX_THREADS 16    // Reader threads without io_uring
+
+typedef struct PrefetchEntry PrefetchEntry;
+typedef struct PrefetchRing PrefetchRing;
+
+typedef struct {
+    const int *images;  // Manifest indices in the order they will be loaded
+    int count;
+    int next;           // First image not handed to a reader yet
+    int outstanding;    // Images handed to a reader and not taken by a worker
+} PrefetchLane;
+
+typedef struct Prefetcher {
+    const Manifest *manifest;
+    const char *image_dir;
+    int depth;
+    PrefetchEntry *entries;         // One per manifest image
+    PrefetchLane lanes[PREFETCH_MAX_LANES];
+    int num_lanes;
+    int next_lane;                  // Lane to look at first, so lanes take turns
+    pthread_mutex_t lock;
+    pthread_cond_t work;            // Readers: an image to read, or stopping
+    pthread_cond_t ready;           // Workers: a read finished
+    int stopping;
+    PrefetchRing *ring;             // NULL when reading with threads
+    pthread_t threads[PREFETCH_MAX_THREADS];
+    int num_threads;
+    QueueTiming timing;             // Reads ahead (pushes), waits and how far ahead they got
+    long own_reads;                 // Images workers had to read themselves
+    double ready_sum;
+} Prefetcher;
+
+// Start reading up to depth images ahead of every lane. Returns 0 on success.
+int openPrefetcher(Prefetcher *prefetcher, const Manifest *manifest, const char *image_dir, int depth);
+
+// Set the images of lane (0..PREFETCH_MAX_LANES-1), replacing what it held;
+// images already read stay available until they are taken.
+void prefetchLane(Prefetcher *prefetcher, int lane, const int *images, int count);
+
+// The file read ahead for image, or NULL if there is none (its read was
+// never started, failed, or found a raw copy): the caller then reads the
+// image itself. Waits for a read in flight, recording the wait and the bytes
+// read as the read stage of image. The buffer is the caller's to free().
+unsigned char *prefetchTake(Prefetcher *prefetcher, int image, size_t *size, RunReport *report, int thread);
+
+// Stop the readers and free what was read but never taken; records the
+// prefetch queue in report unless it is NULL
+void closePrefetcher(Prefetcher *prefetcher, RunReport *report);
+
+// "io_uring" or "threads"
+const char *prefetchMethod(const Prefetcher *prefetcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,303 @@
+#include "run_report.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const char *stage_names[NUM_STAGES] = {"read", "decode", "filter", "resize", "encode"};
+
+double wallClockSeconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+int initRunReport(RunReport *report, const char *program, const Manifest *manifest, int num_threads) {
+    memset(report, 0, sizeof(*report));
+    report->program = program;
+    report->mode = "";
+    report->decoders = "";
+    report->encoder = "";
+    report->manifest = manifest;
+    report->num_threads = num_threads > 0 ? num_threads : 1;
+    report->images = (ImageTiming *)calloc(manifest->count > 0 ? manifest->count : 1, sizeof(ImageTiming));
+    report->threads = (ThreadTiming *)calloc(report->num_threads, sizeof(ThreadTiming));
+    if (!report->images || !report->threads) {
+        freeRunReport(report);
+        return -1;
+    }
+    for (int n = 0; n < manifest->count; n++) report->images[n].thread = -1;
+    report->start_time = wallClockSeconds();
+    report->next_progress = report->start_time;
+    return 0;
+}
+
+void freeRunReport(RunReport *report) {
+    free(report->images);
+    free(report->threads);
+    free(report->ranks);
+    report->images = NULL;
+    report->threads = NULL;
+    report->ranks = NULL;
+}
+
+void runReportStage(RunReport *report, int image, int thread, RunStage stage, double seconds) {
+    report->images[image].seconds[stage] += seconds;
+    report->threads[thread].seconds[stage] += seconds;
+}
+
+void runReportBytes(RunReport *report, int image, int thread, size_t bytes_read, size_t bytes_written) {
+    report->images[image].bytes_read += bytes_read;
+    report->images[image].bytes_written += bytes_written;
+    report->threads[thread].bytes_read += bytes_read;
+    report->threads[thread].bytes_written += bytes_written;
+}
+
+void runReportImageDone(RunReport *report, int image, int thread, int written) {
+    report->images[image].thread = thread;
+    report->images[image].status = written ? 1 : -1;
+    if (written) report->threads[thread].images++;
+}
+
+void runReportQueue(RunReport *report, const QueueTiming *queue) {
+    // Backends that run once per chunk of images report the same queues every time
+    for (int q = 0; q < report->num_queues; q++) {
+        QueueTiming *merged = &report->queues[q];
+        if (strcmp(merged->name, queue->name) != 0) continue;
+
+        long pushes = merged->pushes + queue->pushes;
+        if (pushes > 0)
+            merged->mean_depth = (merged->mean_depth * merged->pushes + queue->mean_depth * queue->pushes) / pushes;
+        merged->pushes = pushes;
+        if (queue->max_depth > merged->max_depth) merged->max_depth = queue->max_depth;
+        merged->full_waits += queue->full_waits;
+        merged->empty_waits += queue->empty_waits;
+        return;
+    }
+    if (report->num_queues < RUN_REPORT_MAX_QUEUES) report->queues[report->num_queues++] = *queue;
+}
+
+void runReportBackend(RunReport *report, const BackendTiming *backend) {
+    if (report->num_backends < RUN_REPORT_MAX_BACKENDS) report->backends[report->num_backends++] = *backend;
+}
+
+unsigned char *readFileTimed(RunReport *report, int image, int thread, const char *path, size_t *size) {
+    double start_time = wallClockSeconds();
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    unsigned char *data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) length = ftell(file);
+    if (length > 0 && fseek(file, 0, SEEK_SET) == 0) data = (unsigned char *)malloc(length);
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    if (data) {
+        *size = (size_t)length;
+        runReportStage(report, image, thread, STAGE_READ, wallClockSeconds() - start_time);
+        runReportBytes(report, image, thread, *size, 0);
+    }
+    return data;
+}
+
+int progressRefreshDue(RunReport *report) {
+    double now = wallClockSeconds();
+    int due = 0;
+
+    // Cheap unsynchronized check first; only callers past the deadline contend
+    double next;
+    #pragma omp atomic read
+    next = report->next_progress;
+    if (now < next) return 0;
+
+    #pragma omp critical (progress_refresh)
+    {
+        if (now >= report->next_progress) {
+            #pragma omp atomic write
+            report->next_progress = now + PROGRESS_REFRESH_SECONDS;
+            due = 1;
+        }
+    }
+    return due;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Median, p95 and max (ms) of one stage over the processed images
+static void stageDistribution(const RunReport *report, RunStage stage, double *p50, double *p95, double *max) {
+    int count = report->manifest->count;
+    double *samples = (double *)malloc((count > 0 ? count : 1) * sizeof(double));
+    int n = 0;
+
+    *p50 = *p95 = *max = 0.0;
+    if (!samples) return;
+    for (int i = 0; i < count; i++)
+        if (report->images[i].status != 0) samples[n++] = report->images[i].seconds[stage] * 1e3;
+    if (n > 0) {
+        qsort(samples, n, sizeof(double), compareDoubles);
+        *p50 = samples[(int)ceil(0.5 * n) - 1];
+        *p95 = samples[(int)ceil(0.95 * n) - 1];
+        *max = samples[n - 1];
+    }
+    free(samples);
+}
+
+static void totals(const RunReport *report, double *seconds, size_t *bytes_read, size_t *bytes_written) {
+    memset(seconds, 0, NUM_STAGES * sizeof(double));
+    *bytes_read = *bytes_written = 0;
+    for (int t = 0; t < report->num_threads; t++) {
+        for (int s = 0; s < NUM_STAGES; s++) seconds[s] += report->threads[t].seconds[s];
+        *bytes_read += report->threads[t].bytes_read;
+        *bytes_written += report->threads[t].bytes_written;
+    }
+}
+
+void printRunSummary(const RunReport *report) {
+    double seconds[NUM_STAGES];
+    size_t bytes_read, bytes_written;
+    totals(report, seconds, &bytes_read, &bytes_written);
+
+    printf("Stage time (summed over threads):");
+    for (int s = 0; s < NUM_STAGES; s++) printf(" %s %.3f s%s", stage_names[s], seconds[s], s + 1 < NUM_STAGES ? "," : "\n");
+    printf("Read %.1f MB, wrote %.1f MB\n", bytes_read / 1e6, bytes_written / 1e6);
+}
+
+void writeJsonString(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const char *p = text; *p; p++) {
+        if (*p == '"' || *p == '\\') fprintf(file, "\\%c", *p);
+        else if ((unsigned char)*p < 0x20) fprintf(file, "\\u%04x", *p);
+        else fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+int writeRunReport(const RunReport *report, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Could not write run report: %s\n", path);
+        return -1;
+    }
+
+    double seconds[NUM_STAGES];
+    size_t bytes_read, bytes_written;
+    int written = 0, failed = 0, skipped = 0;
+    totals(report, seconds, &bytes_read, &bytes_written);
+    for (int i = 0; i < report->manifest->count; i++) {
+        if (report->images[i].status > 0) written++;
+        else if (report->images[i].status < 0) failed++;
+        else skipped++;
+    }
+
+    fprintf(file, "{\n  \"program\": ");
+    writeJsonString(file, report->program);
+    fprintf(file, ",\n  \"mode\": ");
+    writeJsonString(file, report->mode);
+    fprintf(file, ",\n  \"codecs\": {\"decode\": ");
+    writeJsonString(file, report->decoders);
+    fprintf(file, ", \"encode\": ");
+    writeJsonString(file, report->encoder);
+    fprintf(file, "},\n  \"wall_seconds\": %.6f,\n", wallClockSeconds() - report->start_time);
+    fprintf(file, "  \"images\": {\"total\": %d, \"written\": %d, \"failed\": %d, \"skipped\": %d},\n",
+            report->manifest->count, written, failed, skipped);
+    fprintf(file, "  \"bytes_read\": %zu,\n  \"bytes_written\": %zu,\n", bytes_read, bytes_written);
+
+    fprintf(file, "  \"stages\": {\n");
+    for (int s = 0; s < NUM_STAGES; s++) {
+        double p50, p95, max;
+        stageDistribution(report, (RunStage)s, &p50, &p95, &max);
+        fprintf(file, "    \"%s\": {\"total_seconds\": %.6f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+                stage_names[s], seconds[s], p50, p95, max, s + 1 < NUM_STAGES ? "," : "");
+    }
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"threads\": [\n");
+    for (int t = 0; t < report->num_threads; t++) {
+        const ThreadTiming *thread = &report->threads[t];
+        fprintf(file, "    {\"thread\": %d, \"images\": %ld, \"bytes_read\": %zu, \"bytes_written\": %zu",
+                t, thread->images, thread->bytes_read, thread->bytes_written);
+        for (int s = 0; s < NUM_STAGES; s++) fprintf(file, ", \"%s_seconds\": %.6f", stage_names[s], thread->seconds[s]);
+        fprintf(file, "}%s\n", t + 1 < report->num_threads ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"queues\": [\n");
+    for (int q = 0; q < report->num_queues; q++) {
+        const QueueTiming *queue = &report->queues[q];
+        fprintf(file, "    {\"name\": ");
+        writeJsonString(file, queue->name);
+        fprintf(file, ", \"capacity\": %d, \"max_depth\": %d, \"mean_depth\": %.3f, "
+                      "\"full_waits\": %ld, \"empty_waits\": %ld}%s\n",
+                queue->capacity, queue->max_depth, queue->mean_depth, queue->full_waits, queue->empty_waits,
+                q + 1 < report->num_queues ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"backends\": [\n");
+    for (int b = 0; b < report->num_backends; b++) {
+        const BackendTiming *backend = &report->backends[b];
+        fprintf(file, "    {\"name\": ");
+        writeJsonString(file, backend->name);
+        fprintf(file, ", \"mode\": ");
+        writeJsonString(file, backend->mode);
+        fprintf(file, ", \"first_thread\": %d, \"threads\": %d, \"images\": %d, \"written\": %d, "
+                      "\"chunks\": %d, \"busy_seconds\": %.6f, \"images_per_second\": %.3f}%s\n",
+                backend->first_thread, backend->num_threads, backend->images, backend->written, backend->chunks,
+                backend->busy_seconds, backend->busy_seconds > 0 ? backend->images / backend->busy_seconds : 0.0,
+                b + 1 < report->num_backends ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"ranks\": [\n");
+    for (int r = 0; r < report->num_ranks; r++) {
+        const RankTiming *rank = &report->ranks[r];
+        fprintf(file, "    {\"rank\": %d, \"host\": ", rank->rank);
+        writeJsonString(file, rank->host);
+        fprintf(file, ", \"program\": ");
+        writeJsonString(file, rank->program);
+        fprintf(file, ", \"mode\": ");
+        writeJsonString(file, rank->mode);
+        fprintf(file, ", \"threads\": %d, \"images\": %d, \"written\": %d, \"failed\": %d, "
+                      "\"wall_seconds\": %.6f, \"images_per_second\": %.3f}%s\n",
+                rank->threads, rank->images, rank->written, rank->failed, rank->wall_seconds,
+                rank->wall_seconds > 0 ? rank->images / rank->wall_seconds : 0.0, r + 1 < report->num_ranks ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"per_image\": [\n");
+    for (int i = 0; i < report->manifest->count; i++) {
+        const ImageTiming *image = &report->images[i];
+        fprintf(file, "    {\"file\": ");
+        writeJsonString(file, report->manifest->images[i].file_name);
+        fprintf(file, ", \"status\": \"%s\", \"thread\": %d, \"bytes_read\": %zu, \"bytes_written\": %zu",
+                image->status > 0 ? "written" : (image->status < 0 ? "failed" : "skipped"),
+                image->thread, image->bytes_read, image->bytes_written);
+        for (int s = 0; s < NUM_STAGES; s++) fprintf(file, ", \"%s_ms\": %.4f", stage_names[s], image->seconds[s] * 1e3);
+        fprintf(file, "}%s\n", i + 1 < report->manifest->count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    int ok = fclose(file) == 0;
+    if (!ok) printf("Could not write run report: %s\n", path);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,137 @@
+#ifndef RUN_REPORT_H
+#define RUN_REPORT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "manifest_loader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Per-image, per-stage telemetry for a dataset run. Every image has its own
+// record, written only by the thread working on that stage of it, and every
+// thread has its own cache-line padded totals, so the hot path takes no locks:
+// a stage costs two clock reads and a few stores. The records are summarized
+// on the console at the end of the run and, with --report FILE, written out as
+// a JSON run report together with byte counters and pipeline queue depths.
+
+#define PROGRESS_REFRESH_SECONDS 0.2  // Progress bar redraw interval
+#define RUN_REPORT_MAX_QUEUES 4
+#define RUN_REPORT_MAX_BACKENDS 4
+
+typedef enum {
+    STAGE_READ,     // File I/O (or mapping a raw file)
+    STAGE_DECODE,
+    STAGE_FILTER,
+    STAGE_RESIZE,   // Scaling to the --resize size, when one is given
+    STAGE_ENCODE,   // Encoding and writing the output
+    NUM_STAGES
+} RunStage;
+
+typedef struct {
+    double seconds[NUM_STAGES];
+    size_t bytes_read;
+    size_t bytes_written;
+    int thread;     // Thread that wrote the image, -1 if it never got there
+    int status;     // 0 not processed, 1 written, -1 failed
+} ImageTiming;
+
+typedef struct {
+    double seconds[NUM_STAGES];
+    long images;
+    size_t bytes_read;
+    size_t bytes_written;
+    char pad[64];   // Keep neighbouring threads' totals off each other's cache lines
+} ThreadTiming;
+
+typedef struct {
+    const char *name;
+    int capacity;
+    int max_depth;
+    double mean_depth;  // Average depth seen by pushes
+    long pushes;
+    long full_waits;    // Pushes that blocked on a full queue
+    long empty_waits;   // Pops that blocked on an empty queue
+} QueueTiming;
+
+// One backend of the run and the images the scheduler gave it
+typedef struct {
+    const char *name;
+    const char *mode;
+    int first_thread;   // Its threads in the per-thread totals
+    int num_threads;
+    int images;         // Images handed to it
+    int written;
+    int chunks;         // Pieces the images came in (1 for a static share)
+    double busy_seconds;
+} BackendTiming;
+
+// One process of a multi-node run (see cluster.h)
+typedef struct {
+    int rank;
+    char host[64];
+    char program[64];   // Its backends and their modes
+    char mode[64];
+    int threads;        // Its threads in the per-thread totals, after those of the ranks before it
+    int images;         // Images it processed
+    int written;
+    int failed;
+    double wall_seconds;
+} RankTiming;
+
+typedef struct {
+    const char *program;
+    const char *mode;
+    const char *decoders;   // Image codecs of the run (codec.h)
+    const char *encoder;
+    const Manifest *manifest;
+    ImageTiming *images;
+    int num_threads;
+    ThreadTiming *threads;
+    QueueTiming queues[RUN_REPORT_MAX_QUEUES];
+    int num_queues;
+    BackendTiming backends[RUN_REPORT_MAX_BACKENDS];
+    int num_backends;
+    RankTiming *ranks;  // Filled on rank 0 by clusterGatherReport, NULL otherwise
+    int num_ranks;
+    double start_time;
+    double next_progress;
+} RunReport;
+
+// Monotonic wall-clock time in seconds
+double wallClockSeconds(void);
+
+// Set up records for every image of the manifest and num_threads threads. Returns 0 on success.
+int initRunReport(RunReport *report, const char *program, const Manifest *manifest, int num_threads);
+void freeRunReport(RunReport *report);
+
+// Add time spent by thread on one stage of image
+void runReportStage(RunReport *report, int image, int thread, RunStage stage, double seconds);
+void runReportBytes(RunReport *report, int image, int thread, size_t bytes_read, size_t bytes_written);
+void runReportImageDone(RunReport *report, int image, int thread, int written);
+// Record a queue's depth statistics; a queue reported again under the same name is merged
+void runReportQueue(RunReport *report, const QueueTiming *queue);
+void runReportBackend(RunReport *report, const BackendTiming *backend);
+
+// Read a whole file into a malloc'd buffer, recording it as the read stage of image.
+// Returns NULL if the file cannot be read.
+unsigned char *readFileTimed(RunReport *report, int image, int thread, const char *path, size_t *size);
+
+// 1 if the progress bar is due for a redraw; at most one caller per interval gets 1
+int progressRefreshDue(RunReport *report);
+
+// Per-stage totals on stdout
+void printRunSummary(const RunReport *report);
+
+// JSON run report. Returns 0 on success.
+int writeRunReport(const RunReport *report, const char *path);
+
+// Write text as a quoted JSON string
+void writeJsonString(FILE *file, const char *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
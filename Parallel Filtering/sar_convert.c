@@ -0,0 +1,77 @@
+// One-time converter from the dataset's PNG/JPEG images to the raw container
+// (sar_raw.h). Every image listed in the annotation file is decoded to
+// grayscale, 16-bit for 16-bit sources and 8-bit otherwise, and written as
+// <output_dir>/<file_name>.sarraw. With output_dir left at the image directory,
+// the filter binaries pick the raw copies up automatically.
+//
+// Usage: sar_convert <annotations.json> <image_dir> [output_dir] [--tile W H]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "manifest_loader.h"
+#include "sar_raw.h"
+
+int main(int argc, char **argv) {
+    const char *json_path = NULL, *image_dir = NULL, *output_dir = NULL;
+    int tile_width = 0, tile_height = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tile") == 0 && i + 2 < argc) {
+            tile_width = atoi(argv[++i]);
+            tile_height = atoi(argv[++i]);
+        } else if (!json_path) {
+            json_path = argv[i];
+        } else if (!image_dir) {
+            image_dir = argv[i];
+        } else if (!output_dir) {
+            output_dir = argv[i];
+        } else {
+            json_path = NULL;
+            break;
+        }
+    }
+    if (!json_path || !image_dir) {
+        fprintf(stderr, "Usage: %s <annotations.json> <image_dir> [output_dir] [--tile W H]\n", argv[0]);
+        return 1;
+    }
+    if (!output_dir) output_dir = image_dir;
+
+    Manifest manifest;
+    if (loadManifest(json_path, MANIFEST_CACHE, &manifest) != 0) return 1;
+
+    clock_t start = clock();
+    int total_images = manifest.count;
+    int converted = 0;
+
+    for (int n = 0; n < manifest.count; n++) {
+        char image_path[512];
+        char raw_path[512];
+
+        sprintf(image_path, "%s/%s", image_dir, manifest.images[n].file_name);
+        sprintf(raw_path, "%s/%s%s", output_dir, manifest.images[n].file_name, SAR_RAW_EXTENSION);
+
+        // 16-bit sources keep their full precision
+        int width, height, channels;
+        int dtype = stbi_is_16_bit(image_path) ? PIXEL_U16 : PIXEL_U8;
+        void *image_data = dtype == PIXEL_U16
+            ? (void *)stbi_load_16(image_path, &width, &height, &channels, STBI_grey)
+            : (void *)stbi_load(image_path, &width, &height, &channels, STBI_grey);
+        if (!image_data) {
+            printf("Could not read image: %s\n", image_path);
+            continue;
+        }
+        if (sarRawWrite(raw_path, image_data, width, height, dtype, tile_width, tile_height) == 0)
+            converted++;
+        stbi_image_free(image_data);
+    }
+    freeManifest(&manifest);
+
+    printf("Converted %d of %d images in %.3f seconds\n", converted, total_images,
+           ((double)(clock() - start)) / CLOCKS_PER_SEC);
+    return converted == total_images ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+// Command-line driver for every filter backend. The backend is picked at
+// runtime (--backend auto, the default) or named, and several backends can
+// share one dataset: --backend openmp,cuda (or --backend all) runs both at the
+// same time, each pulling images from a shared queue at its own pace, while
+// --split 1,3 fixes the GPU's part at three quarters of the images instead.
+// Built with mpicc and -DUSE_MPI=1 it also runs under mpirun, one process per
+// node, each with its own backends on its part of the manifest (cluster.h).
+// With --serve DIR it keeps running, with its backends prepared, and processes
+// the jobs put in a queue directory (service.h).
+//
+// Build (add -DUSE_CUDA=1, filter_apply_cuda.cu compiled with nvcc and -lcudart for the CUDA backend):
+//   gcc -O2 -fopenmp -o sar_filter sar_filter.c backend.c filter_apply.c filter_apply_parallel.c
+//       image_io.c buffer_pool.c journal.c filter_chain.c manifest_loader.c sar_raw.c output_format.c
+//       run_report.c benchmark.c cluster.c scene_stream.c prefetch.c codec.c service.c -lm -lpthread
+// (add -DUSE_LIBJPEG=1 -ljpeg and -DUSE_LIBPNG=1 -lpng for the library codecs, see codec.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "backend.h"
+#include "benchmark.h"
+#include "buffer_pool.h"
+#include "scene_stream.h"
+#include "pixel_type.h"
+#include "codec.h"
+#include "service.h"
+
+// Benchmark entry point: the backend's prepared chain on one frame
+static void benchFrame(const unsigned char *src, unsigned char *dst, int width, int height, void *context) {
+    ((const FilterBackend *)context)->filter_frame(src, dst, width, height, PIXEL_U8);
+}
+
+// Parse --split W[,W...]: the relative share of the images of each backend, in --backend order.
+// Returns the number of weights, or 0 if the list is invalid.
+static int parseSplit(const char *text, double *weights) {
+    int count = 0;
+    const char *p = text;
+    for (;;) {
+        char *end;
+        double weight = strtod(p, &end);
+        if (end == p || weight < 0 || count == MAX_BACKENDS) return 0;
+        weights[count++] = weight;
+        if (*end == '\0') break;
+        if (*end != ',') return 0;
+        p = end + 1;
+    }
+
+    double total = 0.0;
+    for (int i = 0; i < count; i++) total += weights[i];
+    return total > 0 ? count : 0;
+}
+
+// What one run processes and with which backends: the command line's, or a service job's
+typedef struct {
+    DatasetOptions options;
+    const char *backend_list;
+    double weights[MAX_BACKENDS];
+    int num_weights;
+} DatasetRun;
+
+// Parse a dataset, chain or backend selection option at argv[*i] like parseBenchOption:
+// 1 if used, 0 if not (or its value is invalid), -1 if an invalid chain option
+//
+// --backend LIST: backends to run ("auto" picks one for the hardware and frame sizes, "all" uses every one)
+// --split W,...: fixed relative share of the images per backend instead of the shared queue
+// --json FILE, --images DIR, --output DIR: dataset manifest, input and output folders
+// --files A[,B...]: these images of the input folder instead of the manifest's
+// --chain SPEC, --chain-file FILE: filter stages to run (see filter_chain.h)
+// --format auto|png|png:LEVEL|pgm|raw: how the filtered images are written
+// --resize WxH: scale the filtered images to W x H before encoding (0 on one side keeps the aspect ratio)
+// --report FILE: write a JSON run report with per-image stage timings and queue depths
+// --incremental mtime|hash: skip images the output directory's journal has current outputs for
+// --shard dynamic|block: how the ranks of an MPI run split the images
+// --stream-above MB: filter raw scenes of at least MB megabytes band by band (0 = never)
+// --band-rows N: rows per band of a streamed scene
+// --prefetch N: images to read ahead of each backend (0 = none)
+static int parseDatasetOption(int argc, char **argv, int *i, DatasetRun *run) {
+    DatasetOptions *options = &run->options;
+    int parsed = parseChainOption(argc, argv, i, &options->chain);
+    if (parsed != 0) return parsed;
+    if (*i + 1 >= argc) return 0;
+
+    const char *option = argv[*i], *value = argv[*i + 1];
+    if (strcmp(option, "--backend") == 0) {
+        run->backend_list = value;
+    } else if (strcmp(option, "--split") == 0) {
+        if ((run->num_weights = parseSplit(value, run->weights)) == 0) return 0;
+    } else if (strcmp(option, "--format") == 0) {
+        if (parseOutputFormat(value, &options->output) != 0) return 0;
+    } else if (strcmp(option, "--resize") == 0) {
+        if (parseResize(value, &options->output) != 0) return 0;
+    } else if (strcmp(option, "--incremental") == 0) {
+        if (parseJournalMode(value, &options->incremental) != 0) return 0;
+    } else if (strcmp(option, "--shard") == 0) {
+        if (parseShardMode(value, &options->shard) != 0) return 0;
+    } else if (strcmp(option, "--stream-above") == 0) {
+        if (atof(value) < 0) return 0;
+        options->stream_above = (long long)(atof(value) * 1024 * 1024);
+    } else if (strcmp(option, "--band-rows") == 0) {
+        if (atoi(value) <= 0) return 0;
+        options->band_rows = atoi(value);
+    } else if (strcmp(option, "--prefetch") == 0) {
+        if (atoi(value) < 0) return 0;
+        options->prefetch_depth = atoi(value);
+    } else if (strcmp(option, "--report") == 0) {
+        options->report_path = value;
+    } else if (strcmp(option, "--json") == 0) {
+        options->json_path = value;
+    } else if (strcmp(option, "--files") == 0) {
+        options->file_list = value;
+    } else if (strcmp(option, "--images") == 0) {
+        options->image_dir = value;
+    } else if (strcmp(option, "--output") == 0) {
+        options->output_dir = value;
+    } else {
+        return 0;
+    }
+    ++*i;
+    return 1;
+}
+
+static void printUsage(const char *program) {
+    const FilterBackend *backends[MAX_BACKENDS];
+    int count = listBackends(backends);
+
+    fprintf(stderr, "Usage: %s [--backend auto|all|NAME[,NAME...]] [--split W[,W...]] [--list-backends]\n"
+                    "    --json FILE|--files A[,B...] --images DIR --output DIR %s\n"
+                    "    [--format auto|png|png:LEVEL|pgm|raw] [--resize WxH] [--report FILE]\n"
+                    "    [--incremental mtime|hash] [--shard dynamic|block] [--stream-above MB] [--band-rows N]\n"
+                    "    [--prefetch N] [--serve DIR]\n    %s\n",
+            program, FILTER_CHAIN_OPTIONS, benchUsage());
+    for (int b = 0; b < count; b++)
+        if (backends[b]->usage[0]) fprintf(stderr, "    %s: %s\n", backends[b]->name, backends[b]->usage);
+}
+
+static void printBackends(void) {
+    const FilterBackend *backends[MAX_BACKENDS];
+    int count = listBackends(backends);
+    for (int b = 0; b < count; b++)
+        printf("%-8s %s\n", backends[b]->name, backends[b]->available() ? "available" : "not available");
+}
+
+// 1 if the run has its images and somewhere to write them: the paths have no defaults
+static int hasDatasetPaths(const DatasetOptions *options) {
+    if ((options->json_path || options->file_list) && options->image_dir && options->output_dir) return 1;
+    printf("Filtering needs --json FILE (or --files A[,B...]), --images DIR and --output DIR\n");
+    return 0;
+}
+
+// What a run filters and the chain and output settings it starts with
+static void printRunSettings(const DatasetOptions *options) {
+    char chain_text[512];
+    formatFilterChain(&options->chain, chain_text, sizeof(chain_text));
+    printf("Filtering %s from %s into %s\n", options->file_list ? options->file_list : options->json_path,
+           options->image_dir, options->output_dir);
+    printf("Filter chain: %s\n", chain_text);
+    printf("Output format: %s\n", outputFormatName(&options->output));
+    if (options->output.resize_width || options->output.resize_height)
+        printf("Output size: %dx%d\n", options->output.resize_width, options->output.resize_height);
+}
+
+// Service job: the service's own command line with the job's options on top
+static int runJob(int argc, char **argv, void *context) {
+    DatasetRun job = *(const DatasetRun *)context;
+    for (int i = 0; i < argc; i++) {
+        if (parseDatasetOption(argc, argv, &i, &job) != 1) {
+            printf("Invalid job option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    if (!hasDatasetPaths(&job.options)) return -1;
+    printRunSettings(&job.options);
+    return processDataset(&job.options, job.backend_list, job.weights, job.num_weights);
+}
+
+static int run(int argc, char **argv) {
+    DatasetRun dataset;
+    DatasetOptions *options = &dataset.options;
+    const char *serve_dir = NULL;
+    char chain_text[512];
+    BenchOptions bench;
+    const FilterBackend *backends[MAX_BACKENDS];
+    int num_compiled = listBackends(backends);
+
+    memset(&dataset, 0, sizeof(dataset));
+    dataset.backend_list = "auto";
+    defaultFilterChain(&options->chain);
+    parseOutputFormat("auto", &options->output);
+    options->stream_above = STREAM_ABOVE_BYTES;
+    options->prefetch_depth = PREFETCH_DEPTH;
+    initBenchOptions(&bench);
+
+    // Dataset and chain options: see parseDatasetOption
+    // --serve DIR: keep running and process the jobs of a queue directory (service.h)
+    // --bench...: time the filter chain instead of processing the dataset
+    // Backend options (--mode, --batch, ...) are handed to every compiled backend
+    for (int i = 1; i < argc; i++) {
+        int parsed = parseBenchOption(argc, argv, &i, &bench);
+        for (int b = 0; parsed == 0 && b < num_compiled; b++) parsed = backends[b]->parse_option(argc, argv, &i);
+        if (parsed == 0) parsed = parseDatasetOption(argc, argv, &i, &dataset);
+        if (parsed == 1) continue;
+        if (parsed == 0 && strcmp(argv[i], "--list-backends") == 0) {
+            printBackends();
+            return 0;
+        } else if (parsed == 0 && strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_dir = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    formatFilterChain(&options->chain, chain_text, sizeof(chain_text));
+
+    if (bench.enabled) {
+        // Every listed backend is benchmarked in turn on the same frames and
+        // checked against the serial filters, which implement every chain
+        const FilterBackend *selected[MAX_BACKENDS];
+        int num_selected = parseBackendList(dataset.backend_list, &options->chain, NULL, selected);
+        int status = num_selected > 0 ? 0 : 1;
+        printf("Filter chain: %s\n", chain_text);
+
+        for (int b = 0; b < num_selected; b++) {
+            const FilterBackend *backend = selected[b];
+            if (backend->prepare(&options->chain) <= 0) {
+                status = 1;
+                continue;
+            }
+            serial_backend.prepare(&options->chain);
+            BenchBackend bench_backend = {backend->name, benchFrame, (void *)backend, benchFrame,
+                                          (void *)&serial_backend};
+            if (runBenchmark(&bench_backend, &bench, options->json_path, options->image_dir) != 0) status = 1;
+            backend->release();
+            if (backend != &serial_backend) serial_backend.release();
+        }
+        poolRelease();
+        return status;
+    }
+
+    if (serve_dir) {
+        printf("Codecs: decode %s, encode %s\n", decoderNames(), pngEncoder()->name);
+        return serveQueue(serve_dir, runJob, &dataset);
+    }
+
+    if (!hasDatasetPaths(options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    printRunSettings(options);
+    printf("Codecs: decode %s, encode %s\n", decoderNames(), pngEncoder()->name);
+
+    if (processDataset(options, dataset.backend_list, dataset.weights, dataset.num_weights) < 0) return 1;
+
+    printf("\nFiltering complete.\n");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    clusterInit(&argc, &argv);
+    int status = run(argc, argv);
+    clusterFinalize();
+    return status;
+}
@@ -0,0 +1,383 @@
+#include "sar_raw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// 64-bit file offsets on every platform (scenes can exceed 2 GB)
+#ifdef _WIN32
+#define seekFile _fseeki64
+#define tellFile _ftelli64
+#else
+#define seekFile fseeko
+#define tellFile ftello
+#endif
+
+// On-disk header, native byte order, padded to SAR_RAW_HEADER_SIZE
+typedef struct {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t dtype;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t reserved0;
+    uint64_t data_offset;
+    uint8_t reserved[24];
+} SarRawHeader;
+
+static size_t tileCount(int size, int tile_size) {
+    return ((size_t)size + tile_size - 1) / tile_size;
+}
+
+// Bytes of pixel data after the header, including padding in edge tiles
+static size_t dataSize(int width, int height, int dtype, int tile_width, int tile_height) {
+    size_t pixel_size = pixelSize(dtype);
+    if (tile_width > 0 && tile_height > 0)
+        return tileCount(width, tile_width) * tileCount(height, tile_height) *
+               (size_t)tile_width * tile_height * pixel_size;
+    return (size_t)width * height * pixel_size;
+}
+
+static void fillHeader(SarRawHeader *header, int width, int height, int dtype, int tile_width, int tile_height) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SAR_RAW_MAGIC, sizeof(header->magic));
+    header->width = (uint32_t)width;
+    header->height = (uint32_t)height;
+    header->dtype = (uint32_t)dtype;
+    header->tile_width = (uint32_t)tile_width;
+    header->tile_height = (uint32_t)tile_height;
+    header->data_offset = SAR_RAW_HEADER_SIZE;
+}
+
+// Map size bytes of path. writable creates/truncates the file and maps it shared;
+// otherwise the existing file is mapped copy-on-write.
+// Returns SAR_RAW_OK, SAR_RAW_MISSING or SAR_RAW_ERROR.
+static int mapFile(const char *path, size_t create_size, int writable, SarRawImage *image) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                              FILE_SHARE_READ, NULL, writable ? CREATE_ALWAYS : OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return GetLastError() == ERROR_FILE_NOT_FOUND && !writable ? SAR_RAW_MISSING : SAR_RAW_ERROR;
+
+    LARGE_INTEGER size;
+    if (writable) size.QuadPart = (LONGLONG)create_size;
+    else if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return SAR_RAW_ERROR;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_WRITECOPY,
+                                        size.HighPart, size.LowPart, NULL);
+    void *base = mapping ? MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, 0) : NULL;
+    if (!base) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return SAR_RAW_ERROR;
+    }
+    image->file_handle = file;
+    image->mapping_handle = mapping;
+    image->map_base = (unsigned char *)base;
+    image->map_size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0666);
+    if (fd < 0) return errno == ENOENT && !writable ? SAR_RAW_MISSING : SAR_RAW_ERROR;
+
+    size_t size = create_size;
+    if (writable) {
+        if (ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            return SAR_RAW_ERROR;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return SAR_RAW_ERROR;
+        }
+        size = (size_t)st.st_size;
+    }
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file referenced
+    if (base == MAP_FAILED) return SAR_RAW_ERROR;
+
+    image->map_base = (unsigned char *)base;
+    image->map_size = size;
+#endif
+    return SAR_RAW_OK;
+}
+
+static void unmapFile(SarRawImage *image) {
+    if (!image->map_base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(image->map_base);
+    CloseHandle((HANDLE)image->mapping_handle);
+    CloseHandle((HANDLE)image->file_handle);
+#else
+    munmap(image->map_base, image->map_size);
+#endif
+    image->map_base = NULL;
+}
+
+// Check a header read from a file of file_size bytes and take its geometry. Returns 0 if valid.
+static int readHeader(const SarRawHeader *header, size_t file_size, int *width, int *height, int *dtype,
+                      int *tile_width, int *tile_height) {
+    if (memcmp(header->magic, SAR_RAW_MAGIC, sizeof(header->magic)) != 0) return -1;
+    if (header->width == 0 || header->height == 0 || header->width > INT32_MAX || header->height > INT32_MAX) return -1;
+    if (pixelSize((int)header->dtype) == 0) return -1;
+    if ((header->tile_width == 0) != (header->tile_height == 0)) return -1;
+    if (header->tile_width > INT32_MAX || header->tile_height > INT32_MAX) return -1;
+
+    *width = (int)header->width;
+    *height = (int)header->height;
+    *dtype = (int)header->dtype;
+    *tile_width = (int)header->tile_width;
+    *tile_height = (int)header->tile_height;
+
+    size_t data_size = dataSize(*width, *height, *dtype, *tile_width, *tile_height);
+    if (header->data_offset < sizeof(*header) || header->data_offset > file_size ||
+        file_size - header->data_offset < data_size) return -1;
+    return 0;
+}
+
+int sarRawOpen(const char *path, SarRawImage *image) {
+    memset(image, 0, sizeof(*image));
+
+    int result = mapFile(path, 0, 0, image);
+    if (result != SAR_RAW_OK) {
+        if (result == SAR_RAW_ERROR) printf("\nCould not map raw image: %s\n", path);
+        return result;
+    }
+
+    SarRawHeader header;
+    if (image->map_size < sizeof(header)) goto invalid;
+    memcpy(&header, image->map_base, sizeof(header));
+    if (readHeader(&header, image->map_size, &image->width, &image->height, &image->dtype, &image->tile_width,
+                   &image->tile_height) != 0) goto invalid;
+
+    unsigned char *data = image->map_base + header.data_offset;
+    if (image->tile_width == 0) {
+        image->pixels = data;
+        return SAR_RAW_OK;
+    }
+
+    // Untile into a row-major copy
+    size_t pixel_size = pixelSize(image->dtype);
+    size_t row_size = (size_t)image->width * pixel_size;
+    size_t tiles_x = tileCount(image->width, image->tile_width);
+    size_t tile_row_size = (size_t)image->tile_width * pixel_size;
+    size_t tile_size = tile_row_size * image->tile_height;
+
+    image->pixels = (unsigned char *)malloc(row_size * image->height);
+    if (!image->pixels) {
+        printf("\nOut of memory reading raw image: %s\n", path);
+        unmapFile(image);
+        return SAR_RAW_ERROR;
+    }
+    image->owns_pixels = 1;
+
+    for (int y = 0; y < image->height; y++) {
+        size_t ty = y / image->tile_height, in_y = y % image->tile_height;
+        for (size_t tx = 0; tx < tiles_x; tx++) {
+            size_t x0 = tx * image->tile_width;
+            size_t count = (size_t)image->width - x0;
+            if (count > (size_t)image->tile_width) count = image->tile_width;
+            memcpy(image->pixels + y * row_size + x0 * pixel_size,
+                   data + (ty * tiles_x + tx) * tile_size + in_y * tile_row_size,
+                   count * pixel_size);
+        }
+    }
+    return SAR_RAW_OK;
+
+invalid:
+    printf("\nInvalid raw image: %s\n", path);
+    unmapFile(image);
+    return SAR_RAW_ERROR;
+}
+
+int sarRawCreate(const char *path, int width, int height, int dtype, SarRawImage *image) {
+    memset(image, 0, sizeof(*image));
+    if (width <= 0 || height <= 0 || pixelSize(dtype) == 0) return SAR_RAW_ERROR;
+
+    if (mapFile(path, SAR_RAW_HEADER_SIZE + dataSize(width, height, dtype, 0, 0), 1, image) != SAR_RAW_OK) {
+        printf("\nCould not create raw image: %s\n", path);
+        return SAR_RAW_ERROR;
+    }
+
+    SarRawHeader header;
+    fillHeader(&header, width, height, dtype, 0, 0);
+    memcpy(image->map_base, &header, sizeof(header));
+
+    image->width = width;
+    image->height = height;
+    image->dtype = dtype;
+    image->pixels = image->map_base + SAR_RAW_HEADER_SIZE;
+    return SAR_RAW_OK;
+}
+
+void sarRawClose(SarRawImage *image) {
+    if (image->owns_pixels) free(image->pixels);
+    unmapFile(image);
+    image->pixels = NULL;
+}
+
+int sarRawWrite(const char *path, const void *data, int width, int height, int dtype,
+                int tile_width, int tile_height) {
+    const unsigned char *pixels = (const unsigned char *)data;
+    if (tile_width <= 0 || tile_height <= 0) tile_width = tile_height = 0;
+
+    SarRawImage image;
+    if (tile_width == 0) {
+        // Untiled: one copy into the mapped file
+        if (sarRawCreate(path, width, height, dtype, &image) != SAR_RAW_OK) return -1;
+        memcpy(image.pixels, pixels, (size_t)width * height * pixelSize(dtype));
+        sarRawClose(&image);
+        return 0;
+    }
+
+    size_t pixel_size = pixelSize(dtype);
+    if (width <= 0 || height <= 0 || pixel_size == 0) return -1;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("\nCould not create raw image: %s\n", path);
+        return -1;
+    }
+
+    SarRawHeader header;
+    fillHeader(&header, width, height, dtype, tile_width, tile_height);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // Tiles in row-major tile order, edge tiles zero padded
+    size_t tile_row_size = (size_t)tile_width * pixel_size;
+    unsigned char *tile = (unsigned char *)calloc(tile_height, tile_row_size);
+    ok = ok && tile;
+    for (int y0 = 0; ok && y0 < height; y0 += tile_height) {
+        for (int x0 = 0; ok && x0 < width; x0 += tile_width) {
+            int rows = height - y0 < tile_height ? height - y0 : tile_height;
+            int cols = width - x0 < tile_width ? width - x0 : tile_width;
+            memset(tile, 0, tile_row_size * tile_height);
+            for (int y = 0; y < rows; y++)
+                memcpy(tile + y * tile_row_size, pixels + ((size_t)(y0 + y) * width + x0) * pixel_size,
+                       cols * pixel_size);
+            ok = fwrite(tile, tile_row_size, tile_height, file) == (size_t)tile_height;
+        }
+    }
+    free(tile);
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok) {
+        printf("\nCould not write raw image: %s\n", path);
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+int sarRawStreamOpen(const char *path, SarRawStream *stream) {
+    memset(stream, 0, sizeof(*stream));
+    stream->file = fopen(path, "rb");
+    if (!stream->file) return errno == ENOENT ? SAR_RAW_MISSING : SAR_RAW_ERROR;
+
+    SarRawHeader header;
+    long long file_size = -1;
+    if (seekFile(stream->file, 0, SEEK_END) == 0) file_size = (long long)tellFile(stream->file);
+    if (file_size < (long long)sizeof(header) || seekFile(stream->file, 0, SEEK_SET) != 0 ||
+        fread(&header, sizeof(header), 1, stream->file) != 1 ||
+        readHeader(&header, (size_t)file_size, &stream->width, &stream->height, &stream->dtype,
+                   &stream->tile_width, &stream->tile_height) != 0) {
+        printf("\nInvalid raw image: %s\n", path);
+        fclose(stream->file);
+        stream->file = NULL;
+        return SAR_RAW_ERROR;
+    }
+    stream->data_offset = (long long)header.data_offset;
+    return SAR_RAW_OK;
+}
+
+int sarRawStreamCreate(const char *path, int width, int height, int dtype, int create, SarRawStream *stream) {
+    memset(stream, 0, sizeof(*stream));
+    if (width <= 0 || height <= 0 || pixelSize(dtype) == 0) return -1;
+
+    long long size = SAR_RAW_HEADER_SIZE + (long long)dataSize(width, height, dtype, 0, 0);
+    stream->file = fopen(path, create ? "w+b" : "r+b");
+    int ok = stream->file != NULL;
+    if (ok && create) {
+        // Header, then one byte at the very end to give the file its full size,
+        // flushed so that other processes can open it right away
+        SarRawHeader header;
+        fillHeader(&header, width, height, dtype, 0, 0);
+        ok = fwrite(&header, sizeof(header), 1, stream->file) == 1 && seekFile(stream->file, size - 1, SEEK_SET) == 0 &&
+             fputc(0, stream->file) != EOF && fflush(stream->file) == 0;
+    } else if (ok) {
+        ok = seekFile(stream->file, 0, SEEK_END) == 0 && (long long)tellFile(stream->file) == size;
+    }
+    if (!ok) {
+        printf("\nCould not create raw image: %s\n", path);
+        if (stream->file) fclose(stream->file);
+        stream->file = NULL;
+        return -1;
+    }
+    stream->width = width;
+    stream->height = height;
+    stream->dtype = dtype;
+    stream->data_offset = SAR_RAW_HEADER_SIZE;
+    return 0;
+}
+
+int sarRawReadRows(SarRawStream *stream, int first_row, int rows, void *data) {
+    unsigned char *pixels = (unsigned char *)data;
+    size_t pixel_size = pixelSize(stream->dtype);
+    size_t row_size = (size_t)stream->width * pixel_size;
+    if (first_row < 0 || rows < 0 || first_row + rows > stream->height) return -1;
+
+    if (stream->tile_width == 0) {
+        return seekFile(stream->file, stream->data_offset + (long long)first_row * row_size, SEEK_SET) == 0 &&
+               fread(pixels, row_size, rows, stream->file) == (size_t)rows ? 0 : -1;
+    }
+
+    // Tiled: every row is pieced together from one row of each tile it crosses
+    size_t tiles_x = tileCount(stream->width, stream->tile_width);
+    size_t tile_row_size = (size_t)stream->tile_width * pixel_size;
+    size_t tile_size = tile_row_size * stream->tile_height;
+    for (int y = first_row; y < first_row + rows; y++) {
+        size_t ty = y / stream->tile_height, in_y = y % stream->tile_height;
+        for (size_t tx = 0; tx < tiles_x; tx++) {
+            size_t x0 = tx * stream->tile_width;
+            size_t count = (size_t)stream->width - x0;
+            if (count > (size_t)stream->tile_width) count = stream->tile_width;
+            long long offset = stream->data_offset + (long long)((ty * tiles_x + tx) * tile_size + in_y * tile_row_size);
+            if (seekFile(stream->file, offset, SEEK_SET) != 0 ||
+                fread(pixels + (size_t)(y - first_row) * row_size + x0 * pixel_size, pixel_size, count,
+                      stream->file) != count)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int sarRawWriteRows(SarRawStream *stream, int first_row, int rows, const void *pixels) {
+    size_t row_size = (size_t)stream->width * pixelSize(stream->dtype);
+    if (first_row < 0 || rows < 0 || first_row + rows > stream->height || stream->tile_width != 0) return -1;
+    return seekFile(stream->file, stream->data_offset + (long long)first_row * row_size, SEEK_SET) == 0 &&
+           fwrite(pixels, row_size, rows, stream->file) == (size_t)rows ? 0 : -1;
+}
+
+int sarRawStreamClose(SarRawStream *stream) {
+    int ok = !stream->file || fclose(stream->file) == 0;
+    stream->file = NULL;
+    return ok ? 0 : -1;
+}
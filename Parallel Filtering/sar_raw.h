@@ -0,0 +1,91 @@
+#ifndef SAR_RAW_H
+#define SAR_RAW_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "pixel_type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Raw planar container: a fixed 64-byte header followed by the pixels, either
+// row-major or split into fixed-size tiles. Files are read and written through
+// memory mappings, so an untiled image is filtered straight from the mapped pages
+// with no decode and written with no encode.
+//
+// A raw copy of <name> is looked up as <name>SAR_RAW_EXTENSION (see sar_convert.c);
+// when it exists the binaries read it instead of the PNG/JPEG and write raw output.
+#define SAR_RAW_EXTENSION ".sarraw"
+#define SAR_RAW_MAGIC "SARRAW01"
+#define SAR_RAW_HEADER_SIZE 64
+
+// sarRawOpen results
+#define SAR_RAW_OK 0
+#define SAR_RAW_MISSING 1   // No such file; not an error
+#define SAR_RAW_ERROR (-1)  // Unreadable or malformed file (reported on stdout)
+
+typedef struct {
+    int width;
+    int height;
+    int dtype;          // PixelType
+    int tile_width;     // 0 when the file is untiled
+    int tile_height;
+    unsigned char *pixels;  // Row-major width*height samples of dtype
+    // Mapping state
+    unsigned char *map_base;
+    size_t map_size;
+    int owns_pixels;    // pixels was untiled into a heap copy, not the mapping
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+} SarRawImage;
+
+// Map a raw file. The mapping is copy-on-write: the caller may filter pixels in
+// place without touching the file. Tiled files are untiled into a heap copy.
+int sarRawOpen(const char *path, SarRawImage *image);
+
+// Create an untiled raw file and map it writable. Pixels written to
+// image->pixels land in the file; sarRawClose flushes them.
+int sarRawCreate(const char *path, int width, int height, int dtype, SarRawImage *image);
+
+void sarRawClose(SarRawImage *image);
+
+// Write a row-major buffer to a raw file, tiled when tile_width/tile_height > 0.
+// Returns 0 on success.
+int sarRawWrite(const char *path, const void *pixels, int width, int height, int dtype,
+                int tile_width, int tile_height);
+
+// Row access through stdio for scenes too large to map or hold in memory:
+// only the rows asked for are ever in memory.
+typedef struct {
+    FILE *file;
+    int width;
+    int height;
+    int dtype;
+    int tile_width;     // 0 when the file is untiled
+    int tile_height;
+    long long data_offset;
+} SarRawStream;
+
+// Open a raw file for reading rows. Returns SAR_RAW_OK, SAR_RAW_MISSING or SAR_RAW_ERROR.
+int sarRawStreamOpen(const char *path, SarRawStream *stream);
+
+// Open an untiled raw file for writing rows. With create the file is created
+// (or truncated) at its full size first; otherwise an existing file of that size
+// is opened, so several processes can each write their own rows. Returns 0 on success.
+int sarRawStreamCreate(const char *path, int width, int height, int dtype, int create, SarRawStream *stream);
+
+// Read or write rows [first_row, first_row + rows) as row-major samples. Returns 0 on success.
+int sarRawReadRows(SarRawStream *stream, int first_row, int rows, void *pixels);
+int sarRawWriteRows(SarRawStream *stream, int first_row, int rows, const void *pixels);
+
+// Returns 0 if everything written reached the file
+int sarRawStreamClose(SarRawStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+#include "scene_stream.h"
+#include "sar_raw.h"
+#include "cluster.h"
+#include "image_io.h"
+#include "buffer_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+int chainStreams(const FilterChain *chain, int verbose) {
+    for (int i = 0; i < chain->count; i++) {
+        if (chain->stages[i].kind == FILTER_ADAPTIVE_WIENER && chain->stages[i].noise < 0) {
+            if (verbose)
+                printf("Loading large scenes whole: stage %d (adaptive-wiener) estimates its noise over the "
+                       "image; give it a fixed noise to stream them\n", i + 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int isLargeScene(const char *image_dir, const char *file_name, long long threshold) {
+    char raw_path[512];
+    SarRawStream stream;
+
+    snprintf(raw_path, sizeof(raw_path), "%s/%s%s", image_dir, file_name, SAR_RAW_EXTENSION);
+    if (sarRawStreamOpen(raw_path, &stream) != SAR_RAW_OK) return 0;
+    long long size = (long long)stream.width * stream.height * pixelSize(stream.dtype);
+    sarRawStreamClose(&stream);
+    return size >= threshold;
+}
+
+// Rank 0 creates the output at its full size; the other ranks open it once it exists
+static int openSceneOutput(const char *path, const SarRawStream *input, SarRawStream *output) {
+    int rank = clusterRank();
+    int created = rank != 0 ||
+                  sarRawStreamCreate(path, input->width, input->height, input->dtype, 1, output) == 0;
+    if (!clusterAllOk(created)) {
+        if (rank == 0 && created) sarRawStreamClose(output);
+        return 0;
+    }
+    int opened = rank == 0 ||
+                 sarRawStreamCreate(path, input->width, input->height, input->dtype, 0, output) == 0;
+    if (!clusterAllOk(opened)) {
+        if (opened) sarRawStreamClose(output);
+        return 0;
+    }
+    return 1;
+}
+
+// Scale the streamed full-size output at full_path to the output size with
+// every core and save it as the scene's output
+static int resizeScene(DatasetJob *job, int image, const char *full_path, const char *output_path, int thread) {
+    SarRawImage full;
+    int width, height;
+    if (sarRawOpen(full_path, &full) != SAR_RAW_OK) return 0;
+    void *resized = resizeOutputImage(full.pixels, full.width, full.height, full.dtype, job->output,
+                                      omp_get_max_threads(), &width, &height, job->report, image, thread);
+    int written = resized && saveOutputImage(output_path, resized, width, height, full.dtype, job->output, 1,
+                                             job->report, image, thread);
+    if (!resized) printf("\nOut of memory resizing image: %s\n", output_path);
+    poolFree(resized);
+    sarRawClose(&full);
+    return written;
+}
+
+int streamScene(DatasetJob *job, const FilterBackend *backend, int image, int band_rows, int thread) {
+    char image_path[512], output_path[512], raw_path[520], out_path[540];
+    SarRawStream input, output;
+    RunReport *report = job->report;
+    int rank = clusterRank(), size = clusterSize();
+
+    memset(&output, 0, sizeof(output));
+    datasetImagePaths(job, image, image_path, output_path);
+    snprintf(raw_path, sizeof(raw_path), "%s%s", image_path, SAR_RAW_EXTENSION);
+
+    int opened = sarRawStreamOpen(raw_path, &input) == SAR_RAW_OK;
+    // As loadInputImage skips wide raw files in a run without wide samples
+    if (opened && input.dtype != PIXEL_U8 && !job->wide_samples) {
+        printf("\nSkipping %s image: %s\n", pixelTypeName(input.dtype), raw_path);
+        sarRawStreamClose(&input);
+        opened = 0;
+    }
+    if (!clusterAllOk(opened)) {
+        if (opened) sarRawStreamClose(&input);
+        if (rank == 0) datasetImageDone(job, image, thread, 0);
+        return 0;
+    }
+
+    // Every rank filters its block of the rows, a band at a time, with the halo around each band
+    int width = input.width, height = input.height;
+    size_t row_size = (size_t)width * pixelSize(input.dtype);
+    int halo = chainHaloRows(job->chain);
+    if (band_rows <= 0) band_rows = (int)(STREAM_BAND_BYTES / (long long)row_size);
+    if (band_rows < 1) band_rows = 1;
+    if (band_rows > height) band_rows = height;
+    int first = clusterBlockStart(height, rank, size), last = clusterBlockStart(height, rank + 1, size);
+
+    // A scene scaled for output is streamed into a full-size copy next to it first
+    int out_width, out_height;
+    int resizing = outputSize(job->output, width, height, &out_width, &out_height);
+    snprintf(out_path, sizeof(out_path), "%s%s%s", output_path, resizing ? STREAM_FULL_SUFFIX : "",
+             SAR_RAW_EXTENSION);
+
+    size_t band_size = (size_t)(band_rows + 2 * halo) * row_size;
+    unsigned char *src = (unsigned char *)malloc(band_size);
+    unsigned char *dst = (unsigned char *)malloc(band_size);
+    int ok = src && dst;
+    if (!ok) printf("\nOut of memory for a band of %d rows of %s\n", band_rows, image_path);
+    int have_output = clusterAllOk(ok) && openSceneOutput(out_path, &input, &output);
+    ok = have_output;
+
+    size_t bytes_read = 0, bytes_written = 0;
+    for (int y0 = first; ok && y0 < last; y0 += band_rows) {
+        int y1 = y0 + band_rows < last ? y0 + band_rows : last;
+        int top = y0 - halo > 0 ? y0 - halo : 0;
+        int bottom = y1 + halo < height ? y1 + halo : height;
+
+        double start_time = wallClockSeconds();
+        ok = sarRawReadRows(&input, top, bottom - top, src) == 0;
+        double read_time = wallClockSeconds();
+        runReportStage(report, image, thread, STAGE_READ, read_time - start_time);
+        if (!ok) {
+            printf("\nError reading rows %d-%d of %s\n", top, bottom - 1, raw_path);
+            break;
+        }
+        bytes_read += (size_t)(bottom - top) * row_size;
+
+        ok = backend->filter_frame(src, dst, width, bottom - top, input.dtype);
+        double filter_time = wallClockSeconds();
+        runReportStage(report, image, thread, STAGE_FILTER, filter_time - read_time);
+        if (!ok) {
+            printf("\nThe %s backend could not filter %s\n", backend->name, image_path);
+            break;
+        }
+
+        // Only the band itself is written; its halo rows are the neighbouring bands'
+        ok = sarRawWriteRows(&output, y0, y1 - y0, dst + (size_t)(y0 - top) * row_size) == 0;
+        runReportStage(report, image, thread, STAGE_ENCODE, wallClockSeconds() - filter_time);
+        if (!ok) printf("\nError writing %s\n", out_path);
+        bytes_written += (size_t)(y1 - y0) * row_size;
+    }
+    free(src);
+    free(dst);
+    sarRawStreamClose(&input);
+    if (output.file && sarRawStreamClose(&output) != 0) {
+        printf("\nError writing %s\n", out_path);
+        ok = 0;
+    }
+    ok = clusterAllOk(ok);
+
+    // Rank 0 records the whole file, so the journal sees the output's size
+    // (saveOutputImage records the scaled one)
+    if (rank == 0) bytes_written = resizing ? 0 : SAR_RAW_HEADER_SIZE + (size_t)height * row_size;
+    if (resizing && rank == 0) {
+        ok = ok && resizeScene(job, image, out_path, output_path, thread);
+        remove(out_path);
+    } else if (!ok && have_output && rank == 0) {
+        remove(out_path);  // A scene that failed part of the way leaves no output behind
+    }
+    if (resizing) ok = clusterAllOk(ok);
+    runReportBytes(report, image, thread, bytes_read, ok ? bytes_written : 0);
+    if (rank == 0) datasetImageDone(job, image, thread, ok);
+    return ok;
+}
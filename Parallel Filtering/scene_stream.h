@@ -0,0 +1,47 @@
+#ifndef SCENE_STREAM_H
+#define SCENE_STREAM_H
+
+#include "backend.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Band-by-band filtering of scenes too large to load whole. A scene with a
+// converted raw copy of at least DatasetOptions.stream_above bytes is read a
+// band of rows at a time, together with chainHaloRows() rows above and below
+// it, filtered with the backend's filter_frame (all of its threads, or the
+// GPU) and written into the raw output before the next band is read, so peak
+// memory is two bands whatever the scene size. Because the halo covers every
+// stage's window, the output is the same as filtering the scene whole.
+//
+// With --resize the bands go into a full-size raw copy next to the output
+// (STREAM_FULL_SUFFIX), which is then scaled to the output size from its
+// mapping, with every core, and removed.
+//
+// In a multi-node run every rank streams its own block of the scene's rows
+// into the one output file, reading the halo rows of its neighbours from the
+// shared filesystem rather than exchanging them.
+
+#define STREAM_ABOVE_BYTES (1024LL * 1024 * 1024)  // Default --stream-above: 1 GiB of samples
+#define STREAM_BAND_BYTES (64LL * 1024 * 1024)     // Default band: 64 MiB of samples
+#define STREAM_FULL_SUFFIX ".full"                   // Full-size copy of a scene that is scaled for output
+
+// 1 if the chain can be run band by band: every stage only looks at its window
+// (an adaptive Wiener stage that estimates its noise over the image cannot).
+// With verbose, says why not.
+int chainStreams(const FilterChain *chain, int verbose);
+
+// 1 if image_dir/file_name has a raw copy of at least threshold bytes of samples
+int isLargeScene(const char *image_dir, const char *file_name, long long threshold);
+
+// Filter image band by band with backend (prepared) into its output path plus
+// SAR_RAW_EXTENSION (scaled to the output size, in its format, with --resize), in bands of band_rows rows (0 = STREAM_BAND_BYTES), and
+// record it under thread. Collective in a multi-node run. Returns 1 if written.
+int streamScene(DatasetJob *job, const FilterBackend *backend, int image, int band_rows, int thread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+#include "service.h"
+#include "backend.h"
+#include "cluster.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <time.h>
+#endif
+
+#define MAX_JOB_ARGS 128  // Options and values of one job
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+static void sleepMilliseconds(int milliseconds) {
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    struct timespec delay = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+#endif
+}
+
+// Write queue_dir/NAME into path (SERVICE_MAX_PATH bytes), where NAME is the
+// first length bytes of name followed by suffix. Returns 1 if it fits.
+static int queuePath(char *path, const char *queue_dir, const char *name, int length, const char *suffix) {
+    int size = snprintf(path, SERVICE_MAX_PATH, "%s/%.*s%s", queue_dir, length, name, suffix);
+    return size >= 0 && size < SERVICE_MAX_PATH;
+}
+
+static int isJobName(const char *name) {
+    size_t length = strlen(name), suffix = strlen(SERVICE_JOB_SUFFIX);
+    return length > suffix && strcmp(name + length - suffix, SERVICE_JOB_SUFFIX) == 0;
+}
+
+// Keep name in first (SERVICE_MAX_NAME bytes) if it is a job that sorts before the one there
+static void considerJob(const char *name, char *first) {
+    if (isJobName(name) && strlen(name) < SERVICE_MAX_NAME && (!first[0] || strcmp(name, first) < 0))
+        strcpy(first, name);
+}
+
+// The name of the queue's first job in name order into first (SERVICE_MAX_NAME bytes).
+// Returns 1 if there is one.
+static int firstJob(const char *queue_dir, char *first) {
+    first[0] = '\0';
+#ifdef _WIN32
+    char pattern[SERVICE_MAX_PATH];
+    struct _finddata_t entry;
+    if (!queuePath(pattern, queue_dir, "*", 1, SERVICE_JOB_SUFFIX)) return 0;
+    intptr_t handle = _findfirst(pattern, &entry);
+    if (handle == -1) return 0;
+    do considerJob(entry.name, first);
+    while (_findnext(handle, &entry) == 0);
+    _findclose(handle);
+#else
+    DIR *dir = opendir(queue_dir);
+    if (!dir) return 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) considerJob(entry->d_name, first);
+    closedir(dir);
+#endif
+    return first[0] != '\0';
+}
+
+// Read a job file whole, NUL-terminated. Returns NULL (after saying why) if it cannot.
+static char *readJob(const char *path) {
+    FILE *file = fopen(path, "rb");
+    char *text = (char *)malloc(SERVICE_MAX_JOB_BYTES + 1);
+    size_t size = file && text ? fread(text, 1, SERVICE_MAX_JOB_BYTES + 1, file) : 0;
+    if (file) fclose(file);
+    if (!file || !text || size > SERVICE_MAX_JOB_BYTES) {
+        printf(!file ? "Could not open job: %s\n" : !text ? "Out of memory reading job: %s\n"
+                                                         : "Job too large: %s\n", path);
+        free(text);
+        return NULL;
+    }
+    text[size] = '\0';
+    return text;
+}
+
+// Split the lines of a job into options and their values, in place. Returns
+// the number of arguments, or -1 if there are more than capacity.
+static int splitJob(char *text, char **argv, int capacity) {
+    int argc = 0;
+    char *line = text;
+    while (line) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        while (*line == ' ' || *line == '\t') line++;
+        char *end = line + strlen(line);
+        while (end > line && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) *--end = '\0';
+        if (line[0] && line[0] != '#') {
+            char *value = line + strcspn(line, " \t");
+            if (argc + 2 > capacity) return -1;
+            argv[argc++] = line;
+            if (*value) {
+                *value++ = '\0';
+                while (*value == ' ' || *value == '\t') value++;
+                argv[argc++] = value;
+            }
+        }
+        line = next;
+    }
+    return argc;
+}
+
+// Write the status file of job name, NAME.done or NAME.failed, through a
+// temporary copy, so that it never appears half-written
+static void writeStatus(const char *queue_dir, const char *name, int written, double seconds) {
+    const char *suffix = written >= 0 ? ".done" : ".failed";
+    int base_length = (int)(strlen(name) - strlen(SERVICE_JOB_SUFFIX));
+    char path[SERVICE_MAX_PATH], temporary[SERVICE_MAX_PATH];
+    if (!queuePath(path, queue_dir, name, base_length, suffix) ||
+        snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        printf("Status path too long for job: %s\n", name);
+        return;
+    }
+    FILE *file = fopen(temporary, "w");
+    if (!file) {
+        printf("Could not write job status: %s\n", path);
+        return;
+    }
+    if (written >= 0) fprintf(file, "%d images written or up to date in %.3f seconds\n", written, seconds);
+    else fprintf(file, "failed after %.3f seconds\n", seconds);
+    fclose(file);
+    remove(path);
+    if (rename(temporary, path) != 0) printf("Could not write job status: %s\n", path);
+}
+
+// Run the claimed job name (renamed to running_path) and write its status. Returns 1 if it succeeded.
+static int runClaimedJob(const char *queue_dir, const char *name, const char *running_path,
+                         ServiceJobFunction run_job, void *context) {
+    char *argv[MAX_JOB_ARGS];
+    int written = -1;
+    double start_time = wallClockSeconds();
+
+    printf("\nJob %s\n", name);
+    char *text = readJob(running_path);
+    int argc = text ? splitJob(text, argv, MAX_JOB_ARGS) : 0;
+    if (text && argc < 0) printf("Too many options in job: %s\n", name);
+    else if (text) written = run_job(argc, argv, context);
+    free(text);
+    double seconds = wallClockSeconds() - start_time;
+
+    writeStatus(queue_dir, name, written, seconds);
+    remove(running_path);
+
+    if (written >= 0) printf("Job %s: %d images in %.3f seconds\n", name, written, seconds);
+    else printf("Job %s failed\n", name);
+    fflush(stdout);
+    return written >= 0;
+}
+
+int serveQueue(const char *queue_dir, ServiceJobFunction run_job, void *context) {
+    char stop_path[SERVICE_MAX_PATH];
+    int jobs = 0, failed = 0;
+
+    if (clusterSize() > 1) {
+        printf("--serve runs on a single node\n");
+        return 1;
+    }
+    // Every job path then fits: a job's longest one is its claimed copy
+    if (strlen(queue_dir) + 1 + SERVICE_MAX_NAME + strlen(SERVICE_RUNNING_SUFFIX) > SERVICE_MAX_PATH) {
+        printf("Queue directory path too long: %s\n", queue_dir);
+        return 1;
+    }
+    if (makeDirectory(queue_dir) != 0) {
+        printf("Error creating queue directory: %s\n", queue_dir);
+        return 1;
+    }
+    queuePath(stop_path, queue_dir, SERVICE_STOP_FILE, (int)strlen(SERVICE_STOP_FILE), "");
+
+    void (*previous_int)(int) = signal(SIGINT, requestStop);
+    void (*previous_term)(int) = signal(SIGTERM, requestStop);
+    keepBackendsPrepared(1);
+    printf("Serving jobs from %s (stop with %s/%s)\n", queue_dir, queue_dir, SERVICE_STOP_FILE);
+    fflush(stdout);
+
+    // Removing the stop file tells this service, and only this one, to stop
+    while (!stop_requested && remove(stop_path) != 0) {
+        char name[SERVICE_MAX_NAME], job_path[SERVICE_MAX_PATH], running_path[SERVICE_MAX_PATH];
+        if (!firstJob(queue_dir, name)) {
+            sleepMilliseconds(SERVICE_POLL_MS);
+            continue;
+        }
+        // Checked above, but never left to find the same unclaimable job on every scan
+        if (!queuePath(job_path, queue_dir, name, (int)strlen(name), "") ||
+            !queuePath(running_path, queue_dir, name, (int)strlen(name), SERVICE_RUNNING_SUFFIX)) {
+            printf("Job path too long, stopping: %s/%s\n", queue_dir, name);
+            break;
+        }
+        // Gone if another service claimed it first. One that stays is failed
+        // and removed rather than found again on the next scan.
+        if (rename(job_path, running_path) != 0) {
+            FILE *unclaimed = fopen(job_path, "rb");
+            if (!unclaimed) continue;
+            fclose(unclaimed);
+            printf("\nCould not claim job: %s\n", job_path);
+            jobs++;
+            failed++;
+            writeStatus(queue_dir, name, -1, 0.0);
+            if (remove(job_path) != 0) {
+                printf("Could not remove job, stopping: %s\n", job_path);
+                break;
+            }
+            continue;
+        }
+        jobs++;
+        if (!runClaimedJob(queue_dir, name, running_path, run_job, context)) failed++;
+    }
+
+    releasePreparedBackends();
+    signal(SIGINT, previous_int);
+    signal(SIGTERM, previous_term);
+    printf("\nService stopped after %d jobs (%d failed)\n", jobs, failed);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Long-running service mode (--serve DIR). Rather than one dataset per
+// process, the driver takes jobs from a queue directory and runs each through
+// processDataset with the backends left prepared between jobs
+// (keepBackendsPrepared): a CUDA backend sets up its device, kernels and pinned
+// stream buffers once, not per job, and the buffer pool's frames, the OpenMP
+// threads and the stencil kernel selection carry over too. Only a job with a
+// different chain prepares its backends again.
+//
+// A job is a file NAME.job in the directory with dataset, chain and backend
+// selection options, one per line (option, a space, then the value, which may
+// itself contain spaces; # starts a comment line), on top of the service's own
+// command line (backend options such as --mode and --batch are the service's
+// alone), for example:
+//
+//   --json /data/pass42/_annotations.coco.json
+//   --images /data/pass42
+//   --output /data/pass42/filtered
+//
+// or --files a.png,b.png with --images and --output for single images. Jobs
+// are taken in name order. A job is claimed by renaming it to
+// NAME.job.running, so several services can share one directory, and once it
+// has run the service writes NAME.done (or NAME.failed) with the number of
+// images written and the time taken, and removes the claimed file. The
+// service stops when a file named SERVICE_STOP_FILE appears in the directory
+// (it is removed), or on SIGINT or SIGTERM once the job in progress is done.
+// Service mode runs on a single node.
+
+#define SERVICE_JOB_SUFFIX ".job"
+#define SERVICE_RUNNING_SUFFIX ".running"   // Appended to a claimed job
+#define SERVICE_STOP_FILE "stop"
+#define SERVICE_POLL_MS 100                 // Wait between scans of an empty queue
+#define SERVICE_MAX_JOB_BYTES (64 * 1024)
+#define SERVICE_MAX_NAME 256                // Longest job file name plus one; longer ones are left alone
+#define SERVICE_MAX_PATH 1024               // Longest path of a job, its claimed copy or its status file
+
+// Runs one job from its options (argv[0] is the first option). Returns the
+// number of images written or up to date, or -1 if the job failed.
+typedef int (*ServiceJobFunction)(int argc, char **argv, void *context);
+
+// Run the jobs of queue_dir with run_job until stopped. Returns 0 once
+// stopped, 1 if the service could not start.
+int serveQueue(const char *queue_dir, ServiceJobFunction run_job, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif